@@ -0,0 +1,284 @@
+/*
+ * accesslog.c - An asynchronous access log for Tiny. See accesslog.h.
+ */
+#include "accesslog.h"
+
+/* A record: this header, then len bytes of text, padded to 8 bytes */
+typedef struct {
+    unsigned int len;
+    unsigned int kind;
+} alog_hdr_t;
+
+#define RECSIZE(len) (sizeof(alog_hdr_t) + (((len) + 7) & ~(size_t)7))
+
+typedef struct alog_ring {
+    char *buf;                 /* ALOG_RINGSIZE bytes, 8-byte aligned */
+    unsigned long head;        /* Bytes ever written (owner; release) */
+    unsigned long tail;        /* Bytes ever drained (drain; release) */
+    int owned;                 /* Does a live thread write to it? */
+    int sampled;               /* Log this thread's current request? */
+    unsigned long nconns;      /* Sampling: connections and requests seen */
+    unsigned long nreqs;
+    unsigned long logged;      /* Counters: owner writes, anyone reads */
+    unsigned long skipped;
+    unsigned long dropped;
+    struct alog_ring *next;    /* All rings; never removed */
+} alog_ring_t;
+
+int alog_on = 0;
+static int alog_every;
+static alog_ring_t *rings;
+static pthread_key_t ring_key;
+static __thread alog_ring_t *myring;
+
+/*
+ * ring_release - thread-specific data destructor: a thread that exits
+ *     hands its ring on to the next new thread. What it logged is
+ *     still drained.
+ */
+static void ring_release(void *vargp)
+{
+    alog_ring_t *r = vargp;
+
+    __atomic_store_n(&r->owned, 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * ring_get - return the calling thread's ring, taking over one left by
+ *     a thread that exited, or adding a new one, the first time
+ */
+static alog_ring_t *ring_get(void)
+{
+    alog_ring_t *r;
+    int zero;
+
+    if (myring)
+	return myring;
+    for (r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r; r = r->next) {
+	zero = 0;
+	if (__atomic_compare_exchange_n(&r->owned, &zero, 1, 0,
+					__ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+	    break;
+    }
+    if (!r) {
+	r = Calloc(1, sizeof(alog_ring_t));
+	r->buf = Malloc(ALOG_RINGSIZE);
+	r->owned = 1;
+	r->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&rings, &r->next, r, 0,
+					    __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+	    ;
+    }
+    pthread_setspecific(ring_key, r);
+    return myring = r;
+}
+
+/*
+ * put - queue a record of the given kind whose text is the count
+ *     pieces s[i] of n[i] bytes, or count it dropped if the ring is
+ *     too full to take it
+ */
+static void put(int kind, char **s, size_t *n, int count)
+{
+    alog_ring_t *r = ring_get();
+    unsigned long head = r->head, tail;
+    size_t len = 0, need, room, off;
+    alog_hdr_t *h;
+    char *p;
+    int i;
+
+    for (i = 0; i < count; i++) {
+	if (n[i] > ALOG_MAXTEXT - len)
+	    n[i] = ALOG_MAXTEXT - len;
+	len += n[i];
+    }
+    need = RECSIZE(len);
+    off = head & (ALOG_RINGSIZE - 1);
+    room = ALOG_RINGSIZE - off;         /* Contiguous bytes before the end */
+    if (room < need)
+	need += room;                   /* Pad to the end and start over */
+    tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+    if (need > ALOG_RINGSIZE - (head - tail)) {
+	__atomic_store_n(&r->dropped, r->dropped + 1, __ATOMIC_RELAXED);
+	return;
+    }
+
+    if (room < RECSIZE(len)) {
+	h = (alog_hdr_t *)(r->buf + off);
+	h->kind = ALOG_PAD;
+	h->len = room - sizeof(alog_hdr_t);
+	head += room;
+	off = 0;
+    }
+    h = (alog_hdr_t *)(r->buf + off);
+    h->kind = kind;
+    h->len = len;
+    p = (char *)(h + 1);
+    for (i = 0; i < count; i++) {
+	memcpy(p, s[i], n[i]);
+	p += n[i];
+    }
+    __atomic_store_n(&r->head, head + RECSIZE(len), __ATOMIC_RELEASE);
+    __atomic_store_n(&r->logged, r->logged + 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * alog_sample - decide whether to log the connection (kind ALOG_ACCEPT)
+ *     or request (ALOG_REQUEST) the calling thread is about to log:
+ *     one of each in every alog_every. The answer for a request also
+ *     holds for the response that alog_response logs next.
+ */
+int alog_sample(int kind)
+{
+    alog_ring_t *r = ring_get();
+    int yes;
+
+    if (kind == ALOG_ACCEPT)
+	yes = r->nconns++ % alog_every == 0;
+    else
+	yes = r->sampled = r->nreqs++ % alog_every == 0;
+    if (!yes)
+	__atomic_store_n(&r->skipped, r->skipped + 1, __ATOMIC_RELAXED);
+    return yes;
+}
+
+/*
+ * alog_accept - log a new client's address
+ */
+void alog_accept(char *host, char *port)
+{
+    char *s[3] = { host, ", ", port };
+    size_t n[3] = { strlen(host), 2, strlen(port) };
+
+    put(ALOG_ACCEPT, s, n, 3);
+}
+
+/*
+ * alog_request - log a request head of len bytes
+ */
+void alog_request(char *head, size_t len)
+{
+    put(ALOG_REQUEST, &head, &len, 1);
+}
+
+/*
+ * alog_response - log a response head, given in up to three pieces
+ *     (a NULL piece is left out), if its request was sampled
+ */
+void alog_response(char *s1, size_t n1, char *s2, size_t n2,
+		   char *s3, size_t n3)
+{
+    char *s[3] = { s1, s2, s3 };
+    size_t n[3] = { n1, n2, n3 };
+
+    if (ring_get()->sampled)
+	put(ALOG_RESPONSE, s, n, s3 ? 3 : s2 ? 2 : 1);
+}
+
+/*
+ * out_flush - write out the drain's batch. If stdout has gone away, so
+ *     has the log; the server carries on.
+ */
+static void out_flush(char *out, size_t *outlen)
+{
+    rio_writen(STDOUT_FILENO, out, *outlen);
+    *outlen = 0;
+}
+
+/*
+ * out_put - add n bytes to the drain's batch
+ */
+static void out_put(char *out, size_t *outlen, char *s, size_t n)
+{
+    if (*outlen + n > ALOG_OUTBUF)
+	out_flush(out, outlen);
+    memcpy(out + *outlen, s, n);
+    *outlen += n;
+}
+
+/*
+ * drain - thread routine: copy every ring's records to stdout, in
+ *     batches, as text in the format Tiny has always logged
+ */
+static void *drain(void *vargp)
+{
+    alog_ring_t *r;
+    unsigned long head, tail, dropped, reported = 0;
+    alog_hdr_t *h;
+    char *out = Malloc(ALOG_OUTBUF), *text, note[MAXLINE];
+    size_t outlen = 0, pass;
+    int n;
+
+    Pthread_detach(pthread_self());
+    while (1) {
+	dropped = pass = 0;
+	for (r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r; r = r->next) {
+	    dropped += __atomic_load_n(&r->dropped, __ATOMIC_RELAXED);
+	    tail = r->tail;
+	    head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+	    while (tail != head) {
+		h = (alog_hdr_t *)(r->buf + (tail & (ALOG_RINGSIZE - 1)));
+		text = (char *)(h + 1);
+		if (h->kind == ALOG_ACCEPT) {
+		    out_put(out, &outlen, "Accepted connection from (", 26);
+		    out_put(out, &outlen, text, h->len);
+		    out_put(out, &outlen, ")\n", 2);
+		}
+		else if (h->kind == ALOG_REQUEST)
+		    out_put(out, &outlen, text, h->len);
+		else if (h->kind == ALOG_RESPONSE) {
+		    out_put(out, &outlen, "Response headers:\n", 18);
+		    out_put(out, &outlen, text, h->len);
+		}
+		pass += h->len;
+		tail += RECSIZE(h->len);
+		__atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+	    }
+	}
+	if (dropped != reported) {
+	    n = snprintf(note, MAXLINE, "tiny: log: %lu records dropped\n",
+			 dropped - reported);
+	    out_put(out, &outlen, note, n);
+	    reported = dropped;
+	}
+	/* Unless the rings filled a whole batch since the last pass, let
+	   records pile up for a while, so each write carries many */
+	if (outlen > 0)
+	    out_flush(out, &outlen);
+	if (pass < ALOG_OUTBUF)
+	    usleep(ALOG_IDLE);
+    }
+    return NULL;
+}
+
+/*
+ * alog_init - turn logging on, one connection and one request in every
+ *     every, and start the drain thread
+ */
+void alog_init(int every)
+{
+    pthread_t tid;
+    int rc;
+
+    if ((rc = pthread_key_create(&ring_key, ring_release)) != 0)
+	posix_error(rc, "pthread_key_create error");
+    alog_every = every;
+    Pthread_create(&tid, NULL, drain, NULL);
+    alog_on = 1;
+}
+
+/*
+ * alog_getstats - add up the counters of every ring
+ */
+void alog_getstats(alog_stats_t *st)
+{
+    alog_ring_t *r;
+
+    memset(st, 0, sizeof(*st));
+    for (r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r; r = r->next) {
+	st->logged += __atomic_load_n(&r->logged, __ATOMIC_RELAXED);
+	st->skipped += __atomic_load_n(&r->skipped, __ATOMIC_RELAXED);
+	st->dropped += __atomic_load_n(&r->dropped, __ATOMIC_RELAXED);
+	st->rings++;
+    }
+}
@@ -0,0 +1,52 @@
+/*
+ * accesslog.h - An asynchronous access log for Tiny (tiny -l).
+ *
+ * Threads serving requests never touch stdio. Each logs into a ring
+ * buffer of its own, a single-producer single-consumer queue of
+ * records (a kind, and the text the record is about: a client's
+ * address, a request head, or a response head), with nothing but a
+ * release store to publish one. A background thread drains every ring
+ * in turn, renders the records in Tiny's old log format, and writes
+ * them to stdout in batches of up to ALOG_OUTBUF bytes.
+ *
+ * A record that doesn't fit in its thread's ring is dropped and
+ * counted rather than waited for, so an overloaded log slows nothing
+ * down; the drain notes in the log itself how many were lost. With
+ * sampling, only one connection and one request in every alog_every
+ * is logged. Logging off (alog_on zero) costs the request path one
+ * test of alog_on per call site.
+ */
+#ifndef __ACCESSLOG_H__
+#define __ACCESSLOG_H__
+
+#include "csapp.h"
+
+#define ALOG_RINGSIZE (1 << 18)  /* Bytes of records per thread, power of 2 */
+#define ALOG_MAXTEXT  MAXBUF     /* Longer text is cut short */
+#define ALOG_OUTBUF   (1 << 16)  /* Bytes the drain writes at once */
+#define ALOG_IDLE     5000       /* us the drain sleeps after a short pass */
+
+/* Record kinds */
+#define ALOG_PAD      0   /* Filler up to the end of the ring */
+#define ALOG_ACCEPT   1   /* "host, port" of a new client */
+#define ALOG_REQUEST  2   /* A request head */
+#define ALOG_RESPONSE 3   /* The head of its response */
+
+typedef struct {
+    unsigned long logged;      /* Records queued */
+    unsigned long skipped;     /* Connections and requests sampled out */
+    unsigned long dropped;     /* Records lost to a full ring */
+    int rings;                 /* One per thread that ever logged */
+} alog_stats_t;
+
+extern int alog_on;            /* Nonzero once alog_init has run */
+
+void alog_init(int every);
+int alog_sample(int kind);
+void alog_accept(char *host, char *port);
+void alog_request(char *head, size_t len);
+void alog_response(char *s1, size_t n1, char *s2, size_t n2,
+		   char *s3, size_t n3);
+void alog_getstats(alog_stats_t *st);
+
+#endif /* __ACCESSLOG_H__ */
@@ -0,0 +1,283 @@
+/*
+ * cache.c - A shared, byte-bounded object cache with CLOCK eviction.
+ *     See cache.h for the locking and reference counting rules.
+ */
+#include "cache.h"
+
+#define atomic_inc(p) __atomic_add_fetch((p), 1, __ATOMIC_RELAXED)
+#define atomic_dec(p) __atomic_sub_fetch((p), 1, __ATOMIC_ACQ_REL)
+
+/* hash - FNV-1a hash of a key */
+static unsigned long hash(const char *key)
+{
+    unsigned long h = 14695981039346656037UL;
+
+    while (*key) {
+	h ^= (unsigned char)*key++;
+	h *= 1099511628211UL;
+    }
+    return h;
+}
+
+/* obj_free - free an object nobody refers to any more */
+static void obj_free(cache_obj_t *obj)
+{
+    Free(obj->key);
+    Free(obj->data);
+    Free(obj);
+}
+
+/*
+ * cache_init - create an empty cache that holds up to maxbytes bytes
+ *     of objects, none of them bigger than maxobj bytes
+ */
+void cache_init(cache_t *cp, size_t maxbytes, size_t maxobj)
+{
+    int rc;
+    pthread_rwlockattr_t attr;
+
+    /* Size the table for objects of about 4 KB, within reason */
+    cp->nbuckets = 64;
+    while (cp->nbuckets < (1 << 16) && cp->nbuckets * 4096 < maxbytes)
+	cp->nbuckets <<= 1;
+    cp->buckets = Calloc(cp->nbuckets, sizeof(cache_obj_t *));
+    cp->hand = NULL;
+    cp->admit = NULL;
+    cp->maxobj = maxobj < maxbytes ? maxobj : maxbytes;
+    memset(&cp->stats, 0, sizeof(cp->stats));
+    cp->stats.maxbytes = maxbytes;
+
+    /* Hits must not queue up behind a waiting insert */
+    pthread_rwlockattr_init(&attr);
+    pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_READER_NP);
+    if ((rc = pthread_rwlock_init(&cp->lock, &attr)) != 0)
+	posix_error(rc, "pthread_rwlock_init error");
+    pthread_rwlockattr_destroy(&attr);
+}
+
+/*
+ * cache_tinylfu - make cp admit new objects through a TinyLFU filter
+ *     sized for its table. Call before the cache is used.
+ */
+void cache_tinylfu(cache_t *cp)
+{
+    cp->admit = Malloc(sizeof(tinylfu_t));
+    tinylfu_init(cp->admit, cp->nbuckets);
+}
+
+/*
+ * cache_lookup - return a referenced object for key, or NULL on a miss
+ */
+cache_obj_t *cache_lookup(cache_t *cp, const char *key)
+{
+    cache_obj_t *obj;
+    unsigned long h = hash(key);
+
+    if (cp->admit)
+	tinylfu_record(cp->admit, h);
+    pthread_rwlock_rdlock(&cp->lock);
+    for (obj = cp->buckets[h & (cp->nbuckets - 1)]; obj; obj = obj->hnext)
+	if (obj->hash == h && !strcmp(obj->key, key))
+	    break;
+    if (obj) {
+	atomic_inc(&obj->refcnt);
+	if (!__atomic_load_n(&obj->referenced, __ATOMIC_RELAXED))
+	    __atomic_store_n(&obj->referenced, 1, __ATOMIC_RELAXED);
+    }
+    pthread_rwlock_unlock(&cp->lock);
+
+    atomic_inc(obj ? &cp->stats.hits : &cp->stats.misses);
+    return obj;
+}
+
+/*
+ * cache_fresh - is obj still a faithful copy of the file whose current
+ *     stat is sbuf?
+ */
+int cache_fresh(cache_obj_t *obj, struct stat *sbuf)
+{
+    return obj->fsize == sbuf->st_size &&
+	obj->mtime.tv_sec == sbuf->st_mtim.tv_sec &&
+	obj->mtime.tv_nsec == sbuf->st_mtim.tv_nsec;
+}
+
+/*
+ * unlink_obj - remove obj from the table and the ring and drop the
+ *     cache's reference to it. Caller holds the write lock.
+ */
+static void unlink_obj(cache_t *cp, cache_obj_t *obj)
+{
+    cache_obj_t **pp;
+
+    for (pp = &cp->buckets[obj->hash & (cp->nbuckets - 1)];
+	 *pp != obj; pp = &(*pp)->hnext)
+	;
+    *pp = obj->hnext;
+
+    if (obj->next == obj)
+	cp->hand = NULL;
+    else {
+	if (cp->hand == obj)
+	    cp->hand = obj->next;
+	obj->prev->next = obj->next;
+	obj->next->prev = obj->prev;
+    }
+
+    obj->cached = 0;
+    cp->stats.bytes -= obj->size;
+    cp->stats.count--;
+    if (atomic_dec(&obj->refcnt) == 0)
+	obj_free(obj);
+}
+
+/*
+ * evict - advance the clock hand until size more bytes fit, evicting
+ *     objects whose reference bit is clear. Caller holds the write lock.
+ */
+static void evict(cache_t *cp, size_t size)
+{
+    cache_obj_t *victim;
+
+    while (cp->hand && cp->stats.bytes + size > cp->stats.maxbytes) {
+	if (__atomic_exchange_n(&cp->hand->referenced, 0, __ATOMIC_RELAXED)) {
+	    cp->hand = cp->hand->next;  /* Second chance */
+	    continue;
+	}
+	victim = cp->hand;
+	unlink_obj(cp, victim);
+	cp->stats.evictions++;
+    }
+}
+
+/*
+ * admit - may an object whose key hashes to h and that needs need
+ *     more bytes evict what the clock hand would take for it (never
+ *     skip, which it replaces)? Only if it is asked for more often than
+ *     each of them. Finds those victims as evict would, without
+ *     changing anything: first the objects with a clear reference bit,
+ *     in clock order, then, if that isn't enough, the others. Caller
+ *     holds the write lock.
+ */
+static int admit(cache_t *cp, unsigned long h, size_t need, cache_obj_t *skip)
+{
+    int round, freq = tinylfu_estimate(cp->admit, h);
+    size_t freed = 0;
+    cache_obj_t *obj;
+
+    for (round = 0; round < 2 && cp->hand; round++) {
+	obj = cp->hand;
+	do {
+	    if (obj != skip && !obj->referenced == !round) {
+		if (tinylfu_estimate(cp->admit, obj->hash) >= freq)
+		    return 0;
+		if ((freed += obj->size) >= need)
+		    return 1;
+	    }
+	    obj = obj->next;
+	} while (obj != cp->hand);
+    }
+    return 1;
+}
+
+/*
+ * cache_insert - cache size bytes of malloc'd data under key, replacing
+ *     any object already there, and return a referenced object holding
+ *     them. The cache takes ownership of data. If sbuf isn't NULL, the
+ *     object records the file's size and mtime for cache_fresh. An
+ *     object bigger than the cache's maxobj isn't cached, but is still
+ *     returned (and freed on its last cache_release); so is one the
+ *     admission filter refuses.
+ */
+cache_obj_t *cache_insert(cache_t *cp, const char *key, char *data,
+			  size_t size, size_t hdrlen, struct stat *sbuf)
+{
+    cache_obj_t *obj, *old, **bucket;
+    size_t bytes;
+
+    obj = Calloc(1, sizeof(cache_obj_t));
+    obj->key = Malloc(strlen(key) + 1);
+    strcpy(obj->key, key);
+    obj->hash = hash(key);
+    obj->data = data;
+    obj->size = size;
+    obj->hdrlen = hdrlen;
+    if (sbuf) {
+	obj->mtime = sbuf->st_mtim;
+	obj->fsize = sbuf->st_size;
+    }
+    obj->refcnt = 1;                    /* The caller's reference */
+
+    if (size > cp->maxobj) {
+	atomic_inc(&cp->stats.rejections);
+	return obj;
+    }
+
+    pthread_rwlock_wrlock(&cp->lock);
+    bucket = &cp->buckets[obj->hash & (cp->nbuckets - 1)];
+    for (old = *bucket; old; old = old->hnext)
+	if (old->hash == obj->hash && !strcmp(old->key, key))
+	    break;
+    bytes = cp->stats.bytes - (old ? old->size : 0);
+    if (cp->admit && bytes + size > cp->stats.maxbytes &&
+	!admit(cp, obj->hash, bytes + size - cp->stats.maxbytes, old)) {
+	cp->stats.refusals++;
+	pthread_rwlock_unlock(&cp->lock);
+	return obj;
+    }
+    if (old)
+	unlink_obj(cp, old);            /* Someone beat us to it: replace */
+    evict(cp, size);
+
+    obj->refcnt++;                      /* The cache's reference */
+    obj->cached = 1;
+    obj->hnext = *bucket;
+    *bucket = obj;
+    if (cp->hand) {                     /* Enter just behind the hand */
+	obj->next = cp->hand;
+	obj->prev = cp->hand->prev;
+	cp->hand->prev->next = obj;
+	cp->hand->prev = obj;
+    }
+    else
+	cp->hand = obj->prev = obj->next = obj;
+    cp->stats.bytes += size;
+    cp->stats.count++;
+    cp->stats.insertions++;
+    pthread_rwlock_unlock(&cp->lock);
+    return obj;
+}
+
+/*
+ * cache_invalidate - remove obj from the cache (if it is still there)
+ *     because it no longer matches its source. The caller's reference
+ *     stays valid.
+ */
+void cache_invalidate(cache_t *cp, cache_obj_t *obj)
+{
+    pthread_rwlock_wrlock(&cp->lock);
+    if (obj->cached) {
+	unlink_obj(cp, obj);
+	cp->stats.invalidations++;
+    }
+    pthread_rwlock_unlock(&cp->lock);
+}
+
+/*
+ * cache_release - give back a reference from cache_lookup or
+ *     cache_insert
+ */
+void cache_release(cache_t *cp, cache_obj_t *obj)
+{
+    if (atomic_dec(&obj->refcnt) == 0)
+	obj_free(obj);
+}
+
+/*
+ * cache_getstats - copy out the cache's counters
+ */
+void cache_getstats(cache_t *cp, cache_stats_t *st)
+{
+    pthread_rwlock_rdlock(&cp->lock);
+    *st = cp->stats;
+    pthread_rwlock_unlock(&cp->lock);
+}
@@ -0,0 +1,75 @@
+/*
+ * cache.h - A shared, byte-bounded object cache.
+ *
+ * Objects are immutable byte strings named by a string key. Lookups
+ * run under a read lock and only touch atomics, so concurrent hits
+ * never wait for one another; inserts and evictions take the write
+ * lock. Eviction uses the CLOCK approximation of LRU: a hit only sets
+ * the object's reference bit, and the clock hand evicts the first
+ * object it finds whose bit is clear, clearing bits as it passes.
+ *
+ * Objects are reference counted. cache_lookup and cache_insert return
+ * a referenced object that the caller must give back with
+ * cache_release; an object evicted or replaced while someone is still
+ * sending it is freed only when the last reference is released.
+ *
+ * After cache_tinylfu, the cache also keeps a TinyLFU filter (see
+ * tinylfu.h) of how often each key is looked up, and only admits a new
+ * object if that would evict nothing asked for as often as it is.
+ */
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+#include "csapp.h"
+#include "tinylfu.h"
+
+typedef struct cache_obj {
+    char *key;
+    unsigned long hash;        /* Hash of key */
+    char *data;                /* hdrlen header bytes, then the body */
+    size_t size;               /* Total bytes in data */
+    size_t hdrlen;             /* Leading bytes of data that are headers */
+    struct timespec mtime;     /* Validators for objects backed by a file */
+    off_t fsize;
+    int refcnt;                /* References, including the cache's own */
+    int referenced;            /* CLOCK reference bit */
+    int cached;                /* Still reachable from the cache? */
+    struct cache_obj *hnext;   /* Hash chain */
+    struct cache_obj *prev;    /* CLOCK ring */
+    struct cache_obj *next;
+} cache_obj_t;
+
+typedef struct {
+    unsigned long hits;        /* Lookups that found an object */
+    unsigned long misses;      /* Lookups that didn't */
+    unsigned long insertions;  /* Objects added */
+    unsigned long evictions;   /* Objects pushed out to make room */
+    unsigned long invalidations; /* Objects removed as stale */
+    unsigned long rejections;  /* Objects too big to cache */
+    unsigned long refusals;    /* Objects the admission filter kept out */
+    size_t bytes;              /* Bytes of objects currently cached */
+    size_t maxbytes;
+    int count;                 /* Objects currently cached */
+} cache_stats_t;
+
+typedef struct {
+    pthread_rwlock_t lock;     /* Readers: lookups. Writers: everything else */
+    cache_obj_t **buckets;     /* Hash table of objects by key */
+    size_t nbuckets;           /* Power of two */
+    cache_obj_t *hand;         /* CLOCK hand; NULL if the cache is empty */
+    size_t maxobj;             /* Largest object that will be cached */
+    tinylfu_t *admit;          /* Admission filter, or NULL to admit all */
+    cache_stats_t stats;       /* Counters; bumped atomically under read lock */
+} cache_t;
+
+void cache_init(cache_t *cp, size_t maxbytes, size_t maxobj);
+void cache_tinylfu(cache_t *cp);
+cache_obj_t *cache_lookup(cache_t *cp, const char *key);
+cache_obj_t *cache_insert(cache_t *cp, const char *key, char *data,
+			  size_t size, size_t hdrlen, struct stat *sbuf);
+int cache_fresh(cache_obj_t *obj, struct stat *sbuf);
+void cache_invalidate(cache_t *cp, cache_obj_t *obj);
+void cache_release(cache_t *cp, cache_obj_t *obj);
+void cache_getstats(cache_t *cp, cache_stats_t *st);
+
+#endif /* __CACHE_H__ */
@@ -0,0 +1,127 @@
+/*
+ * cachesim.c - Replay an access trace against the object cache and
+ *     compare hit ratios with and without TinyLFU admission.
+ *
+ *     usage: cachesim [-c cachebytes] [-o maxobject] [-s size] tracefile...
+ *
+ * Each line of a trace is one request: a key (say, a URI) and
+ * optionally the object's size in bytes (default size, 4096). Lines
+ * starting with '#' are skipped. Every request is looked up in a
+ * cache.c cache of cachebytes bytes (default the proxy's
+ * MAX_CACHE_SIZE) and objects up to maxobject bytes (default
+ * MAX_OBJECT_SIZE), and inserted on a miss, just as the proxy does:
+ * once with plain CLOCK eviction, once with cache_tinylfu. For each,
+ * reports the hit ratio, the byte hit ratio (the share of requested
+ * bytes served from the cache), and how many objects were evicted or
+ * refused.
+ */
+#include "csapp.h"
+#include "cache.h"
+
+#define MAX_CACHE_SIZE  1049000
+#define MAX_OBJECT_SIZE 102400
+
+typedef struct {
+    char *key;
+    size_t size;
+} access_t;
+
+static access_t *trace;
+static size_t ntrace, tracecap;
+
+/*
+ * read_trace - append the requests in filename to trace
+ */
+static void read_trace(char *filename, size_t defsize)
+{
+    FILE *fp;
+    char line[MAXLINE], key[MAXLINE];
+    unsigned long size;
+    int n;
+
+    if (!(fp = fopen(filename, "r")))
+	unix_error(filename);
+    while (fgets(line, sizeof(line), fp)) {
+	if (line[0] == '#' || (n = sscanf(line, "%s %lu", key, &size)) < 1)
+	    continue;
+	if (ntrace == tracecap) {
+	    tracecap = tracecap ? 2 * tracecap : 4096;
+	    trace = Realloc(trace, tracecap * sizeof(access_t));
+	}
+	trace[ntrace].key = Malloc(strlen(key) + 1);
+	strcpy(trace[ntrace].key, key);
+	trace[ntrace].size = n == 2 ? size : defsize;
+	ntrace++;
+    }
+    fclose(fp);
+}
+
+/*
+ * replay - run the trace through a fresh cache and print the results
+ */
+static void replay(char *name, size_t cachebytes, size_t maxobject,
+		   int tinylfu)
+{
+    size_t i, bytes = 0, hitbytes = 0;
+    cache_t cache;
+    cache_obj_t *obj;
+    cache_stats_t st;
+
+    cache_init(&cache, cachebytes, maxobject);
+    if (tinylfu)
+	cache_tinylfu(&cache);
+    for (i = 0; i < ntrace; i++) {
+	bytes += trace[i].size;
+	if ((obj = cache_lookup(&cache, trace[i].key)) != NULL)
+	    hitbytes += trace[i].size;
+	else  /* The cache only accounts for the size; keep the data tiny */
+	    obj = cache_insert(&cache, trace[i].key, Malloc(1),
+			       trace[i].size, 0, NULL);
+	cache_release(&cache, obj);
+    }
+    cache_getstats(&cache, &st);
+    printf("%-8s %10lu %10lu %7.2f%% %9.2f%% %10lu %10lu\n", name,
+	   st.hits + st.misses, st.hits,
+	   ntrace ? 100.0 * st.hits / ntrace : 0.0,
+	   bytes ? 100.0 * hitbytes / bytes : 0.0,
+	   st.evictions, st.refusals);
+}
+
+int main(int argc, char **argv)
+{
+    int c;
+    long cachebytes = MAX_CACHE_SIZE, maxobject = MAX_OBJECT_SIZE;
+    long size = 4096;
+
+    while ((c = getopt(argc, argv, "c:o:s:")) != -1) {
+	switch (c) {
+	case 'c':
+	    cachebytes = strtol(optarg, NULL, 0);
+	    break;
+	case 'o':
+	    maxobject = strtol(optarg, NULL, 0);
+	    break;
+	case 's':
+	    size = strtol(optarg, NULL, 0);
+	    break;
+	default:
+	    goto usage;
+	}
+    }
+    if (optind == argc || cachebytes < 1 || maxobject < 1 || size < 0) {
+    usage:
+	fprintf(stderr, "usage: %s [-c cachebytes] [-o maxobject] "
+		"[-s size] tracefile...\n", argv[0]);
+	exit(1);
+    }
+    for (; optind < argc; optind++)
+	read_trace(argv[optind], size);
+
+    printf("%zu requests, %ld-byte cache, objects up to %ld bytes\n",
+	   ntrace, cachebytes, maxobject);
+    printf("%-8s %10s %10s %8s %10s %10s %10s\n", "policy", "requests",
+	   "hits", "hit", "bytehit", "evictions", "refusals");
+    replay("clock", cachebytes, maxobject, 0);
+    replay("tinylfu", cachebytes, maxobject, 1);
+    exit(0);
+}
@@ -0,0 +1,42 @@
+/*
+ * adder.c - a minimal CGI program that adds two numbers together.
+ *     Written around cgi_accept, so that tiny -f can keep it running
+ *     and hand it request after request; it makes a handy benchmark
+ *     of the two ways of running CGI programs.
+ *
+ *     build: gcc -O2 -I.. -o adder adder.c ../cgiworker.c ../csapp.c -pthread
+ */
+/* $begin adder */
+#include "csapp.h"
+#include "cgiworker.h"
+
+int main(void) {
+    char *buf, *p;
+    char content[MAXLINE];
+    int n1, n2;
+
+    while (cgi_accept() >= 0) {
+	/* Extract the two arguments */
+	n1 = n2 = 0;
+	if ((buf = getenv("QUERY_STRING")) != NULL) {
+	    n1 = atoi(buf);
+	    if ((p = strchr(buf, '&')) != NULL)
+		n2 = atoi(p+1);
+	}
+
+	/* Make the response body */
+	snprintf(content, sizeof(content),
+		 "Welcome to add.com: THE Internet addition portal.\r\n<p>"
+		 "The answer is: %d + %d = %d\r\n<p>"
+		 "Thanks for visiting!\r\n", n1, n2, n1 + n2);
+
+	/* Generate the HTTP response */
+	printf("Connection: close\r\n");
+	printf("Content-length: %d\r\n", (int)strlen(content));
+	printf("Content-type: text/html\r\n\r\n");
+	printf("%s", content);
+	fflush(stdout);
+    }
+    exit(0);
+}
+/* $end adder */
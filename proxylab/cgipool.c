@@ -0,0 +1,332 @@
+/*
+ * cgipool.c - Persistent CGI worker processes. See cgipool.h.
+ */
+#include "cgipool.h"
+#include <poll.h>
+#include <spawn.h>
+
+/* Only declared under _GNU_SOURCE (see accept4 in tiny_epoll.c) */
+extern int posix_spawn_file_actions_addclosefrom_np(
+    posix_spawn_file_actions_t *actions, int from);
+
+/*
+ * cgipool_init - create an empty pool that runs up to maxworkers
+ *     workers of each CGI program
+ */
+void cgipool_init(cgipool_t *cp, int maxworkers)
+{
+    int rc;
+
+    if ((rc = pthread_mutex_init(&cp->lock, NULL)) != 0)
+	posix_error(rc, "pthread_mutex_init error");
+    cp->maxworkers = maxworkers;
+    cp->progs = NULL;
+    memset(&cp->stats, 0, sizeof(cp->stats));
+}
+
+/*
+ * find_prog - return the program called filename, adding it if need
+ *     be. Caller holds the lock.
+ */
+static cgiprog_t *find_prog(cgipool_t *cp, char *filename)
+{
+    cgiprog_t *pp;
+
+    for (pp = cp->progs; pp; pp = pp->next)
+	if (!strcmp(pp->filename, filename))
+	    return pp;
+    pp = Calloc(1, sizeof(cgiprog_t));
+    pp->filename = Malloc(strlen(filename) + 1);
+    strcpy(pp->filename, filename);
+    pp->next = cp->progs;
+    cp->progs = pp;
+    return pp;
+}
+
+/*
+ * reap - kill worker w of pp and forget it. Caller holds the lock.
+ */
+static void reap(cgipool_t *cp, cgiprog_t *pp, cgiworker_t *w)
+{
+    cgiworker_t **wp;
+
+    for (wp = &pp->workers; *wp != w; wp = &(*wp)->next)
+	;
+    *wp = w->next;
+    kill(w->pid, SIGKILL);      /* Not reaped yet, so still ours */
+    waitpid(w->pid, NULL, 0);
+    close(w->fd);
+    if (w->busy)
+	cp->stats.busy--;
+    Free(w);
+    pp->nworkers--;
+    cp->stats.nworkers--;
+}
+
+/*
+ * now_ms - the monotonic clock in milliseconds
+ */
+static long now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
+/*
+ * spawn - start another worker of pp. It is of no use until it says it
+ *     is ready, which collect notices. Returns it, or NULL if it
+ *     couldn't be started. Caller holds the lock, but doesn't wait.
+ */
+static cgiworker_t *spawn(cgipool_t *cp, cgiprog_t *pp)
+{
+    int sv[2], rc;
+    char **envp, *argv[2];
+    size_t nenv;
+    pid_t pid;
+    cgiworker_t *w;
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    sigset_t sigs;
+
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0) {
+	fprintf(stderr, "tiny: cgi socketpair: %s\n", strerror(errno));
+	return NULL;
+    }
+
+    /* The worker gets its own environment: setenv would change the
+       one every thread shares */
+    for (nenv = 0; environ[nenv]; nenv++)
+	;
+    envp = Malloc((nenv + 2) * sizeof(char *));
+    memcpy(envp, environ, nenv * sizeof(char *));
+    envp[nenv] = CGI_WORKER_ENV "=1";
+    envp[nenv + 1] = NULL;
+    argv[0] = pp->filename;
+    argv[1] = NULL;
+
+    /* Started as spawn_dynamic starts a plain CGI child, with the
+       socketpair as its stdin (the dup2 clears close-on-exec). It
+       outlives the request being served now, so it mustn't keep that
+       client's socket open, or any other the server has. */
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, sv[1], STDIN_FILENO);
+    posix_spawn_file_actions_addclosefrom_np(&actions, STDERR_FILENO + 1);
+    posix_spawnattr_init(&attr);
+    sigemptyset(&sigs);
+    posix_spawnattr_setsigmask(&attr, &sigs);
+    sigaddset(&sigs, SIGPIPE);
+    posix_spawnattr_setsigdefault(&attr, &sigs);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK |
+			     POSIX_SPAWN_SETSIGDEF);
+    rc = posix_spawn(&pid, pp->filename, &actions, &attr, argv, envp);
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    Free(envp);
+    close(sv[1]);
+    if (rc != 0) {
+	fprintf(stderr, "tiny: can't run %s: %s\n", pp->filename,
+		strerror(rc));
+	close(sv[0]);
+	return NULL;
+    }
+
+    w = Calloc(1, sizeof(cgiworker_t));
+    w->pid = pid;
+    w->fd = sv[0];
+    w->starting = 1;
+    w->started = now_ms();
+    w->next = pp->workers;
+    pp->workers = w;
+    pp->nworkers++;
+    cp->stats.nworkers++;
+    cp->stats.spawns++;
+    return w;
+}
+
+/*
+ * collect - note which of pp's new workers have said they are ready
+ *     and which of its busy ones have finished, and reap those that
+ *     hung up. A new worker that hangs up first marks pp plain, unless
+ *     another has ever said it was ready, when it has only crashed; one
+ *     that is still silent after CGI_STARTWAIT ms is only slow, and is
+ *     reaped so the next request can try again. Returns how many new
+ *     workers crashed or were that slow. Caller holds the lock.
+ */
+static int collect(cgipool_t *cp, cgiprog_t *pp)
+{
+    cgiworker_t *w, *next;
+    ssize_t n;
+    char c;
+    int slow = 0;
+
+    for (w = pp->workers; w; w = next) {
+	next = w->next;
+	if (w->sending || (!w->busy && !w->starting))
+	    continue;
+	n = recv(w->fd, &c, 1, MSG_DONTWAIT);
+	if (w->starting) {
+	    if (n == 1 && c == CGI_READY) {
+		w->starting = 0;
+		pp->ready = 1;
+	    }
+	    else if (n >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK &&
+				errno != EINTR)) {
+		if (pp->ready) {        /* Others of it work: it crashed */
+		    cp->stats.crashes++;
+		    slow++;
+		}
+		else {
+		    /* Exited, or said something else: it reads no
+		       requests */
+		    fprintf(stderr, "tiny: %s doesn't call cgi_accept; "
+			    "forking it per request\n", pp->filename);
+		    pp->plain = 1;
+		}
+		reap(cp, pp, w);
+	    }
+	    else if (now_ms() - w->started >= CGI_STARTWAIT) {
+		fprintf(stderr, "tiny: cgi worker %d of %s didn't start in "
+			"time\n", (int)w->pid, pp->filename);
+		cp->stats.slowstarts++;
+		reap(cp, pp, w);
+		slow++;
+	    }
+	}
+	else if (n == 1) {
+	    w->busy = 0;
+	    cp->stats.busy--;
+	}
+	else if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK &&
+			    errno != EINTR)) {
+	    cp->stats.crashes++;
+	    reap(cp, pp, w);
+	}
+    }
+    return slow;
+}
+
+/*
+ * send_request - hand the request (its query string, and the client's
+ *     socket fd) to a worker over wfd
+ */
+static int send_request(int wfd, char *cgiargs, int fd)
+{
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    union {                     /* Aligned room for one descriptor */
+	struct cmsghdr hdr;
+	char buf[CMSG_SPACE(sizeof(int))];
+    } ctl;
+
+    iov.iov_base = cgiargs;
+    iov.iov_len = strlen(cgiargs) + 1;  /* With the NUL: never empty */
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctl.buf;
+    msg.msg_controllen = sizeof(ctl.buf);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    return sendmsg(wfd, &msg, MSG_NOSIGNAL) < 0 ? -1 : 0;
+}
+
+/*
+ * cgipool_serve - have a worker of the CGI program filename answer the
+ *     client on fd, whose status line has been sent. Returns 0 once a
+ *     worker has the request (the caller may close its copy of fd at
+ *     once), or -1 if the caller should fork the program as usual:
+ *     filename isn't a cgi_accept program, or couldn't be started, or
+ *     none of its workers is free. If wait, waits while they are all
+ *     busy or starting, unless one of them fails or is too slow to start;
+ *     otherwise (the event loops) starts another, if it may, for later
+ *     requests, and returns -1 at once.
+ */
+int cgipool_serve(cgipool_t *cp, char *filename, char *cgiargs, int fd,
+		  int wait)
+{
+    cgiprog_t *pp;
+    cgiworker_t *w, *next;
+    struct pollfd *pfds;
+    int n, slow, waited = 0;
+    pid_t pid;
+
+    pfds = Malloc(cp->maxworkers * sizeof(struct pollfd));
+    pthread_mutex_lock(&cp->lock);
+    pp = find_prog(cp, filename);
+    while (!pp->plain) {
+	slow = collect(cp, pp);
+	if (pp->plain) {
+	    /* It doesn't call cgi_accept: stop the rest of its workers
+	       starting. None has ever said it was ready, so none should
+	       have a request, but leave any that does alone. */
+	    for (w = pp->workers; w; w = next) {
+		next = w->next;
+		if (!w->busy && !w->sending)
+		    reap(cp, pp, w);
+	    }
+	    break;
+	}
+	for (w = pp->workers; w && (w->busy || w->starting); w = w->next)
+	    ;
+	if (!w && !slow && pp->nworkers < cp->maxworkers &&
+	    spawn(cp, pp) == NULL)
+	    break;
+
+	if (w) {
+	    w->busy = w->sending = 1;
+	    cp->stats.busy++;
+	    pid = w->pid;
+	    pthread_mutex_unlock(&cp->lock);
+	    n = send_request(w->fd, cgiargs, fd);
+	    pthread_mutex_lock(&cp->lock);
+	    w->sending = 0;
+	    if (n == 0) {
+		cp->stats.requests++;
+		pthread_mutex_unlock(&cp->lock);
+		Free(pfds);
+		return 0;
+	    }
+	    /* It died while idle: replace it and try again */
+	    fprintf(stderr, "tiny: cgi worker %d of %s is gone\n", (int)pid,
+		    filename);
+	    cp->stats.crashes++;
+	    reap(cp, pp, w);
+	    continue;
+	}
+	if (!wait || slow) {
+	    cp->stats.forks++;
+	    break;
+	}
+
+	/* All busy or starting: wait for one to finish or start */
+	if (!waited++)
+	    cp->stats.waits++;
+	for (n = 0, w = pp->workers; w; w = w->next)
+	    if (!w->sending) {
+		pfds[n].fd = w->fd;
+		pfds[n++].events = POLLIN;
+	    }
+	pthread_mutex_unlock(&cp->lock);
+	poll(pfds, n, CGI_STARTWAIT);
+	pthread_mutex_lock(&cp->lock);
+    }
+    pthread_mutex_unlock(&cp->lock);
+    Free(pfds);
+    return -1;
+}
+
+/*
+ * cgipool_getstats - copy out the pool's counters
+ */
+void cgipool_getstats(cgipool_t *cp, cgipool_stats_t *st)
+{
+    pthread_mutex_lock(&cp->lock);
+    *st = cp->stats;
+    pthread_mutex_unlock(&cp->lock);
+}
@@ -0,0 +1,78 @@
+/*
+ * cgipool.h - Persistent CGI worker processes (tiny -f).
+ *
+ * Instead of a fork and execve per request, each CGI program is run as
+ * up to maxworkers long-lived worker processes, started the first time
+ * the program is asked for. A worker's stdin is one end of a
+ * SOCK_SEQPACKET socketpair. For each request the server sends the
+ * query string down it with the client's socket attached (SCM_RIGHTS)
+ * and forgets about the request; the worker answers on that socket,
+ * closes it, and sends back one byte to say it is ready for the next.
+ * The program side of this is cgi_accept (cgiworker.h), in the manner
+ * of FastCGI's FCGI_Accept.
+ *
+ * A worker that hangs up instead of saying it is ready has crashed (or
+ * exited); it is killed, reaped, and replaced when next needed. A
+ * program that exits before any of its workers has ever said it is
+ * ready isn't written for cgi_accept, and is run the old way from then
+ * on; once one has, a new worker that exits has just crashed. One
+ * that says nothing for CGI_STARTWAIT ms is just slow to start: it is
+ * given up on, and started again for a later request.
+ *
+ * Nobody waits for a new worker with the pool locked. Threads that
+ * serve a connection at a time wait, unlocked, for a worker to start
+ * or come free; the event loops never wait, and fork the program for a
+ * request no worker is free for.
+ */
+#ifndef __CGIPOOL_H__
+#define __CGIPOOL_H__
+
+#include "csapp.h"
+
+#define CGI_WORKER_ENV "TINY_CGI_WORKER"  /* Set in a worker's environment */
+#define CGI_READY      'R'                /* Worker to server: send me more */
+#define CGI_STARTWAIT  1000               /* ms to wait for a new worker */
+
+typedef struct cgiworker {
+    pid_t pid;
+    int fd;                    /* Our end of the socketpair */
+    int busy;                  /* Has a request it hasn't finished */
+    int sending;               /* A thread is handing it one, unlocked */
+    int starting;              /* Hasn't said it is ready yet */
+    long started;              /* When it was started (ms, monotonic) */
+    struct cgiworker *next;
+} cgiworker_t;
+
+typedef struct cgiprog {
+    char *filename;
+    int plain;                 /* Not a cgi_accept program: fork it */
+    int ready;                 /* Some worker of it has said it is ready */
+    int nworkers;
+    cgiworker_t *workers;
+    struct cgiprog *next;
+} cgiprog_t;
+
+typedef struct {
+    unsigned long requests;    /* Requests handed to a worker */
+    unsigned long spawns;      /* Workers started */
+    unsigned long crashes;     /* Workers that hung up mid-request or idle */
+    unsigned long waits;       /* Requests that waited for a busy worker */
+    unsigned long forks;       /* Requests forked: no worker was free */
+    unsigned long slowstarts;  /* Workers given up on as they started */
+    int nworkers;              /* Workers running */
+    int busy;                  /* ... with a request */
+} cgipool_stats_t;
+
+typedef struct {
+    pthread_mutex_t lock;      /* Protects everything below */
+    int maxworkers;            /* Workers per program */
+    cgiprog_t *progs;
+    cgipool_stats_t stats;
+} cgipool_t;
+
+void cgipool_init(cgipool_t *cp, int maxworkers);
+int cgipool_serve(cgipool_t *cp, char *filename, char *cgiargs, int fd,
+		  int wait);
+void cgipool_getstats(cgipool_t *cp, cgipool_stats_t *st);
+
+#endif /* __CGIPOOL_H__ */
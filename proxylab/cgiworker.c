@@ -0,0 +1,73 @@
+/*
+ * cgiworker.c - The CGI program's side of tiny's persistent workers.
+ *     See cgiworker.h.
+ */
+#include "cgipool.h"
+#include "cgiworker.h"
+
+/*
+ * cgi_accept - finish the current request, if any, and wait for the
+ *     next. On return QUERY_STRING is set and stdout goes to the
+ *     client. Returns 0 when there is a request to answer, and -1 when
+ *     the program should exit: after its one request if it isn't a
+ *     worker, or when tiny closes the worker's channel.
+ */
+int cgi_accept(void)
+{
+    static int worker = -1, inrequest = 0, savedout = -1;
+    char query[MAXLINE], ready = CGI_READY;
+    int fd;
+    ssize_t n;
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    union {
+	struct cmsghdr hdr;
+	char buf[CMSG_SPACE(sizeof(int))];
+    } ctl;
+
+    if (worker < 0) {
+	worker = getenv(CGI_WORKER_ENV) != NULL;
+	if (worker) {
+	    /* A client that goes away costs it one response, not the
+	       worker */
+	    Signal(SIGPIPE, SIG_IGN);
+	    savedout = dup(STDOUT_FILENO);
+	}
+    }
+    if (!worker)
+	return inrequest++ ? -1 : 0;
+
+    if (inrequest) {
+	fflush(stdout);
+	clearerr(stdout);
+	dup2(savedout, STDOUT_FILENO);  /* Let go of the client */
+	inrequest = 0;
+    }
+    if (send(STDIN_FILENO, &ready, 1, MSG_NOSIGNAL) != 1)
+	return -1;
+
+    iov.iov_base = query;
+    iov.iov_len = sizeof(query) - 1;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctl.buf;
+    msg.msg_controllen = sizeof(ctl.buf);
+    while ((n = recvmsg(STDIN_FILENO, &msg, 0)) < 0 && errno == EINTR)
+	;
+    if (n <= 0)                         /* tiny has gone */
+	return -1;
+    cmsg = CMSG_FIRSTHDR(&msg);
+    if (!cmsg || cmsg->cmsg_level != SOL_SOCKET ||
+	cmsg->cmsg_type != SCM_RIGHTS)
+	return -1;
+    memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+    query[n] = '\0';
+
+    setenv("QUERY_STRING", query, 1);
+    dup2(fd, STDOUT_FILENO);
+    close(fd);
+    inrequest = 1;
+    return 0;
+}
@@ -0,0 +1,19 @@
+/*
+ * cgiworker.h - The CGI program's side of tiny's persistent workers
+ *     (see cgipool.h).
+ *
+ * A program written as
+ *
+ *     while (cgi_accept() >= 0) {
+ *         ... read QUERY_STRING, print the response on stdout ...
+ *     }
+ *
+ * answers one request and exits when run as an ordinary CGI program,
+ * and answers request after request when tiny runs it as a worker.
+ */
+#ifndef __CGIWORKER_H__
+#define __CGIWORKER_H__
+
+int cgi_accept(void);
+
+#endif /* __CGIWORKER_H__ */
@@ -0,0 +1,302 @@
+/*
+ * connpool.c - A pool of idle keep-alive connections to origin servers.
+ *     See connpool.h.
+ */
+#include "connpool.h"
+
+#define SWEEP_PERIOD 1         /* Seconds between reaper passes */
+
+static void *reaper(void *vargp);
+
+/* now - seconds on a clock that never jumps */
+static time_t now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
+
+/* hash - FNV-1a hash of a key */
+static unsigned long hash(const char *key)
+{
+    unsigned long h = 14695981039346656037UL;
+
+    while (*key) {
+	h ^= (unsigned char)*key++;
+	h *= 1099511628211UL;
+    }
+    return h;
+}
+
+/*
+ * connpool_init - create an empty pool that keeps up to maxidle idle
+ *     connections per origin, each for at most idletimeout seconds and
+ *     until it is maxage seconds old, and opens at most maxconns
+ *     connections per origin (0 for no limit). New connections look
+ *     names up through rs if it isn't NULL. Starts the pool's reaper.
+ */
+void connpool_init(connpool_t *cp, resolver_t *rs, int maxidle,
+		   int maxconns, int idletimeout, int maxage)
+{
+    int rc;
+    pthread_t tid;
+
+    if ((rc = pthread_mutex_init(&cp->lock, NULL)) != 0)
+	posix_error(rc, "pthread_mutex_init error");
+    cp->resolver = rs;
+    cp->nbuckets = 64;
+    cp->buckets = Calloc(cp->nbuckets, sizeof(origin_t *));
+    cp->maxidle = maxidle;
+    cp->maxconns = maxconns;
+    cp->idletimeout = idletimeout;
+    cp->maxage = maxage;
+    memset(&cp->stats, 0, sizeof(cp->stats));
+    Pthread_create(&tid, NULL, reaper, cp);
+}
+
+/*
+ * find_origin - return the origin called key, creating it if need be.
+ *     Caller holds the lock.
+ */
+static origin_t *find_origin(connpool_t *cp, char *key)
+{
+    origin_t *op, **bucket;
+
+    bucket = &cp->buckets[hash(key) & (cp->nbuckets - 1)];
+    for (op = *bucket; op; op = op->next)
+	if (!strcmp(op->key, key))
+	    return op;
+
+    op = Calloc(1, sizeof(origin_t));
+    op->key = Malloc(strlen(key) + 1);
+    strcpy(op->key, key);
+    pthread_cond_init(&op->turn, NULL);
+    op->next = *bucket;
+    *bucket = op;
+    return op;
+}
+
+/*
+ * drop_origin - free op if nothing refers to it any more. Caller holds
+ *     the lock.
+ */
+static void drop_origin(connpool_t *cp, origin_t *op)
+{
+    origin_t **pp;
+
+    if (op->nconns > 0 || op->ticket != op->serving)
+	return;
+    for (pp = &cp->buckets[hash(op->key) & (cp->nbuckets - 1)];
+	 *pp != op; pp = &(*pp)->next)
+	;
+    *pp = op->next;
+    pthread_cond_destroy(&op->turn);
+    Free(op->key);
+    Free(op);
+}
+
+/*
+ * expired - has the connection outlived the pool's limits?
+ */
+static int expired(connpool_t *cp, pconn_t *pc, time_t t)
+{
+    return t - pc->since >= cp->idletimeout || t - pc->born >= cp->maxage;
+}
+
+/*
+ * close_expired - close op's idle connections that are past their time
+ *     at t. Caller holds the lock.
+ */
+static void close_expired(connpool_t *cp, origin_t *op, time_t t)
+{
+    pconn_t *idle, **pp;
+
+    for (pp = &op->idle; (idle = *pp) != NULL; ) {
+	if (expired(cp, idle, t)) {
+	    *pp = idle->next;
+	    Close(idle->fd);
+	    Free(idle);
+	    op->nidle--;
+	    op->nconns--;
+	    cp->stats.nidle--;
+	    cp->stats.expired++;
+	}
+	else
+	    pp = &idle->next;
+    }
+}
+
+/*
+ * reaper - thread routine: close idle connections past their time and
+ *     drop the origins that leaves unused, whether or not anyone asks
+ *     for those origins again
+ */
+static void *reaper(void *vargp)
+{
+    connpool_t *cp = vargp;
+    origin_t *op, *next;
+    size_t i;
+    time_t t;
+
+    Pthread_detach(pthread_self());
+    while (1) {
+	sleep(SWEEP_PERIOD);
+	pthread_mutex_lock(&cp->lock);
+	t = now();
+	for (i = 0; i < cp->nbuckets; i++) {
+	    for (op = cp->buckets[i]; op; op = next) {
+		next = op->next;
+		if (!op->idle)
+		    continue;
+		close_expired(cp, op, t);
+		pthread_cond_broadcast(&op->turn);
+		drop_origin(cp, op);
+	    }
+	}
+	pthread_mutex_unlock(&cp->lock);
+    }
+    return NULL;
+}
+
+/*
+ * alive - does the idle connection on fd still look usable? An origin
+ *     that closed it has sent an EOF (or a reset); one that sent bytes
+ *     nobody asked for can't be trusted with another request either.
+ */
+static int alive(int fd)
+{
+    char c;
+
+    return recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) < 0 &&
+	(errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+/*
+ * connpool_get - get a connection to host:port into pc: an idle one
+ *     from the pool if there is a live one, else a new one. Waits its
+ *     turn if the origin is at the maxconns limit. Returns the
+ *     descriptor, or -2 if host doesn't resolve and -1 if connecting
+ *     failed, as open_clientfd does.
+ */
+int connpool_get(connpool_t *cp, char *host, char *port, pconn_t *pc)
+{
+    char key[2 * MAXLINE];
+    unsigned long myturn;
+    origin_t *op;
+    pconn_t *idle;
+    int fd;
+
+    snprintf(key, sizeof(key), "%s:%s", host, port);
+    pthread_mutex_lock(&cp->lock);
+    op = find_origin(cp, key);
+
+    /* Take a ticket and wait until it is our turn and a connection is free */
+    myturn = op->ticket++;
+    if (myturn != op->serving ||
+	(cp->maxconns > 0 && op->nconns >= cp->maxconns && !op->idle)) {
+	cp->stats.waits++;
+	while (myturn != op->serving ||
+	       (cp->maxconns > 0 && op->nconns >= cp->maxconns && !op->idle))
+	    pthread_cond_wait(&op->turn, &cp->lock);
+    }
+
+    /* Reuse the most recent idle connection that is still good */
+    while ((idle = op->idle) != NULL) {
+	op->idle = idle->next;
+	op->nidle--;
+	cp->stats.nidle--;
+	*pc = *idle;
+	Free(idle);
+	pthread_mutex_unlock(&cp->lock);
+	if (!expired(cp, pc, now()) && alive(pc->fd)) {
+	    pthread_mutex_lock(&cp->lock);
+	    cp->stats.reuses++;
+	    goto done;
+	}
+	Close(pc->fd);
+	pthread_mutex_lock(&cp->lock);
+	op->nconns--;
+	if (expired(cp, pc, now()))
+	    cp->stats.expired++;
+	else
+	    cp->stats.stale++;
+    }
+
+    /* None left: connect a new one, holding its place under the limit */
+    op->nconns++;
+    op->serving++;
+    pthread_cond_broadcast(&op->turn);
+    pthread_mutex_unlock(&cp->lock);
+    fd = cp->resolver ? resolv_connect(cp->resolver, host, port)
+	: open_clientfd(host, port);
+    if (fd < 0) {
+	pthread_mutex_lock(&cp->lock);
+	op->nconns--;
+	pthread_cond_broadcast(&op->turn);
+	drop_origin(cp, op);
+	pthread_mutex_unlock(&cp->lock);
+	return fd;
+    }
+    pc->fd = fd;
+    pc->reused = 0;
+    pc->born = now();
+    pc->origin = op;
+    pc->next = NULL;
+    pthread_mutex_lock(&cp->lock);
+    cp->stats.connects++;
+    pthread_mutex_unlock(&cp->lock);
+    return fd;
+
+ done:
+    pc->reused = 1;
+    op->serving++;
+    pthread_cond_broadcast(&op->turn);
+    pthread_mutex_unlock(&cp->lock);
+    return pc->fd;
+}
+
+/*
+ * connpool_put - give back the connection in pc. If reusable (the
+ *     response was read to its end and the origin will keep the
+ *     connection open), it joins the origin's idle connections, unless
+ *     it is too old or the origin already has maxidle of them;
+ *     otherwise it is closed. The origin's idle connections past their
+ *     time are closed on the way, without waiting for the reaper.
+ */
+void connpool_put(connpool_t *cp, pconn_t *pc, int reusable)
+{
+    origin_t *op = pc->origin;
+    pconn_t *idle;
+    time_t t = now();
+
+    pc->since = t;
+    pthread_mutex_lock(&cp->lock);
+    close_expired(cp, op, t);
+
+    if (reusable && op->nidle < cp->maxidle && !expired(cp, pc, t)) {
+	idle = Malloc(sizeof(pconn_t));
+	*idle = *pc;
+	idle->next = op->idle;
+	op->idle = idle;
+	op->nidle++;
+	cp->stats.nidle++;
+    }
+    else {
+	Close(pc->fd);
+	op->nconns--;
+    }
+    pthread_cond_broadcast(&op->turn);
+    drop_origin(cp, op);
+    pthread_mutex_unlock(&cp->lock);
+}
+
+/*
+ * connpool_getstats - copy out the pool's counters
+ */
+void connpool_getstats(connpool_t *cp, connpool_stats_t *st)
+{
+    pthread_mutex_lock(&cp->lock);
+    *st = cp->stats;
+    pthread_mutex_unlock(&cp->lock);
+}
@@ -0,0 +1,72 @@
+/*
+ * connpool.h - A pool of idle keep-alive connections to origin servers.
+ *
+ * The pool keeps, for each origin (host and port), a stack of idle
+ * connections that finished a response and may carry another request.
+ * connpool_get hands out the most recently used one that still looks
+ * alive, or connects a new one; connpool_put returns it, or closes it
+ * if it can't be reused. An idle connection is closed once it has sat
+ * in the pool for idletimeout seconds or has been open for maxage: a
+ * reaper thread looks for such connections every second, and drops
+ * origins left with no connections, so that a forward proxy that
+ * visits many hosts once doesn't keep their sockets open for good.
+ *
+ * If maxconns is set, no origin ever has more than that many
+ * connections open at once. Threads that want one when the limit is
+ * reached wait their turn: they are served strictly in the order they
+ * asked, so no thread can starve the others of an origin.
+ */
+#ifndef __CONNPOOL_H__
+#define __CONNPOOL_H__
+
+#include "csapp.h"
+#include "resolver.h"
+
+typedef struct pconn {
+    int fd;
+    int reused;                /* Did this connection serve a request before? */
+    time_t born;               /* When it was connected */
+    time_t since;              /* When it was last put back in the pool */
+    struct origin *origin;
+    struct pconn *next;        /* Idle stack */
+} pconn_t;
+
+typedef struct origin {
+    char *key;                 /* "host:port" */
+    pconn_t *idle;             /* Idle connections, most recent first */
+    int nidle;
+    int nconns;                /* Connections open, idle or in use */
+    unsigned long ticket;      /* Next turn to hand out */
+    unsigned long serving;     /* Turn now being served */
+    pthread_cond_t turn;       /* Signalled when a connection frees up */
+    struct origin *next;       /* Hash chain */
+} origin_t;
+
+typedef struct {
+    unsigned long connects;    /* New connections made */
+    unsigned long reuses;      /* Requests sent on an idle connection */
+    unsigned long stale;       /* Idle connections the origin had closed */
+    unsigned long expired;     /* Idle connections closed for their age */
+    unsigned long waits;       /* Gets that waited for the maxconns limit */
+    int nidle;                 /* Idle connections now in the pool */
+} connpool_stats_t;
+
+typedef struct {
+    pthread_mutex_t lock;      /* Protects everything below */
+    resolver_t *resolver;      /* Name lookups; NULL: open_clientfd's own */
+    origin_t **buckets;        /* Hash table of origins by key */
+    size_t nbuckets;           /* Power of two */
+    int maxidle;               /* Idle connections kept per origin; 0: none */
+    int maxconns;              /* Open connections per origin; 0: no limit */
+    int idletimeout;           /* Seconds an idle connection is kept */
+    int maxage;                /* Seconds a connection may be reused for */
+    connpool_stats_t stats;
+} connpool_t;
+
+void connpool_init(connpool_t *cp, resolver_t *rs, int maxidle,
+		   int maxconns, int idletimeout, int maxage);
+int connpool_get(connpool_t *cp, char *host, char *port, pconn_t *pc);
+void connpool_put(connpool_t *cp, pconn_t *pc, int reusable);
+void connpool_getstats(connpool_t *cp, connpool_stats_t *st);
+
+#endif /* __CONNPOOL_H__ */
@@ -773,6 +773,434 @@ ssize_t rio_writen(int fd, void *usrbuf, size_t n)
 }
 /* $end rio_writen */
 
+/*
+ * rio_sendmore - Robustly write n bytes to a socket, flagged MSG_MORE so
+ *    that a short response header shares a TCP segment with the body
+ *    that follows it. Falls back to rio_writen if fd isn't a socket.
+ */
+ssize_t rio_sendmore(int fd, void *usrbuf, size_t n)
+{
+    size_t nleft = n;
+    ssize_t nwritten;
+    char *bufp = usrbuf;
+
+    while (nleft > 0) {
+	if ((nwritten = send(fd, bufp, nleft, MSG_MORE)) < 0) {
+	    if (errno == EINTR)  /* Interrupted by sig handler return */
+		nwritten = 0;    /* and call send() again */
+	    else if (errno == ENOTSOCK)
+		return rio_writen(fd, bufp, nleft) < 0 ? -1 : n;
+	    else
+		return -1;       /* errno set by send() */
+	}
+	nleft -= nwritten;
+	bufp += nwritten;
+    }
+    return n;
+}
+
+/*
+ * rio_writev - Robustly write every byte described by iov[0..iovcnt-1]
+ *    with as few writev() calls as the descriptor allows. iov is
+ *    updated in place as bytes go out.
+ */
+ssize_t rio_writev(int fd, struct iovec *iov, int iovcnt)
+{
+    size_t total = 0;
+    ssize_t nwritten;
+
+    while (iovcnt > 0 && iov->iov_len == 0) {
+	iov++;
+	iovcnt--;
+    }
+    while (iovcnt > 0) {
+	if ((nwritten = writev(fd, iov, iovcnt)) < 0) {
+	    if (errno == EINTR)  /* Interrupted by sig handler return */
+		continue;        /* and call writev() again */
+	    return -1;           /* errno set by writev() */
+	}
+	total += nwritten;
+	while (iovcnt > 0 && (size_t)nwritten >= iov->iov_len) {
+	    nwritten -= iov->iov_len;
+	    iov++;
+	    iovcnt--;
+	}
+	if (iovcnt > 0) {        /* Short write: resume mid-vector */
+	    iov->iov_base = (char *)iov->iov_base + nwritten;
+	    iov->iov_len -= nwritten;
+	}
+    }
+    return total;
+}
+
+/*
+ * rio_mmapwrite - Robustly write n bytes of file infd, starting at
+ *    offset, to outfd by mapping the file and writing from the mapping
+ */
+ssize_t rio_mmapwrite(int outfd, int infd, off_t offset, size_t n)
+{
+    char *mapp;
+    off_t base;
+    size_t len;
+    ssize_t rc;
+
+    if (n == 0)
+	return 0;
+    base = offset & ~((off_t)sysconf(_SC_PAGESIZE) - 1); /* Page-align */
+    len = n + (offset - base);
+    if ((mapp = mmap(0, len, PROT_READ, MAP_PRIVATE, infd, base)) == MAP_FAILED)
+	return -1;
+    rc = rio_writen(outfd, mapp + (offset - base), n);
+    munmap(mapp, len);
+    return rc;
+}
+
+/*
+ * rio_sendfile - Robustly send n bytes of file infd, starting at
+ *    offset, to outfd with sendfile(), so the bytes go from the page
+ *    cache to the socket without a copy through user space or a
+ *    mapping to tear down. Falls back to rio_mmapwrite for the rest of
+ *    the range if the kernel can't sendfile between the descriptors.
+ *    Returns the number of bytes sent, which is short only if the file
+ *    is shorter than offset+n.
+ */
+ssize_t rio_sendfile(int outfd, int infd, off_t offset, size_t n)
+{
+    size_t nleft = n;
+    ssize_t nsent;
+
+    while (nleft > 0) {
+	if ((nsent = sendfile(outfd, infd, &offset, nleft)) < 0) {
+	    if (errno == EINTR)  /* Interrupted by sig handler return */
+		continue;        /* and call sendfile() again */
+	    if (errno == EINVAL || errno == ENOSYS) {
+		if (rio_mmapwrite(outfd, infd, offset, nleft) < 0)
+		    return -1;
+		return n;
+	    }
+	    return -1;           /* errno set by sendfile() */
+	}
+	if (nsent == 0)
+	    break;               /* EOF: the file shrank */
+	nleft -= nsent;
+    }
+    return n - nleft;
+}
+
+/* splice is only declared under _GNU_SOURCE, which makes <netdb.h>
+   declare a gai_error that clashes with the one in csapp.h */
+extern ssize_t splice(int fd_in, loff_t *off_in, int fd_out, loff_t *off_out,
+		      size_t len, unsigned int flags);
+#ifndef SPLICE_F_MOVE
+#define SPLICE_F_MOVE 1
+#endif
+#ifndef F_SETPIPE_SZ
+#define F_SETPIPE_SZ 1031
+#endif
+
+#define RIO_PIPESIZE (1 << 20)  /* Bytes moved per splice round trip */
+#define RIO_COPYSIZE (1 << 17)  /* Buffer for rio_splice's copy fallback */
+
+static __thread int rio_pipe[2] = { -1, -1 };  /* Each thread's splice pipe */
+
+/*
+ * rio_copy - Copy up to n bytes from infd to outfd through a large
+ *    buffer, stopping early at EOF. Returns the number of bytes
+ *    copied, or -1 on error.
+ */
+static ssize_t rio_copy(int outfd, int infd, size_t n)
+{
+    size_t nleft = n;
+    ssize_t nread, rc = 0;
+    char *buf = Malloc(RIO_COPYSIZE);
+
+    while (nleft > 0) {
+	if ((nread = read(infd, buf, nleft < RIO_COPYSIZE ? nleft
+			  : RIO_COPYSIZE)) < 0) {
+	    if (errno == EINTR)  /* Interrupted by sig handler return */
+		continue;
+	    rc = -1;
+	    break;
+	}
+	if (nread == 0)
+	    break;               /* EOF */
+	if (rio_writen(outfd, buf, nread) < 0) {
+	    rc = -1;
+	    break;
+	}
+	nleft -= nread;
+    }
+    Free(buf);
+    return rc < 0 ? -1 : (ssize_t)(n - nleft);
+}
+
+/*
+ * rio_pipe_close - Close this thread's splice pipe, e.g. because
+ *    bytes were left in it
+ */
+static void rio_pipe_close(void)
+{
+    close(rio_pipe[0]);
+    close(rio_pipe[1]);
+    rio_pipe[0] = rio_pipe[1] = -1;
+}
+
+/*
+ * rio_splice - Robustly move up to n bytes (RIO_ALL: up to EOF) from
+ *    socket infd to outfd with splice() through a pipe kept by each
+ *    thread, so they never pass through user space. Falls back to
+ *    copying through a large buffer if the kernel can't splice between
+ *    the descriptors. Returns the number of bytes moved, which is
+ *    short only on EOF, or -1 on error.
+ */
+ssize_t rio_splice(int outfd, int infd, size_t n)
+{
+    size_t nleft = n, chunk;
+    ssize_t nin, nout;
+    char *buf;
+
+    if (rio_pipe[0] < 0) {
+	if (pipe(rio_pipe) < 0)
+	    return rio_copy(outfd, infd, n);
+	fcntl(rio_pipe[1], F_SETPIPE_SZ, RIO_PIPESIZE);  /* Best effort */
+    }
+
+    while (nleft > 0) {
+	chunk = nleft < RIO_PIPESIZE ? nleft : RIO_PIPESIZE;
+	if ((nin = splice(infd, NULL, rio_pipe[1], NULL, chunk,
+			  SPLICE_F_MOVE)) < 0) {
+	    if (errno == EINTR)  /* Interrupted by sig handler return */
+		continue;
+	    if (errno == EINVAL || errno == ENOSYS)
+		break;           /* Can't splice from infd: copy the rest */
+	    return -1;
+	}
+	if (nin == 0)
+	    return n - nleft;    /* EOF */
+
+	/* Drain the pipe into outfd */
+	while (nin > 0) {
+	    if ((nout = splice(rio_pipe[0], NULL, outfd, NULL, nin,
+			       SPLICE_F_MOVE)) > 0) {
+		nin -= nout;
+		nleft -= nout;
+		continue;
+	    }
+	    if (nout < 0 && errno == EINTR)
+		continue;
+	    if (nout < 0 && (errno == EINVAL || errno == ENOSYS)) {
+		/* Can't splice to outfd: write what's in the pipe by hand */
+		buf = Malloc(nin);
+		if (rio_readn(rio_pipe[0], buf, nin) != nin ||
+		    rio_writen(outfd, buf, nin) < 0) {
+		    Free(buf);
+		    rio_pipe_close();
+		    return -1;
+		}
+		Free(buf);
+		nleft -= nin;
+		goto copy;
+	    }
+	    rio_pipe_close();    /* Bytes are stranded in the pipe */
+	    return -1;
+	}
+    }
+    if (nleft == 0)
+	return n;
+
+ copy:
+    if ((nin = rio_copy(outfd, infd, nleft)) < 0)
+	return -1;
+    return n - nleft + nin;
+}
+
+/*
+ * rio_writeinitb - Associate a descriptor with an empty output buffer.
+ *    Output queued with rio_writeb, rio_writeb_ref, and rio_printfb
+ *    reaches the descriptor only when the buffer fills or is flushed.
+ */
+void rio_writeinitb(riow_t *wp, int fd)
+{
+    wp->riow_fd = fd;
+    wp->riow_cnt = 0;
+    wp->riow_niov = 0;
+}
+
+/*
+ * riow_queue - Queue n bytes at p, extending the last segment if they
+ *    follow on from it. The caller has made sure there is room.
+ */
+static void riow_queue(riow_t *wp, const void *p, size_t n)
+{
+    struct iovec *last;
+
+    if (n == 0)
+	return;
+    if (wp->riow_niov > 0) {
+	last = &wp->riow_iov[wp->riow_niov - 1];
+	if ((char *)last->iov_base + last->iov_len == p) {
+	    last->iov_len += n;   /* Coalesce */
+	    return;
+	}
+    }
+    wp->riow_iov[wp->riow_niov].iov_base = (void *)p;
+    wp->riow_iov[wp->riow_niov].iov_len = n;
+    wp->riow_niov++;
+}
+
+/*
+ * rio_writeb - Buffer n bytes for output (buffered). Small writes are
+ *    copied into the buffer and coalesce into one segment; a write too
+ *    big for the buffer goes out at once, in the same writev as what
+ *    was already queued. (On a nonblocking descriptor, what of it
+ *    doesn't fit in the socket stays queued, uncopied, as if added by
+ *    rio_writeb_ref.) Returns n, or -1 if a flush failed before the
+ *    bytes could be taken.
+ */
+ssize_t rio_writeb(riow_t *wp, const void *usrbuf, size_t n)
+{
+    if (n >= RIO_WBUFSIZE) {
+	if (rio_writeb_ref(wp, usrbuf, n) < 0)
+	    return -1;
+	if (rio_flushb(wp) < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+	    return -1;
+	return n;
+    }
+    if ((wp->riow_cnt + n > RIO_WBUFSIZE || wp->riow_niov == RIO_WIOVMAX) &&
+	rio_flushb(wp) < 0)
+	return -1;
+    memcpy(wp->riow_buf + wp->riow_cnt, usrbuf, n);
+    riow_queue(wp, wp->riow_buf + wp->riow_cnt, n);
+    wp->riow_cnt += n;
+    return n;
+}
+
+/*
+ * rio_writeb_ref - Queue n bytes of the caller's memory for output
+ *    without copying them. The memory must stay valid and unchanged
+ *    until the next flush has sent it. Returns n, or -1 if a flush it
+ *    needed failed.
+ */
+ssize_t rio_writeb_ref(riow_t *wp, const void *usrbuf, size_t n)
+{
+    if (wp->riow_niov == RIO_WIOVMAX && rio_flushb(wp) < 0)
+	return -1;
+    riow_queue(wp, usrbuf, n);
+    return n;
+}
+
+/*
+ * rio_printfb - Format output straight into the buffer (buffered).
+ *    Output bigger than the whole buffer is written out at once with
+ *    rio_writen, so it needs a blocking descriptor. Returns the number
+ *    of bytes queued or written, or -1 on error.
+ */
+ssize_t rio_printfb(riow_t *wp, const char *fmt, ...)
+{
+    int n;
+    size_t room;
+    char *big;
+    va_list ap;
+
+    if (wp->riow_niov == RIO_WIOVMAX && rio_flushb(wp) < 0)
+	return -1;
+    room = RIO_WBUFSIZE - wp->riow_cnt;
+    va_start(ap, fmt);
+    n = vsnprintf(wp->riow_buf + wp->riow_cnt, room, fmt, ap);
+    va_end(ap);
+    if (n < 0)
+	return -1;
+    if ((size_t)n >= room) {  /* Didn't fit: flush, then format again */
+	if (rio_flushb(wp) < 0)
+	    return -1;
+	if (n >= RIO_WBUFSIZE) {
+	    big = Malloc(n + 1);
+	    va_start(ap, fmt);
+	    vsnprintf(big, n + 1, fmt, ap);
+	    va_end(ap);
+	    n = rio_writen(wp->riow_fd, big, n);  /* Nothing to queue behind */
+	    free(big);
+	    return n;
+	}
+	va_start(ap, fmt);
+	vsnprintf(wp->riow_buf, RIO_WBUFSIZE, fmt, ap);
+	va_end(ap);
+    }
+    riow_queue(wp, wp->riow_buf + wp->riow_cnt, n);
+    wp->riow_cnt += n;
+    return n;
+}
+
+/*
+ * riow_flush - Send every queued segment with as few writev (or, with
+ *    flags, sendmsg) calls as the descriptor allows. On error, what
+ *    wasn't sent stays queued, so a descriptor that would block
+ *    (EAGAIN) can be flushed again once it is writable.
+ */
+static ssize_t riow_flush(riow_t *wp, int flags)
+{
+    ssize_t n, total = 0;
+    int niov = wp->riow_niov;
+    struct iovec *iov = wp->riow_iov;
+    struct msghdr msg;
+
+    while (niov > 0) {
+	if (flags) {
+	    memset(&msg, 0, sizeof(msg));
+	    msg.msg_iov = iov;
+	    msg.msg_iovlen = niov;
+	    n = sendmsg(wp->riow_fd, &msg, flags);
+	    if (n < 0 && errno == ENOTSOCK) {
+		flags = 0;    /* Not a socket: plain writev */
+		continue;
+	    }
+	}
+	else
+	    n = writev(wp->riow_fd, iov, niov);
+	if (n < 0) {
+	    if (errno == EINTR) /* Interrupted by sig handler return */
+		continue;
+	    break;            /* errno set by writev() */
+	}
+	total += n;
+	while (niov > 0 && (size_t)n >= iov->iov_len) {
+	    n -= iov->iov_len;
+	    iov++;
+	    niov--;
+	}
+	if (niov > 0) {       /* Short write: resume mid-segment */
+	    iov->iov_base = (char *)iov->iov_base + n;
+	    iov->iov_len -= n;
+	}
+    }
+
+    memmove(wp->riow_iov, iov, niov * sizeof(struct iovec));
+    wp->riow_niov = niov;
+    if (niov == 0) {
+	wp->riow_cnt = 0;     /* The buffer is free again */
+	return total;
+    }
+    return -1;
+}
+
+/*
+ * rio_flushb - Send everything queued. Returns the number of bytes
+ *    sent, or -1 on error (with the rest still queued).
+ */
+ssize_t rio_flushb(riow_t *wp)
+{
+    return riow_flush(wp, 0);
+}
+
+/*
+ * rio_flushb_more - Like rio_flushb, but flagged MSG_MORE so that a
+ *    response head shares a TCP segment with the body that follows
+ */
+ssize_t rio_flushb_more(riow_t *wp)
+{
+    return riow_flush(wp, MSG_MORE);
+}
+
 
 /* 
  * rio_read - This is a wrapper for the Unix read() function that
@@ -788,8 +1216,8 @@ static ssize_t rio_read(rio_t *rp, char *usrbuf, size_t n)
     int cnt;
 
     while (rp->rio_cnt <= 0) {  /* Refill if buf is empty */
-	rp->rio_cnt = read(rp->rio_fd, rp->rio_buf, 
-			   sizeof(rp->rio_buf));
+	rp->rio_cnt = read(rp->rio_fd, rp->rio_base, 
+			   rp->rio_bufsize);
 	if (rp->rio_cnt < 0) {
 	    if (errno != EINTR) /* Interrupted by sig handler return */
 		return -1;
@@ -797,7 +1225,7 @@ static ssize_t rio_read(rio_t *rp, char *usrbuf, size_t n)
 	else if (rp->rio_cnt == 0)  /* EOF */
 	    return 0;
 	else 
-	    rp->rio_bufptr = rp->rio_buf; /* Reset buffer ptr */
+	    rp->rio_bufptr = rp->rio_base; /* Reset buffer ptr */
     }
 
     /* Copy min(n, rp->rio_cnt) bytes from internal buf to user buf */
@@ -817,14 +1245,54 @@ static ssize_t rio_read(rio_t *rp, char *usrbuf, size_t n)
 /* $begin rio_readinitb */
 void rio_readinitb(rio_t *rp, int fd) 
 {
-    rp->rio_fd = fd;  
-    rp->rio_cnt = 0;  
-    rp->rio_bufptr = rp->rio_buf;
+    rio_readinitb_buf(rp, fd, rp->rio_buf, sizeof(rp->rio_buf));
 }
 /* $end rio_readinitb */
 
 /*
- * rio_readnb - Robustly read n bytes (buffered)
+ * rio_readinitb_buf - Associate a descriptor with a read buffer of
+ *    bufsize bytes that the caller supplies (and frees after the last
+ *    read), for when RIO_BUFSIZE is the wrong size: bigger for a
+ *    stream of large transfers, smaller for many mostly-idle ones.
+ */
+void rio_readinitb_buf(rio_t *rp, int fd, char *buf, size_t bufsize)
+{
+    rp->rio_fd = fd;
+    rp->rio_cnt = 0;
+    rp->rio_base = rp->rio_bufptr = buf;
+    rp->rio_bufsize = bufsize;
+}
+
+/*
+ * rio_readv - Refill an empty internal buffer and satisfy a read of n
+ *    bytes in the same system call: one readv fills usrbuf first and
+ *    the internal buffer with whatever follows. A large read thus goes
+ *    straight into the caller's buffer with no copy, and a small one
+ *    still leaves the rest of the input buffered for later reads.
+ *    Returns the bytes placed in usrbuf, 0 on EOF, or -1 on error.
+ */
+static ssize_t rio_readv(rio_t *rp, char *usrbuf, size_t n)
+{
+    ssize_t nread;
+    struct iovec iov[2];
+
+    iov[0].iov_base = usrbuf;
+    iov[0].iov_len = n;
+    iov[1].iov_base = rp->rio_base;
+    iov[1].iov_len = rp->rio_bufsize;
+    while ((nread = readv(rp->rio_fd, iov, 2)) < 0)
+	if (errno != EINTR)     /* Interrupted by sig handler return */
+	    return -1;
+
+    rp->rio_bufptr = rp->rio_base;
+    rp->rio_cnt = (size_t)nread > n ? nread - n : 0;
+    return (size_t)nread > n ? (ssize_t)n : nread;
+}
+
+/*
+ * rio_readnb - Robustly read n bytes (buffered). Bytes already in the
+ *    internal buffer are copied out first; after that each refill is a
+ *    single rio_readv.
  */
 /* $begin rio_readnb */
 ssize_t rio_readnb(rio_t *rp, void *usrbuf, size_t n) 
@@ -834,7 +1302,11 @@ ssize_t rio_readnb(rio_t *rp, void *usrbuf, size_t n)
     char *bufp = usrbuf;
     
     while (nleft > 0) {
-	if ((nread = rio_read(rp, bufp, nleft)) < 0) 
+	if (rp->rio_cnt > 0)
+	    nread = rio_read(rp, bufp, nleft);
+	else
+	    nread = rio_readv(rp, bufp, nleft);
+	if (nread < 0) 
             return -1;          /* errno set by read() */ 
 	else if (nread == 0)
 	    break;              /* EOF */
@@ -845,37 +1317,145 @@ ssize_t rio_readnb(rio_t *rp, void *usrbuf, size_t n)
 }
 /* $end rio_readnb */
 
+/*
+ * rio_refill - Refill rp's internal buffer from its descriptor once
+ *    every unread byte has been consumed. Returns the number of bytes
+ *    now buffered, 0 on EOF, or -1 on error.
+ */
+static ssize_t rio_refill(rio_t *rp)
+{
+    while ((rp->rio_cnt = read(rp->rio_fd, rp->rio_base,
+			       rp->rio_bufsize)) < 0) {
+	if (errno != EINTR) {   /* Interrupted by sig handler return */
+	    rp->rio_cnt = 0;
+	    return -1;
+	}
+    }
+    rp->rio_bufptr = rp->rio_base;
+    return rp->rio_cnt;
+}
+
 /* 
- * rio_readlineb - Robustly read a text line (buffered)
+ * rio_readlineb - Robustly read a text line (buffered). Copies bytes
+ *    up to and including the next newline (at most maxlen-1 of them)
+ *    and NUL-terminates them. The newline is found with memchr over
+ *    the internal buffer, and each run of bytes is copied in one go.
  */
 /* $begin rio_readlineb */
 ssize_t rio_readlineb(rio_t *rp, void *usrbuf, size_t maxlen) 
 {
-    int n, rc;
-    char c, *bufp = usrbuf;
-
-    for (n = 1; n < maxlen; n++) { 
-        if ((rc = rio_read(rp, &c, 1)) == 1) {
-	    *bufp++ = c;
-	    if (c == '\n') {
-                n++;
-     		break;
-            }
-	} else if (rc == 0) {
-	    if (n == 1) {
-		return 0; /* EOF, no data read */
-            }
-	    else {
-		break;    /* EOF, some data was read */
-            }
-	} else
-	    return -1;	  /* Error */
+    size_t n = 0, cnt;
+    ssize_t rc;
+    char *bufp = usrbuf, *nl = NULL;
+
+    while (n + 1 < maxlen) {
+	if (rp->rio_cnt <= 0) {
+	    if ((rc = rio_refill(rp)) < 0)
+		return -1;        /* Error */
+	    if (rc == 0) {
+		if (n == 0)
+		    return 0;     /* EOF, no data read */
+		break;            /* EOF, some data was read */
+	    }
+	}
+
+	/* Copy through the next newline, or as much as fits */
+	cnt = maxlen - 1 - n;
+	if ((size_t)rp->rio_cnt < cnt)
+	    cnt = rp->rio_cnt;
+	if ((nl = memchr(rp->rio_bufptr, '\n', cnt)) != NULL)
+	    cnt = nl - rp->rio_bufptr + 1;
+	memcpy(bufp, rp->rio_bufptr, cnt);
+	rp->rio_bufptr += cnt;
+	rp->rio_cnt -= cnt;
+	bufp += cnt;
+	n += cnt;
+	if (nl)
+	    break;
     }
     *bufp = '\0';
-    return n-1;
+    return n;
 }
 /* $end rio_readlineb */
 
+/*
+ * rio_readline_view - Read a text line without copying it. Sets *linep
+ *    to the line where it lies in rp's internal buffer and returns its
+ *    length, newline included. The line is not NUL-terminated and is
+ *    valid only until the next read from rp. If the line runs past the
+ *    end of the buffered bytes, they are first moved to the front of
+ *    the buffer and more is read after them; a line longer than the
+ *    whole buffer comes back in buffer-sized pieces without newlines.
+ *    Returns 0 on EOF with no data and -1 on error.
+ */
+ssize_t rio_readline_view(rio_t *rp, char **linep)
+{
+    ssize_t rc;
+    size_t scanned = 0, len;
+    char *nl;
+
+    if (rp->rio_cnt <= 0 && rio_refill(rp) < 0)
+	return -1;
+    while (!(nl = memchr(rp->rio_bufptr + scanned, '\n',
+			 rp->rio_cnt - scanned))) {
+	scanned = rp->rio_cnt;
+	if ((rc = rio_fill(rp)) == 0 || (rc < 0 && errno == ENOBUFS))
+	    break;                /* EOF or a full buffer: return what's here */
+	if (rc < 0)
+	    return -1;
+    }
+
+    len = nl ? nl - rp->rio_bufptr + 1 : rp->rio_cnt;
+    *linep = rp->rio_bufptr;
+    rp->rio_bufptr += len;
+    rp->rio_cnt -= len;
+    return len;
+}
+
+/*
+ * rio_fill - Read more bytes into rp's internal buffer without
+ *    consuming any, after moving the unread bytes to the front of the
+ *    buffer. Lets a caller parse a request in place, at rp->rio_bufptr
+ *    (rp->rio_cnt bytes), until it is all there. Returns the number of
+ *    bytes added, 0 on EOF, or -1 on error, with errno set to ENOBUFS
+ *    if the buffer is already full.
+ */
+ssize_t rio_fill(rio_t *rp)
+{
+    ssize_t n;
+
+    if (rp->rio_cnt <= 0)
+	rp->rio_cnt = 0;
+    else if (rp->rio_bufptr != rp->rio_base)
+	memmove(rp->rio_base, rp->rio_bufptr, rp->rio_cnt);
+    rp->rio_bufptr = rp->rio_base;
+    if ((size_t)rp->rio_cnt == rp->rio_bufsize) {
+	errno = ENOBUFS;
+	return -1;
+    }
+
+    while ((n = read(rp->rio_fd, rp->rio_base + rp->rio_cnt,
+		     rp->rio_bufsize - rp->rio_cnt)) < 0)
+	if (errno != EINTR) /* Interrupted by sig handler return */
+	    return -1;
+    rp->rio_cnt += n;
+    return n;
+}
+
+/*
+ * rio_consume - Discard the next n unread bytes of rp's internal
+ *    buffer (at most rp->rio_cnt), e.g. a request parsed in place
+ */
+void rio_consume(rio_t *rp, size_t n)
+{
+    if (rp->rio_cnt <= 0)
+	return;
+    if (n > (size_t)rp->rio_cnt)
+	n = rp->rio_cnt;
+    rp->rio_bufptr += n;
+    rp->rio_cnt -= n;
+}
+
 /**********************************
  * Wrappers for robust I/O routines
  **********************************/
@@ -917,6 +1497,33 @@ ssize_t Rio_readlineb(rio_t *rp, void *usrbuf, size_t maxlen)
     return rc;
 } 
 
+void Rio_sendmore(int fd, void *usrbuf, size_t n) 
+{
+    if (rio_sendmore(fd, usrbuf, n) != n)
+	unix_error("Rio_sendmore error");
+}
+
+ssize_t Rio_sendfile(int outfd, int infd, off_t offset, size_t n) 
+{
+    ssize_t rc;
+
+    if ((rc = rio_sendfile(outfd, infd, offset, n)) < 0)
+	unix_error("Rio_sendfile error");
+    return rc;
+}
+
+void Rio_writeb(riow_t *wp, const void *usrbuf, size_t n) 
+{
+    if (rio_writeb(wp, usrbuf, n) < 0)
+	unix_error("Rio_writeb error");
+}
+
+void Rio_flushb(riow_t *wp) 
+{
+    if (rio_flushb(wp) < 0)
+	unix_error("Rio_flushb error");
+}
+
 /******************************** 
  * Client/server helper functions
  ********************************/
@@ -925,11 +1532,13 @@ ssize_t Rio_readlineb(rio_t *rp, void *usrbuf, size_t maxlen)
  *     return a socket descriptor ready for reading and writing. This
  *     function is reentrant and protocol-independent.
  * 
- *     On error, returns -1 and sets errno.  
+ *     On error, returns -2 for getaddrinfo error (the name didn't
+ *     resolve; reported on stderr), or -1 with errno set for other
+ *     errors. Neither exits, so a server can survive a bad hostname.
  */
 /* $begin open_clientfd */
 int open_clientfd(char *hostname, char *port) {
-    int clientfd;
+    int clientfd, rc;
     struct addrinfo hints, *listp, *p;
 
     /* Get a list of potential server addresses */
@@ -937,7 +1546,11 @@ int open_clientfd(char *hostname, char *port) {
     hints.ai_socktype = SOCK_STREAM;  /* Open a connection */
     hints.ai_flags = AI_NUMERICSERV;  /* ... using a numeric port arg. */
     hints.ai_flags |= AI_ADDRCONFIG;  /* Recommended for connections */
-    Getaddrinfo(hostname, port, &hints, &listp);
+    if ((rc = getaddrinfo(hostname, port, &hints, &listp)) != 0) {
+        fprintf(stderr, "getaddrinfo failed (%s:%s): %s\n", hostname, port,
+                gai_strerror(rc));
+        return -2;
+    }
   
     /* Walk the list for one that we can successfully connect to */
     for (p = listp; p; p = p->ai_next) {
@@ -947,7 +1560,12 @@ int open_clientfd(char *hostname, char *port) {
             continue; /* Socket failed, try the next */
         if (connect(clientfd, p->ai_addr, p->ai_addrlen) != -1) 
             break; /* Success */
-        Close(clientfd); /* Connect failed, try another */
+        if (close(clientfd) < 0) { /* Connect failed, try another */
+            fprintf(stderr, "open_clientfd: close failed: %s\n",
+                    strerror(errno));
+            freeaddrinfo(listp);
+            return -1;
+        }
     } 
 
     /* Clean up */
@@ -1008,6 +1626,54 @@ int open_listenfd(char *port)
 }
 /* $end open_listenfd */
 
+/*
+ * open_listenfd_sharded - Open n listening sockets on port, all bound
+ *     to the same address with SO_REUSEPORT, and store them in fds.
+ *     The kernel spreads incoming connections across them, so each
+ *     can be served by its own thread without sharing an accept queue.
+ *
+ *     On error, closes any sockets it opened, returns -1 and sets errno.
+ */
+int open_listenfd_sharded(char *port, int n, int *fds)
+{
+    struct addrinfo hints, *listp, *p;
+    int i, saved, optval=1;
+
+    memset(&hints, 0, sizeof(struct addrinfo));
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV | AI_ADDRCONFIG;
+    Getaddrinfo(NULL, port, &hints, &listp);
+
+    /* Find an address the first shard can bind to; the rest join it */
+    for (p = listp; p; p = p->ai_next) {
+	for (i = 0; i < n; i++) {
+	    if ((fds[i] = socket(p->ai_family, p->ai_socktype,
+				 p->ai_protocol)) < 0)
+		break;
+	    Setsockopt(fds[i], SOL_SOCKET, SO_REUSEADDR,
+		       (const void *)&optval, sizeof(int));
+	    if (setsockopt(fds[i], SOL_SOCKET, SO_REUSEPORT,
+			   (const void *)&optval, sizeof(int)) < 0 ||
+		bind(fds[i], p->ai_addr, p->ai_addrlen) < 0 ||
+		listen(fds[i], LISTENQ) < 0) {
+		saved = errno;
+		close(fds[i]);
+		errno = saved;
+		break;
+	    }
+	}
+	if (i == n)
+	    break; /* Success */
+	saved = errno;
+	while (--i >= 0)
+	    close(fds[i]);
+	errno = saved;
+    }
+
+    Freeaddrinfo(listp);
+    return p ? 0 : -1;
+}
+
 /****************************************************
  * Wrappers for reentrant protocol-independent helpers
  ****************************************************/
@@ -1015,7 +1681,9 @@ int Open_clientfd(char *hostname, char *port)
 {
     int rc;
 
-    if ((rc = open_clientfd(hostname, port)) < 0) 
+    if ((rc = open_clientfd(hostname, port)) == -2)
+	app_error("Open_clientfd error: name lookup failed");
+    if (rc < 0) 
 	unix_error("Open_clientfd error");
     return rc;
 }
@@ -1029,6 +1697,12 @@ int Open_listenfd(char *port)
     return rc;
 }
 
+void Open_listenfd_sharded(char *port, int n, int *fds)
+{
+    if (open_listenfd_sharded(port, n, fds) < 0)
+	unix_error("Open_listenfd_sharded error");
+}
+
 /* $end csapp.c */
 
 
@@ -3,6 +3,7 @@
 #define __CSAPP_H__
 
 #include <stdio.h>
+#include <stdarg.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
@@ -16,6 +17,8 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
 #include <errno.h>
 #include <math.h>
 #include <pthread.h>
@@ -43,10 +46,26 @@ typedef struct {
     int rio_fd;                /* Descriptor for this internal buf */
     int rio_cnt;               /* Unread bytes in internal buf */
     char *rio_bufptr;          /* Next unread byte in internal buf */
-    char rio_buf[RIO_BUFSIZE]; /* Internal buffer */
+    char *rio_base;            /* Internal buf: rio_buf, or the caller's */
+    size_t rio_bufsize;        /* Size of internal buf (at most INT_MAX) */
+    char rio_buf[RIO_BUFSIZE]; /* Default internal buffer */
 } rio_t;
 /* $end rio_t */
 
+#define RIO_ALL ((size_t)-1)   /* rio_splice: move everything up to EOF */
+
+/* Persistent state for buffered Rio output */
+#define RIO_WBUFSIZE 8192
+#define RIO_WIOVMAX  16
+typedef struct {
+    int riow_fd;                 /* Descriptor to write to */
+    size_t riow_cnt;             /* Bytes used in riow_buf */
+    int riow_niov;               /* Segments queued for the next flush */
+    struct iovec riow_iov[RIO_WIOVMAX]; /* Queued segments, in order: runs
+					   of riow_buf or caller memory */
+    char riow_buf[RIO_WBUFSIZE]; /* Bytes copied in by rio_writeb */
+} riow_t;
+
 /* External variables */
 extern int h_errno;    /* Defined by BIND for DNS errors */ 
 extern char **environ; /* Defined by libc */
@@ -172,8 +191,23 @@ void V(sem_t *sem);
 ssize_t rio_readn(int fd, void *usrbuf, size_t n);
 ssize_t rio_writen(int fd, void *usrbuf, size_t n);
 void rio_readinitb(rio_t *rp, int fd); 
+void rio_readinitb_buf(rio_t *rp, int fd, char *buf, size_t bufsize);
 ssize_t	rio_readnb(rio_t *rp, void *usrbuf, size_t n);
 ssize_t	rio_readlineb(rio_t *rp, void *usrbuf, size_t maxlen);
+ssize_t rio_readline_view(rio_t *rp, char **linep);
+ssize_t rio_fill(rio_t *rp);
+void rio_consume(rio_t *rp, size_t n);
+ssize_t rio_sendmore(int fd, void *usrbuf, size_t n);
+ssize_t rio_writev(int fd, struct iovec *iov, int iovcnt);
+ssize_t rio_mmapwrite(int outfd, int infd, off_t offset, size_t n);
+ssize_t rio_sendfile(int outfd, int infd, off_t offset, size_t n);
+ssize_t rio_splice(int outfd, int infd, size_t n);
+void rio_writeinitb(riow_t *wp, int fd);
+ssize_t rio_writeb(riow_t *wp, const void *usrbuf, size_t n);
+ssize_t rio_writeb_ref(riow_t *wp, const void *usrbuf, size_t n);
+ssize_t rio_printfb(riow_t *wp, const char *fmt, ...);
+ssize_t rio_flushb(riow_t *wp);
+ssize_t rio_flushb_more(riow_t *wp);
 
 /* Wrappers for Rio package */
 ssize_t Rio_readn(int fd, void *usrbuf, size_t n);
@@ -181,14 +215,20 @@ void Rio_writen(int fd, void *usrbuf, size_t n);
 void Rio_readinitb(rio_t *rp, int fd); 
 ssize_t Rio_readnb(rio_t *rp, void *usrbuf, size_t n);
 ssize_t Rio_readlineb(rio_t *rp, void *usrbuf, size_t maxlen);
+void Rio_sendmore(int fd, void *usrbuf, size_t n);
+ssize_t Rio_sendfile(int outfd, int infd, off_t offset, size_t n);
+void Rio_writeb(riow_t *wp, const void *usrbuf, size_t n);
+void Rio_flushb(riow_t *wp);
 
 /* Reentrant protocol-independent client/server helpers */
 int open_clientfd(char *hostname, char *port);
 int open_listenfd(char *port);
+int open_listenfd_sharded(char *port, int n, int *fds);
 
 /* Wrappers for reentrant protocol-independent client/server helpers */
 int Open_clientfd(char *hostname, char *port);
 int Open_listenfd(char *port);
+void Open_listenfd_sharded(char *port, int n, int *fds);
 
 
 #endif /* __CSAPP_H__ */
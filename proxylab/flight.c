@@ -0,0 +1,331 @@
+/*
+ * flight.c - Single-flight fetches: one origin request per key at a
+ *     time. See flight.h.
+ *
+ * Lock order: the table's lock, then a flight's.
+ */
+#include "flight.h"
+
+/* hash - FNV-1a hash of a key */
+static unsigned long hash(const char *key)
+{
+    unsigned long h = 14695981039346656037UL;
+
+    while (*key) {
+	h ^= (unsigned char)*key++;
+	h *= 1099511628211UL;
+    }
+    return h;
+}
+
+/* free_segs - free the bytes recorded by f */
+static void free_segs(flight_t *f)
+{
+    flight_seg_t *seg, *next;
+
+    for (seg = f->head; seg; seg = next) {
+	next = seg->next;
+	Free(seg);
+    }
+    f->head = f->tail = NULL;
+    f->held = 0;
+}
+
+/*
+ * trim - free the segments at the head of f that every follower has
+ *     read, once no new follower can join to start from the head.
+ *     Caller holds f's lock.
+ */
+static void trim(flight_t *f)
+{
+    flight_seg_t *seg;
+    flight_cursor_t *c;
+
+    if (f->published || f->unstarted > 0)
+	return;
+    while ((seg = f->head) && seg->next) {  /* The leader fills the tail */
+	for (c = f->cursors; c; c = c->next)
+	    if (!c->seg || c->seg == seg)
+		return;
+	f->head = seg->next;
+	f->held -= FLIGHT_SEGSIZE;
+	Free(seg);
+	pthread_cond_broadcast(&f->room);
+    }
+}
+
+/*
+ * flight_init - create an empty table of flights, each taking
+ *     followers until it has recorded maxbytes bytes
+ */
+void flight_init(flights_t *fp, size_t maxbytes)
+{
+    int rc;
+
+    if ((rc = pthread_mutex_init(&fp->lock, NULL)) != 0)
+	posix_error(rc, "pthread_mutex_init error");
+    fp->nbuckets = 256;
+    fp->buckets = Calloc(fp->nbuckets, sizeof(flight_t *));
+    fp->maxbytes = maxbytes;
+    fp->flights = fp->joins = 0;
+}
+
+/*
+ * flight_join - join the running flight for key as a follower, or
+ *     start one as its leader if there is none; *leader says which.
+ *     Either way the caller gets a reference to give back with
+ *     flight_release, and a leader must also call flight_finish.
+ */
+flight_t *flight_join(flights_t *fp, const char *key, int *leader)
+{
+    flight_t *f, **bucket;
+
+    pthread_mutex_lock(&fp->lock);
+    bucket = &fp->buckets[hash(key) & (fp->nbuckets - 1)];
+    for (f = *bucket; f; f = f->next)
+	if (!strcmp(f->key, key))
+	    break;
+    if (f) {
+	pthread_mutex_lock(&f->lock);
+	f->refcnt++;
+	f->unstarted++;
+	pthread_mutex_unlock(&f->lock);
+	fp->joins++;
+	pthread_mutex_unlock(&fp->lock);
+	*leader = 0;
+	return f;
+    }
+
+    f = Calloc(1, sizeof(flight_t));
+    f->key = Malloc(strlen(key) + 1);
+    strcpy(f->key, key);
+    pthread_mutex_init(&f->lock, NULL);
+    pthread_cond_init(&f->more, NULL);
+    pthread_cond_init(&f->room, NULL);
+    f->state = FLIGHT_RUNNING;
+    f->recording = f->published = 1;
+    f->refcnt = 1;
+    f->next = *bucket;
+    *bucket = f;
+    fp->flights++;
+    pthread_mutex_unlock(&fp->lock);
+    *leader = 1;
+    return f;
+}
+
+/*
+ * unpublish - take f out of the table so nobody else can join it
+ */
+static void unpublish(flights_t *fp, flight_t *f)
+{
+    flight_t **pp;
+
+    pthread_mutex_lock(&fp->lock);
+    if (f->published) {
+	for (pp = &fp->buckets[hash(f->key) & (fp->nbuckets - 1)];
+	     *pp != f; pp = &(*pp)->next)
+	    ;
+	*pp = f->next;
+	pthread_mutex_lock(&f->lock);
+	f->published = 0;
+	trim(f);
+	pthread_mutex_unlock(&f->lock);
+    }
+    pthread_mutex_unlock(&fp->lock);
+}
+
+/*
+ * wait_room - (leader) wait until f holds few enough bytes to take
+ *     another segment, or has no followers left. Gives up on the
+ *     followers if none of them reads anything for FLIGHT_STALLWAIT
+ *     seconds. Caller holds f's lock.
+ */
+static void wait_room(flights_t *fp, flight_t *f)
+{
+    struct timespec deadline;
+    int rc;
+
+    while (!f->published && f->held + FLIGHT_SEGSIZE > fp->maxbytes &&
+	   f->refcnt > 1) {
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += FLIGHT_STALLWAIT;
+	rc = pthread_cond_timedwait(&f->room, &f->lock, &deadline);
+	if (rc == ETIMEDOUT && f->held + FLIGHT_SEGSIZE > fp->maxbytes &&
+	    f->refcnt > 1) {
+	    f->recording = 0;           /* They end where they are */
+	    f->state = FLIGHT_FAILED;
+	    pthread_cond_broadcast(&f->more);
+	    return;
+	}
+    }
+}
+
+/*
+ * flight_append - (leader) add the next n bytes of the response. Past
+ *     the table's maxbytes the flight takes no more followers, and
+ *     if it has none, stops recording. It never holds much more than
+ *     maxbytes: the leader waits for its followers to read them.
+ */
+void flight_append(flights_t *fp, flight_t *f, const void *data, size_t n)
+{
+    const char *p = data;
+    flight_seg_t *seg;
+    size_t len;
+
+    if (!f->recording)
+	return;
+    if (f->published && f->len + n > fp->maxbytes && flight_bypass(fp, f))
+	return;
+
+    /* Only the leader writes, and only past the bytes published so far */
+    while (n > 0) {
+	seg = f->tail;
+	if (!seg || seg->len == FLIGHT_SEGSIZE) {
+	    pthread_mutex_lock(&f->lock);
+	    wait_room(fp, f);
+	    if (!f->recording || (!f->published && f->refcnt == 1)) {
+		pthread_mutex_unlock(&f->lock);
+		flight_bypass(fp, f);   /* Frees what nobody will read */
+		return;
+	    }
+	    seg = Malloc(sizeof(flight_seg_t));
+	    seg->next = NULL;
+	    seg->len = 0;
+	    f->held += FLIGHT_SEGSIZE;
+	    if (f->tail)
+		f->tail->next = seg;
+	    else
+		f->head = seg;
+	    f->tail = seg;
+	    pthread_mutex_unlock(&f->lock);
+	}
+	len = FLIGHT_SEGSIZE - seg->len;
+	if (len > n)
+	    len = n;
+	memcpy(seg->data + seg->len, p, len);
+	pthread_mutex_lock(&f->lock);
+	seg->len += len;
+	f->len += len;
+	pthread_cond_broadcast(&f->more);
+	pthread_mutex_unlock(&f->lock);
+	p += len;
+	n -= len;
+    }
+}
+
+/*
+ * flight_bypass - (leader) take no more followers, and if there are
+ *     none, stop recording. Returns 1 if nobody needs the rest of the
+ *     response appended, so the leader may relay it as it likes.
+ */
+int flight_bypass(flights_t *fp, flight_t *f)
+{
+    if (!f->recording)
+	return 1;
+    unpublish(fp, f);
+    pthread_mutex_lock(&f->lock);
+    if (f->refcnt == 1) {               /* Nobody left to read it */
+	f->recording = 0;
+	free_segs(f);
+    }
+    pthread_mutex_unlock(&f->lock);
+    return !f->recording;
+}
+
+/*
+ * flight_finish - (leader) end the flight: the response is complete
+ *     if ok, else the fetch failed
+ */
+void flight_finish(flights_t *fp, flight_t *f, int ok)
+{
+    unpublish(fp, f);
+    pthread_mutex_lock(&f->lock);
+    if (f->state == FLIGHT_RUNNING)     /* Not given up on by wait_room */
+	f->state = ok ? FLIGHT_DONE : FLIGHT_FAILED;
+    pthread_cond_broadcast(&f->more);
+    pthread_mutex_unlock(&f->lock);
+}
+
+/*
+ * flight_followers - (leader) how many followers does f have? A
+ *     leader whose own client has gone keeps fetching for them.
+ */
+int flight_followers(flight_t *f)
+{
+    int n;
+
+    pthread_mutex_lock(&f->lock);
+    n = f->refcnt - 1;
+    pthread_mutex_unlock(&f->lock);
+    return n;
+}
+
+/*
+ * flight_relay - (follower) write the response to fd as the leader
+ *     appends it, until the flight ends. Returns the number of bytes
+ *     written, or -1 if the flight failed before producing any (the
+ *     caller should then answer for itself).
+ */
+ssize_t flight_relay(flight_t *f, int fd)
+{
+    flight_cursor_t cur, **cp;
+    size_t off = 0, total = 0, avail;
+    ssize_t rc;
+
+    pthread_mutex_lock(&f->lock);
+    cur.seg = NULL;             /* Keeps f's head until we start on it */
+    cur.next = f->cursors;
+    f->cursors = &cur;
+    f->unstarted--;
+    while (1) {
+	if (!cur.seg)
+	    cur.seg = f->head;
+	avail = cur.seg ? cur.seg->len - off : 0;
+	if (avail > 0) {
+	    pthread_mutex_unlock(&f->lock);
+	    rc = rio_writen(fd, cur.seg->data + off, avail);
+	    pthread_mutex_lock(&f->lock);
+	    if (rc < 0)
+		break;                  /* Our client went away */
+	    off += avail;
+	    total += avail;
+	}
+	else if (cur.seg && cur.seg->next) {
+	    cur.seg = cur.seg->next;
+	    off = 0;
+	    trim(f);
+	}
+	else if (f->state != FLIGHT_RUNNING)
+	    break;
+	else
+	    pthread_cond_wait(&f->more, &f->lock);
+    }
+    for (cp = &f->cursors; *cp != &cur; cp = &(*cp)->next)
+	;
+    *cp = cur.next;
+    trim(f);
+    pthread_cond_broadcast(&f->room);
+    rc = f->state == FLIGHT_FAILED && total == 0 ? -1 : (ssize_t)total;
+    pthread_mutex_unlock(&f->lock);
+    return rc;
+}
+
+/*
+ * flight_release - give back a reference from flight_join
+ */
+void flight_release(flight_t *f)
+{
+    int refcnt;
+
+    pthread_mutex_lock(&f->lock);
+    refcnt = --f->refcnt;
+    pthread_mutex_unlock(&f->lock);
+    if (refcnt > 0)
+	return;
+    free_segs(f);
+    pthread_mutex_destroy(&f->lock);
+    pthread_cond_destroy(&f->more);
+    pthread_cond_destroy(&f->room);
+    Free(f->key);
+    Free(f);
+}
@@ -0,0 +1,88 @@
+/*
+ * flight.h - Single-flight fetches: one origin request per key at a time.
+ *
+ * When several clients miss the cache on the same key at once, only
+ * the first (the leader) fetches it. flight_join makes the others
+ * followers of the leader's flight. The leader appends the response to
+ * the flight as it arrives, and each follower streams it to its own
+ * client from there, at its own pace, while the rest is still coming.
+ * The response is kept in a list of fixed-size segments that never
+ * move, so followers read it without holding any lock.
+ *
+ * A flight stops taking new followers when it finishes, or once it has
+ * recorded flight_maxbytes bytes (later arrivals fetch for themselves,
+ * so one huge download isn't held in memory for latecomers). From then
+ * on, each segment is freed as soon as every follower has read past
+ * it, and the leader waits before recording more than maxbytes that
+ * some follower hasn't read yet. If no follower reads anything for
+ * FLIGHT_STALLWAIT seconds, the leader stops recording and the flight
+ * fails for them where it stands, as if the origin had. It is freed
+ * when the leader and the last follower have released it. A leader
+ * with no followers that won't cache the response can also close the
+ * flight early with flight_bypass and relay the rest of the response
+ * without recording it.
+ */
+#ifndef __FLIGHT_H__
+#define __FLIGHT_H__
+
+#include "csapp.h"
+
+#define FLIGHT_SEGSIZE   (64 * 1024)
+#define FLIGHT_STALLWAIT 30    /* Seconds the leader waits for followers */
+
+/* Flight states */
+#define FLIGHT_RUNNING 0       /* The leader is still fetching */
+#define FLIGHT_DONE    1       /* The whole response has been appended */
+#define FLIGHT_FAILED  2       /* The fetch failed, maybe partway through */
+
+typedef struct flight_seg {
+    struct flight_seg *next;
+    size_t len;                /* Bytes of data filled in */
+    char data[FLIGHT_SEGSIZE];
+} flight_seg_t;
+
+typedef struct flight_cursor {
+    flight_seg_t *seg;         /* Segment a follower is reading, or NULL
+				  if it hasn't started */
+    struct flight_cursor *next;
+} flight_cursor_t;
+
+typedef struct flight {
+    char *key;
+    pthread_mutex_t lock;      /* Protects everything below but key, next */
+    pthread_cond_t more;       /* Broadcast when bytes arrive or it ends */
+    pthread_cond_t room;       /* Broadcast when segments are freed or a
+				  follower leaves */
+    flight_seg_t *head;        /* The response so far, less the segments
+				  every follower has read */
+    flight_seg_t *tail;
+    size_t len;                /* Bytes appended so far */
+    size_t held;               /* Bytes of segments not yet freed */
+    flight_cursor_t *cursors;  /* Followers reading */
+    int unstarted;             /* Followers that haven't started reading */
+    int state;
+    int recording;             /* Still keeping the bytes appended? */
+    int published;             /* Can new followers still join? */
+    int refcnt;                /* The leader and the followers */
+    struct flight *next;       /* Hash chain */
+} flight_t;
+
+typedef struct {
+    pthread_mutex_t lock;      /* Protects the table and published flags */
+    flight_t **buckets;        /* Running flights by key */
+    size_t nbuckets;           /* Power of two */
+    size_t maxbytes;           /* Bytes recorded before closing to joiners */
+    unsigned long flights;     /* Flights led */
+    unsigned long joins;       /* Requests that followed a flight */
+} flights_t;
+
+void flight_init(flights_t *fp, size_t maxbytes);
+flight_t *flight_join(flights_t *fp, const char *key, int *leader);
+void flight_append(flights_t *fp, flight_t *f, const void *data, size_t n);
+int flight_bypass(flights_t *fp, flight_t *f);
+void flight_finish(flights_t *fp, flight_t *f, int ok);
+int flight_followers(flight_t *f);
+ssize_t flight_relay(flight_t *f, int fd);
+void flight_release(flight_t *f);
+
+#endif /* __FLIGHT_H__ */
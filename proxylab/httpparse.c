@@ -0,0 +1,282 @@
+/*
+ * httpparse.c - An incremental, zero-copy parser for HTTP request and
+ *     response heads. See httpparse.h.
+ *
+ * The grammar is RFC 7230's, read leniently the way most servers do:
+ * empty lines before the request line are skipped, a bare LF ends a
+ * line as well as CRLF does, tokens may be separated by runs of spaces,
+ * and the version may be missing. Folded header lines, header names
+ * with characters outside the token set, and control characters are
+ * rejected. A status line must be a version, a three-digit code, and
+ * an optional reason phrase.
+ */
+#include <string.h>
+#include <strings.h>
+#include "httpparse.h"
+
+/* Parser states */
+#define S_START    0        /* Before the request line */
+#define S_METHOD   1
+#define S_AFTER_METHOD 2
+#define S_URI      3
+#define S_AFTER_URI 4
+#define S_VERSION  5
+#define S_LF       6        /* Saw the CR that ends a line */
+#define S_LINE     7        /* At the start of a header line */
+#define S_NAME     8
+#define S_AFTER_COLON 9
+#define S_VALUE    10
+#define S_END_LF   11       /* Saw the CR of the blank line */
+#define S_RVERSION 12       /* Response states: the status line */
+#define S_AFTER_RVERSION 13
+#define S_STATUS   14
+#define S_REASON   15
+
+/* tchar - is c allowed in a token (a method or header name)? */
+static int tchar(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+	(c >= '0' && c <= '9') || (c && strchr("!#$%&'*+-.^_`|~", c));
+}
+
+/* ctl - is c a control character (other than the ones we look for)? */
+static int ctl(char c)
+{
+    return (unsigned char)c < ' ' || c == 0x7f;
+}
+
+/*
+ * http_init - get req ready to parse a new request
+ */
+void http_init(http_req_t *req)
+{
+    memset(req, 0, sizeof(http_req_t));
+    req->state = S_START;
+}
+
+/*
+ * http_init_response - get req ready to parse a new response
+ */
+void http_init_response(http_req_t *req)
+{
+    memset(req, 0, sizeof(http_req_t));
+    req->state = S_RVERSION;
+    req->response = 1;
+}
+
+/*
+ * add_field - record the header field just scanned
+ */
+static void add_field(http_req_t *req)
+{
+    if (req->nheaders < HTTP_MAXHEADERS)
+	req->headers[req->nheaders++] = req->field;
+}
+
+/*
+ * http_parse - continue parsing the request (or response) head at the
+ *     start of buf, which now holds len bytes. Returns HTTP_DONE once
+ *     the blank line that ends the head has been scanned (req->hdrlen
+ *     is then its length, and any bytes after it belong to the body or
+ *     to the next message), HTTP_AGAIN if the head is incomplete, and
+ *     HTTP_BAD if it can't be an HTTP head.
+ */
+int http_parse(http_req_t *req, char *buf, size_t len)
+{
+    size_t i;
+    char c;
+
+    for (i = req->pos; i < len; i++) {
+	c = buf[i];
+	switch (req->state) {
+	case S_START:
+	    if (c == '\r' || c == '\n')
+		break;
+	    req->method.off = i;
+	    req->state = S_METHOD;
+	    /* Fall through */
+	case S_METHOD:
+	    if (c == ' ') {
+		req->method.len = i - req->method.off;
+		req->state = S_AFTER_METHOD;
+	    }
+	    else if (!tchar(c))
+		return HTTP_BAD;
+	    break;
+
+	case S_AFTER_METHOD:
+	    if (c == ' ')
+		break;
+	    req->uri.off = i;
+	    req->state = S_URI;
+	    /* Fall through */
+	case S_URI:
+	    if (c == ' ') {
+		req->uri.len = i - req->uri.off;
+		req->state = S_AFTER_URI;
+		break;
+	    }
+	    if (c != '\r' && c != '\n') {
+		if (ctl(c))
+		    return HTTP_BAD;
+		break;
+	    }
+	    if ((req->uri.len = i - req->uri.off) == 0)
+		return HTTP_BAD;
+	    /* Fall through: the line ended without a version */
+	case S_AFTER_URI:
+	    if (c == ' ')
+		break;
+	    req->version.off = i;
+	    req->state = S_VERSION;
+	    /* Fall through */
+	case S_VERSION:
+	    if (c == '\r' || c == '\n') {
+		req->version.len = i - req->version.off;
+		req->state = c == '\r' ? S_LF : S_LINE;
+	    }
+	    else if (c == ' ' || ctl(c))
+		return HTTP_BAD;
+	    break;
+
+	case S_LF:
+	    if (c != '\n')
+		return HTTP_BAD;
+	    req->state = S_LINE;
+	    break;
+
+	case S_LINE:
+	    if (c == '\r')
+		req->state = S_END_LF;
+	    else if (c == '\n') {
+		req->hdrlen = i + 1;
+		req->pos = i + 1;
+		return HTTP_DONE;
+	    }
+	    else if (!tchar(c))
+		return HTTP_BAD;    /* Including obsolete line folding */
+	    else {
+		req->field.name.off = i;
+		req->state = S_NAME;
+	    }
+	    break;
+
+	case S_NAME:
+	    if (c == ':') {
+		req->field.name.len = i - req->field.name.off;
+		req->state = S_AFTER_COLON;
+	    }
+	    else if (!tchar(c))
+		return HTTP_BAD;
+	    break;
+
+	case S_AFTER_COLON:
+	    if (c == ' ' || c == '\t')
+		break;
+	    req->field.value.off = i;
+	    req->field.value.len = 0;
+	    req->state = S_VALUE;
+	    /* Fall through */
+	case S_VALUE:
+	    if (c == '\r' || c == '\n') {
+		add_field(req);
+		req->state = c == '\r' ? S_LF : S_LINE;
+	    }
+	    else if (c != ' ' && c != '\t') {
+		if (ctl(c))
+		    return HTTP_BAD;
+		req->field.value.len = i + 1 - req->field.value.off;
+	    }
+	    break;
+
+	case S_END_LF:
+	    if (c != '\n')
+		return HTTP_BAD;
+	    req->hdrlen = i + 1;
+	    req->pos = i + 1;
+	    return HTTP_DONE;
+
+	case S_RVERSION:
+	    if (c == ' ') {
+		if ((req->version.len = i) == 0)
+		    return HTTP_BAD;
+		req->state = S_AFTER_RVERSION;
+	    }
+	    else if (!tchar(c) && c != '/')
+		return HTTP_BAD;
+	    break;
+
+	case S_AFTER_RVERSION:
+	    if (c == ' ')
+		break;
+	    req->status.off = i;
+	    req->state = S_STATUS;
+	    /* Fall through */
+	case S_STATUS:
+	    if (c >= '0' && c <= '9')
+		break;
+	    if (c != ' ' && c != '\r' && c != '\n')
+		return HTTP_BAD;
+	    if ((req->status.len = i - req->status.off) != 3)
+		return HTTP_BAD;
+	    req->reason.off = c == ' ' ? i + 1 : i;
+	    req->state = S_REASON;
+	    if (c == ' ')
+		break;
+	    /* Fall through: the line ended without a reason phrase */
+	case S_REASON:
+	    if (c == '\r' || c == '\n') {
+		req->reason.len = i - req->reason.off;
+		req->state = c == '\r' ? S_LF : S_LINE;
+	    }
+	    else if (c != '\t' && ctl(c))
+		return HTTP_BAD;
+	    break;
+	}
+    }
+    req->pos = len;
+    return HTTP_AGAIN;
+}
+
+/*
+ * http_terminate - NUL-terminate every span of a fully parsed request
+ *     in place. Each span is followed by a delimiter inside the head,
+ *     which the NUL overwrites, so buf must not be printed afterwards.
+ */
+void http_terminate(http_req_t *req, char *buf)
+{
+    int i;
+    http_header_t *h;
+
+    if (req->response) {
+	buf[req->version.off + req->version.len] = '\0';
+	buf[req->status.off + req->status.len] = '\0';
+	buf[req->reason.off + req->reason.len] = '\0';
+    }
+    else {
+	buf[req->method.off + req->method.len] = '\0';
+	buf[req->uri.off + req->uri.len] = '\0';
+	buf[req->version.off + req->version.len] = '\0';
+    }
+    for (i = 0; i < req->nheaders; i++) {
+	h = &req->headers[i];
+	buf[h->name.off + h->name.len] = '\0';
+	buf[h->value.off + h->value.len] = '\0';
+    }
+}
+
+/*
+ * http_header - return the first header field called name (in any
+ *     case), or NULL if the request has none
+ */
+http_header_t *http_header(http_req_t *req, char *buf, char *name)
+{
+    int i;
+    size_t len = strlen(name);
+
+    for (i = 0; i < req->nheaders; i++)
+	if (req->headers[i].name.len == len &&
+	    !strncasecmp(http_str(buf, req->headers[i].name), name, len))
+	    return &req->headers[i];
+    return NULL;
+}
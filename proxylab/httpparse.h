@@ -0,0 +1,67 @@
+/*
+ * httpparse.h - An incremental, zero-copy parser for HTTP request and
+ *     response heads.
+ *
+ * The parser never copies the request. It scans a buffer holding the
+ * start of a request and records the method, URI, version, and header
+ * fields as spans (offset and length) of that buffer. If the head isn't
+ * all there yet, http_parse returns HTTP_AGAIN; once more bytes have
+ * been appended, call it again with the same buffer and it resumes
+ * where it stopped, so no byte is examined twice. Spans are offsets
+ * rather than pointers, so the caller may move the unparsed request
+ * (e.g. compact its buffer) between calls.
+ *
+ * Once the head is complete, http_terminate writes a NUL after each
+ * span in place, turning them into C strings that share the buffer.
+ *
+ * A response head is parsed the same way after http_init_response; its
+ * status line lands in version, status, and reason instead of method,
+ * uri, and version.
+ */
+#ifndef __HTTPPARSE_H__
+#define __HTTPPARSE_H__
+
+#include <stddef.h>
+
+#define HTTP_MAXHEADERS 64  /* Header fields recorded; later ones are skipped */
+
+/* http_parse results */
+#define HTTP_DONE   1       /* The whole head has been parsed */
+#define HTTP_AGAIN  0       /* Need more bytes */
+#define HTTP_BAD   -1       /* Not an HTTP request head */
+
+typedef struct {
+    size_t off;             /* Offset from the start of the buffer */
+    size_t len;
+} http_span_t;
+
+typedef struct {
+    http_span_t name;
+    http_span_t value;      /* Without surrounding whitespace */
+} http_header_t;
+
+typedef struct {
+    int state;              /* Where to resume scanning */
+    int response;           /* Parsing a response head? */
+    size_t pos;             /* Bytes scanned so far */
+    http_span_t method;
+    http_span_t uri;
+    http_span_t version;    /* Empty for a bare "GET /uri" request line */
+    http_span_t status;     /* Responses only: the three-digit code */
+    http_span_t reason;     /* Responses only: the reason phrase */
+    http_header_t headers[HTTP_MAXHEADERS];
+    int nheaders;
+    http_header_t field;    /* Header field being scanned */
+    size_t hdrlen;          /* Length of the head, blank line included */
+} http_req_t;
+
+/* The span as a pointer into buf (a C string after http_terminate) */
+#define http_str(buf, span) ((buf) + (span).off)
+
+void http_init(http_req_t *req);
+void http_init_response(http_req_t *req);
+int http_parse(http_req_t *req, char *buf, size_t len);
+void http_terminate(http_req_t *req, char *buf);
+http_header_t *http_header(http_req_t *req, char *buf, char *name);
+
+#endif /* __HTTPPARSE_H__ */
@@ -0,0 +1,304 @@
+/*
+ * latency.c - Per-request latency histograms for Tiny. See latency.h.
+ */
+#include "latency.h"
+
+typedef struct {
+    unsigned long requests;
+    unsigned long in;          /* Bytes */
+    unsigned long out;
+    lat_hist_t h[LAT_NPHASES];
+} lat_outcome_t;
+
+typedef struct lat_thread {
+    lat_outcome_t o[LAT_NOUTCOMES];
+    int owned;                 /* Does a live thread record into it? */
+    struct lat_thread *next;   /* All of them; never removed */
+} lat_thread_t;
+
+static char *phase_names[LAT_NPHASES] = {
+    "accept", "parse", "stat", "head", "body", "total"
+};
+static char *outcome_names[LAT_NOUTCOMES] = { "static", "dynamic", "error" };
+
+static lat_thread_t *threads;
+static pthread_key_t thread_key;
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static __thread lat_thread_t *mine;
+
+/* Counters have one writer, but are read by any thread */
+#define bump(p, n) __atomic_store_n((p), *(p) + (n), __ATOMIC_RELAXED)
+#define peek(p)    __atomic_load_n((p), __ATOMIC_RELAXED)
+
+/*
+ * thread_release - thread-specific data destructor: hand the exiting
+ *     thread's histograms on to the next new thread. What they hold
+ *     still counts.
+ */
+static void thread_release(void *vargp)
+{
+    lat_thread_t *th = vargp;
+
+    __atomic_store_n(&th->owned, 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * key_init - create the key whose destructor releases a thread's
+ *     histograms, once
+ */
+static void key_init(void)
+{
+    int rc;
+
+    if ((rc = pthread_key_create(&thread_key, thread_release)) != 0)
+	posix_error(rc, "pthread_key_create error");
+}
+
+/*
+ * thread_get - return the calling thread's histograms, taking over
+ *     those of a thread that exited, or adding new ones, the first time
+ */
+static lat_thread_t *thread_get(void)
+{
+    lat_thread_t *th;
+    int zero;
+
+    if (mine)
+	return mine;
+    pthread_once(&key_once, key_init);
+    for (th = __atomic_load_n(&threads, __ATOMIC_ACQUIRE); th; th = th->next) {
+	zero = 0;
+	if (__atomic_compare_exchange_n(&th->owned, &zero, 1, 0,
+					__ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+	    break;
+    }
+    if (!th) {
+	th = Calloc(1, sizeof(lat_thread_t));
+	th->owned = 1;
+	th->next = __atomic_load_n(&threads, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&threads, &th->next, th, 0,
+					    __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+	    ;
+    }
+    pthread_setspecific(thread_key, th);
+    return mine = th;
+}
+
+/*
+ * bucket - index of the bucket that holds v ns
+ */
+static int bucket(unsigned long v)
+{
+    int e;
+
+    if (v < LAT_SUB)
+	return v;
+    e = 63 - __builtin_clzl(v);         /* v's highest set bit */
+    if (e >= LAT_MAXBITS)
+	return LAT_NBUCKETS - 1;
+    return (e - LAT_SUBBITS + 1) * LAT_SUB +
+	((v >> (e - LAT_SUBBITS)) & (LAT_SUB - 1));
+}
+
+/*
+ * bucket_value - the highest value bucket i holds
+ */
+static unsigned long bucket_value(int i)
+{
+    int e = i / LAT_SUB + LAT_SUBBITS - 1;
+
+    if (i < LAT_SUB)
+	return i;
+    return ((unsigned long)(LAT_SUB + i % LAT_SUB) << (e - LAT_SUBBITS)) +
+	(1UL << (e - LAT_SUBBITS)) - 1;
+}
+
+/*
+ * lat_reset - forget everything about r, for a new request
+ */
+void lat_reset(lat_req_t *r)
+{
+    memset(r, 0, sizeof(*r));
+    r->outcome = LAT_NONE;
+}
+
+/*
+ * lat_mark - stamp r with the time now, unless it already has that
+ *     stamp (a request head's first bytes, say, may be read twice)
+ */
+void lat_mark(lat_req_t *r, int stamp)
+{
+    struct timespec ts;
+
+    if (r->t[stamp])
+	return;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    r->t[stamp] = ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+/*
+ * lat_hist_add - add v ns to h
+ */
+void lat_hist_add(lat_hist_t *h, unsigned long v)
+{
+    bump(&h->b[bucket(v)], 1);
+    bump(&h->count, 1);
+    if (v > h->max)
+	__atomic_store_n(&h->max, v, __ATOMIC_RELAXED);
+}
+
+/*
+ * lat_record - add the finished request r to the calling thread's
+ *     histograms, unless its outcome is LAT_NONE, and reset it
+ */
+void lat_record(lat_req_t *r)
+{
+    lat_outcome_t *o;
+    int i, first = -1, prev = -1;
+
+    if (r->outcome != LAT_NONE) {
+	o = &thread_get()->o[r->outcome];
+	bump(&o->requests, 1);
+	bump(&o->in, r->in);
+	bump(&o->out, r->out);
+	for (i = 0; i < LAT_NSTAMPS; i++) {
+	    if (!r->t[i])
+		continue;
+	    if (prev >= 0)
+		lat_hist_add(&o->h[i - 1], r->t[i] - r->t[prev]);
+	    else
+		first = i;
+	    prev = i;
+	}
+	if (prev > first)
+	    lat_hist_add(&o->h[LAT_TOTAL], r->t[prev] - r->t[first]);
+    }
+    lat_reset(r);
+}
+
+/*
+ * lat_hist_percentile - the value below which a fraction q of h's
+ *     values lie
+ */
+unsigned long lat_hist_percentile(lat_hist_t *h, double q)
+{
+    unsigned long want = (unsigned long)(q * h->count + 0.999999), seen = 0;
+    int i;
+
+    if (h->count == 0)
+	return 0;
+    for (i = 0; i < LAT_NBUCKETS; i++)
+	if ((seen += h->b[i]) >= want)
+	    break;
+    return bucket_value(i) < h->max ? bucket_value(i) : h->max;
+}
+
+/*
+ * lat_hist_correct - add to h the values in from and, for each value v
+ *     longer than interval ns, the values v - interval, v - 2*interval,
+ *     and so on down to interval. Those are the latencies of the
+ *     requests a load generator expecting to send one per interval
+ *     would have sent while it waited for v instead (coordinated
+ *     omission; HdrHistogram's copyCorrectedForCoordinatedOmission).
+ */
+void lat_hist_correct(lat_hist_t *h, lat_hist_t *from, unsigned long interval)
+{
+    unsigned long v, w, n;
+    int i;
+
+    for (i = 0; i < LAT_NBUCKETS; i++) {
+	if ((n = from->b[i]) == 0)
+	    continue;
+	v = bucket_value(i) < from->max ? bucket_value(i) : from->max;
+	h->b[i] += n;
+	h->count += n;
+	for (w = v; interval > 0 && w >= 2 * interval; ) {
+	    w -= interval;
+	    h->b[bucket(w)] += n;
+	    h->count += n;
+	}
+    }
+    if (from->max > h->max)
+	h->max = from->max;
+}
+
+/*
+ * append - printf onto the end of the n bytes already in buf, as far
+ *     as it fits, and return the new length
+ */
+static size_t append(char *buf, size_t size, size_t n, char *fmt, ...)
+{
+    va_list ap;
+    int rc;
+
+    if (n + 1 >= size)
+	return n;
+    va_start(ap, fmt);
+    rc = vsnprintf(buf + n, size - n, fmt, ap);
+    va_end(ap);
+    if (rc < 0)
+	return n;
+    return (size_t)rc < size - n ? n + rc : size - 1;
+}
+
+/*
+ * lat_render - write every thread's histograms, added up, into buf
+ *     (size bytes, NUL-terminated) as text, or as JSON if json, and
+ *     return the length. Times are in microseconds.
+ */
+size_t lat_render(char *buf, size_t size, int json)
+{
+    lat_outcome_t *all = Calloc(LAT_NOUTCOMES, sizeof(lat_outcome_t)), *o, *t;
+    lat_thread_t *th;
+    lat_hist_t *h;
+    size_t n = 0;
+    int i, j, k;
+
+    for (th = __atomic_load_n(&threads, __ATOMIC_ACQUIRE); th; th = th->next)
+	for (i = 0; i < LAT_NOUTCOMES; i++) {
+	    o = &all[i];
+	    t = &th->o[i];
+	    o->requests += peek(&t->requests);
+	    o->in += peek(&t->in);
+	    o->out += peek(&t->out);
+	    for (j = 0; j < LAT_NPHASES; j++) {
+		o->h[j].count += peek(&t->h[j].count);
+		if (peek(&t->h[j].max) > o->h[j].max)
+		    o->h[j].max = peek(&t->h[j].max);
+		for (k = 0; k < LAT_NBUCKETS; k++)
+		    o->h[j].b[k] += peek(&t->h[j].b[k]);
+	    }
+	}
+
+    if (json)
+	n = append(buf, size, n, "{");
+    for (i = 0; i < LAT_NOUTCOMES; i++) {
+	o = &all[i];
+	if (json)
+	    n = append(buf, size, n, "%s\"%s\": {\"requests\": %lu, "
+		       "\"bytes_in\": %lu, \"bytes_out\": %lu", i ? ", " : "",
+		       outcome_names[i], o->requests, o->in, o->out);
+	else
+	    n = append(buf, size, n, "%s: %lu requests, %lu bytes in, "
+		       "%lu bytes out\n  %-8s %10s %10s %10s %10s %10s\n",
+		       outcome_names[i], o->requests, o->in, o->out, "phase",
+		       "count", "p50 us", "p99 us", "p999 us", "max us");
+	for (j = 0; j < LAT_NPHASES; j++) {
+	    h = &o->h[j];
+	    n = append(buf, size, n, json ? ", \"%s\": {\"count\": %lu, "
+		       "\"p50_us\": %.1f, \"p99_us\": %.1f, \"p999_us\": %.1f, "
+		       "\"max_us\": %.1f}" :
+		       "  %-8s %10lu %10.1f %10.1f %10.1f %10.1f\n",
+		       phase_names[j], h->count,
+		       lat_hist_percentile(h, 0.5) / 1e3,
+		       lat_hist_percentile(h, 0.99) / 1e3,
+		       lat_hist_percentile(h, 0.999) / 1e3, h->max / 1e3);
+	}
+	if (json)
+	    n = append(buf, size, n, "}");
+    }
+    if (json)
+	n = append(buf, size, n, "}\n");
+    Free(all);
+    return n;
+}
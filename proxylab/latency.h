@@ -0,0 +1,75 @@
+/*
+ * latency.h - Per-request latency histograms for Tiny (GET /__stats).
+ *
+ * Each request carries a lat_req_t, stamped with the monotonic clock
+ * as it passes the points below. When it is finished, lat_record adds
+ * the time between each stamp and the one before it (a phase) to a
+ * histogram for that phase and the request's outcome. Stamps a request
+ * never reached are skipped: an error sent before the file was looked
+ * up has no stat phase, and its head phase runs from the parse.
+ *
+ * The histograms are HDR-style: exact below LAT_SUB ns, then
+ * LAT_SUB buckets to each power of two, so every value is kept to
+ * within 1/LAT_SUB (about 6%) up to 2^LAT_MAXBITS ns. Each thread
+ * records into histograms of its own without locks or atomic
+ * read-modify-writes; lat_render adds up every thread's histograms
+ * and reports the count, p50, p99, p99.9 and maximum of each phase,
+ * with the bytes read and sent for each outcome, as text or JSON.
+ */
+#ifndef __LATENCY_H__
+#define __LATENCY_H__
+
+#include "csapp.h"
+
+#define LAT_URI "/__stats"       /* Reserved URI; "?json" for JSON */
+
+/* Stamps, in the order a request passes them */
+#define LAT_ACCEPT  0   /* Connection accepted (its first request only) */
+#define LAT_FIRST   1   /* First bytes of the request head buffered */
+#define LAT_PARSED  2   /* Request head parsed */
+#define LAT_ROUTED  3   /* Mapped onto a file, and the file stat'd */
+#define LAT_HEAD    4   /* Response head written */
+#define LAT_BODY    5   /* Response body written */
+#define LAT_NSTAMPS 6
+
+/* Phases: phase i ends at stamp i + 1; LAT_TOTAL is first to last */
+#define LAT_TOTAL   (LAT_NSTAMPS - 1)
+#define LAT_NPHASES LAT_NSTAMPS
+
+/* Outcomes */
+#define LAT_NONE    -1  /* Not recorded (requests for LAT_URI) */
+#define LAT_STATIC  0
+#define LAT_DYNAMIC 1
+#define LAT_ERROR   2
+#define LAT_NOUTCOMES 3
+
+/* Histogram buckets */
+#define LAT_SUBBITS 4
+#define LAT_SUB     (1 << LAT_SUBBITS)
+#define LAT_MAXBITS 40          /* 2^40 ns is about 18 minutes */
+#define LAT_NBUCKETS ((LAT_MAXBITS - LAT_SUBBITS + 1) * LAT_SUB)
+
+typedef struct {
+    unsigned long count;
+    unsigned long max;         /* ns */
+    unsigned long b[LAT_NBUCKETS];
+} lat_hist_t;
+
+typedef struct {
+    long t[LAT_NSTAMPS];       /* ns (CLOCK_MONOTONIC), or 0 if not reached */
+    int outcome;               /* LAT_STATIC ... LAT_ERROR, or LAT_NONE */
+    size_t in;                 /* Bytes of request head */
+    size_t out;                /* Bytes of response sent */
+} lat_req_t;
+
+void lat_reset(lat_req_t *r);
+void lat_mark(lat_req_t *r, int stamp);
+void lat_record(lat_req_t *r);
+size_t lat_render(char *buf, size_t size, int json);
+
+/* The histograms themselves, for other programs (loadgen.c) */
+void lat_hist_add(lat_hist_t *h, unsigned long v);
+unsigned long lat_hist_percentile(lat_hist_t *h, double q);
+void lat_hist_correct(lat_hist_t *h, lat_hist_t *from, unsigned long interval);
+
+#endif /* __LATENCY_H__ */
@@ -0,0 +1,475 @@
+/*
+ * loadgen.c - An HTTP load generator for Tiny and the proxy.
+ *
+ *     usage: loadgen [-c conns] [-d secs] [-r rate] [-k] host port uri...
+ *
+ * Drives conns connections (default 10) to host:port for secs seconds
+ * (default 10) from one thread with epoll, asking for each uri in turn
+ * with "GET uri HTTP/1.1" (so for the proxy a uri is a whole URL).
+ * Connections are opened with open_clientfd, and responses are read
+ * with rio_fill and parsed in place in each connection's Rio buffer.
+ * With -k a connection is kept alive for as long as the server allows;
+ * without it, every request asks for "Connection: close" and gets a
+ * connection of its own.
+ *
+ * Without -r the test is closed-loop: a connection sends its next
+ * request as soon as it has read the last response. A server that
+ * stalls then stalls the load too, and the requests that would have
+ * seen the stall are never sent (coordinated omission), so besides the
+ * latencies it measured loadgen reports them corrected as HdrHistogram
+ * does, taking the median as the interval each connection meant to
+ * send at.
+ *
+ * With -r the test is open-loop: requests fall due at rate per second
+ * whether or not the responses keep up, each goes out on the first idle
+ * connection, and its latency is measured from when it was due rather
+ * than when it was sent, so time spent waiting for a connection counts.
+ * The service time, from sending to the end of the response, is
+ * reported too, as is the number of requests still waiting when the
+ * test ended.
+ */
+#include "csapp.h"
+#include "latency.h"
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+#define CONNBUF   (1 << 16)  /* Rio buffer per connection */
+#define MAXEVENTS 256
+#define DRAINSECS 2          /* Wait for responses still due at the end */
+
+/* Connection states */
+#define C_IDLE 0    /* No request outstanding (the socket may be closed) */
+#define C_SEND 1    /* Writing the request */
+#define C_HEAD 2    /* Reading the response head */
+#define C_BODY 3    /* Reading the response body */
+
+typedef struct {
+    int fd;                    /* -1 while closed */
+    int state;
+    char *req;                 /* Request being sent, and how far */
+    size_t reqlen, sent;
+    long due;                  /* ns: when the request was due, */
+    long sent_at;              /* and when it went out */
+    int status;                /* Of the response */
+    long left;                 /* Body bytes still to read; -1: up to EOF */
+    int close;                 /* Close once the response is read */
+    rio_t rio;
+    char buf[CONNBUF];
+} conn_t;
+
+static char *host, *port;
+static int epfd, timerfd, keepalive = 0, running = 1;
+static double rate = 0;        /* Requests/s open-loop; 0 for closed-loop */
+static char **reqs;            /* A request for each uri */
+static size_t *reqlens;
+static int nreqs, nextreq;
+static conn_t **idle;          /* Stack of idle connections */
+static int nidle, inflight;
+static long start, end;       /* ns */
+static long issued;            /* Open-loop: requests due at start + i/rate */
+static unsigned long ndone, nbad, nconnerr, nioerr, bytes;
+static lat_hist_t measured, service;
+
+static long now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+/*
+ * due_at - when open-loop request i falls due
+ */
+static long due_at(long i)
+{
+    return start + (long)(i * 1e9 / rate);
+}
+
+/*
+ * conn_open - connect c, nonblocking, and watch it (edge-triggered)
+ */
+static int conn_open(conn_t *c)
+{
+    struct epoll_event ev;
+
+    if ((c->fd = open_clientfd(host, port)) < 0) {
+	c->fd = -1;
+	return -1;
+    }
+    fcntl(c->fd, F_SETFL, fcntl(c->fd, F_GETFL) | O_NONBLOCK);
+    rio_readinitb_buf(&c->rio, c->fd, c->buf, CONNBUF);
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.ptr = c;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, c->fd, &ev) < 0)
+	unix_error("epoll_ctl error");
+    return 0;
+}
+
+static void conn_close(conn_t *c)
+{
+    if (c->fd >= 0)
+	close(c->fd);
+    c->fd = -1;
+}
+
+static void dispatch(void);
+static void conn_send(conn_t *c);
+
+/*
+ * conn_start - send the next request on c, which was due at due.
+ *     Returns -1 if c couldn't connect.
+ */
+static int conn_start(conn_t *c, long due)
+{
+    if (c->fd < 0 && conn_open(c) < 0) {
+	nconnerr++;
+	return -1;
+    }
+    c->req = reqs[nextreq];
+    c->reqlen = reqlens[nextreq];
+    nextreq = (nextreq + 1) % nreqs;
+    c->sent = 0;
+    c->due = due;
+    c->sent_at = now_ns();
+    c->state = C_SEND;
+    inflight++;
+    conn_send(c);
+    return 0;
+}
+
+/*
+ * conn_end - c is done with its request, one way or another: close it
+ *     if need be, and put it to work again
+ */
+static void conn_end(conn_t *c)
+{
+    c->state = C_IDLE;
+    inflight--;
+    if (c->close || !keepalive)
+	conn_close(c);
+    idle[nidle++] = c;
+    dispatch();
+}
+
+/*
+ * conn_fail - c's request got no (complete) response
+ */
+static void conn_fail(conn_t *c)
+{
+    nioerr++;
+    c->close = 1;
+    conn_end(c);
+}
+
+/*
+ * conn_finish - c has read a whole response
+ */
+static void conn_finish(conn_t *c)
+{
+    long t = now_ns();
+
+    lat_hist_add(&measured, t - c->due);
+    lat_hist_add(&service, t - c->sent_at);
+    ndone++;
+    if (c->status < 200 || c->status > 299)
+	nbad++;
+    conn_end(c);
+}
+
+/*
+ * head_length - length of the complete response head at the start of
+ *     c's buffer, or 0 if it hasn't all arrived
+ */
+static size_t head_length(conn_t *c)
+{
+    char *p = c->rio.rio_bufptr;
+    int i;
+
+    for (i = 3; i < c->rio.rio_cnt; i++)
+	if (p[i] == '\n' && p[i - 1] == '\r' && p[i - 2] == '\n' &&
+	    p[i - 3] == '\r')
+	    return i + 1;
+    return 0;
+}
+
+/*
+ * parse_head - pick the status, body length and keep-alive out of the
+ *     len-byte response head at the start of c's buffer. Returns the
+ *     status, or -1 if the head is malformed.
+ */
+static int parse_head(conn_t *c, size_t len)
+{
+    char head[MAXBUF], *line, *value;
+    int status, http10;
+
+    if (len >= MAXBUF || strncmp(c->rio.rio_bufptr, "HTTP/1.", 7))
+	return -1;
+    memcpy(head, c->rio.rio_bufptr, len);
+    head[len] = '\0';
+    http10 = head[7] == '0';
+    status = atoi(head + 8);
+    c->left = (status >= 100 && status < 200) || status == 204 ||
+	status == 304 ? 0 : -1;
+    c->close = http10;
+    for (line = strstr(head, "\r\n") + 2; *line != '\r';
+	 line = strstr(line, "\r\n") + 2) {
+	if ((value = strchr(line, ':')) == NULL)
+	    continue;
+	for (value++; *value == ' ' || *value == '\t'; value++)
+	    ;
+	if (!strncasecmp(line, "Content-length:", 15))
+	    c->left = atol(value);
+	else if (!strncasecmp(line, "Connection:", 11))
+	    c->close = strncasecmp(value, "keep-alive", 10) != 0;
+    }
+    if (c->left < 0)
+	c->close = 1;           /* The body ends when the server closes */
+    return status;
+}
+
+/*
+ * conn_recv - read as much of c's response as has arrived
+ */
+static void conn_recv(conn_t *c)
+{
+    size_t len;
+    ssize_t n;
+
+    while (1) {
+	if (c->state == C_IDLE)
+	    rio_consume(&c->rio, c->rio.rio_cnt);
+	else if (c->state == C_HEAD && (len = head_length(c)) > 0) {
+	    if ((c->status = parse_head(c, len)) < 0) {
+		conn_fail(c);
+		return;
+	    }
+	    rio_consume(&c->rio, len);
+	    bytes += len;
+	    c->state = C_BODY;
+	}
+	if (c->state == C_BODY) {
+	    n = c->rio.rio_cnt;
+	    if (c->left >= 0 && c->left < n)
+		n = c->left;
+	    rio_consume(&c->rio, n);
+	    bytes += n;
+	    if (c->left >= 0 && (c->left -= n) == 0) {
+		conn_finish(c);
+		return;
+	    }
+	}
+
+	if ((n = rio_fill(&c->rio)) > 0)
+	    continue;
+	if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+	    return;
+	if (c->state == C_IDLE)         /* The server closed an idle one */
+	    conn_close(c);
+	else if (n == 0 && c->state == C_BODY && c->left < 0)
+	    conn_finish(c);
+	else
+	    conn_fail(c);
+	return;
+    }
+}
+
+/*
+ * conn_send - write as much of c's request as the socket will take
+ */
+static void conn_send(conn_t *c)
+{
+    ssize_t n;
+
+    while (c->sent < c->reqlen) {
+	if ((n = write(c->fd, c->req + c->sent, c->reqlen - c->sent)) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    if (errno != EAGAIN && errno != EWOULDBLOCK)
+		conn_fail(c);
+	    return;
+	}
+	c->sent += n;
+    }
+    c->state = C_HEAD;
+    conn_recv(c);               /* The edge may have passed already */
+}
+
+/*
+ * dispatch - put idle connections to work: all of them in a closed
+ *     loop, or as many as there are requests due in an open one, and
+ *     set the timer for the next request due. Connections that go idle
+ *     meanwhile wait for the next call: in an open loop the timer is
+ *     already due, and a closed loop calls again after every epoll_wait.
+ */
+static void dispatch(void)
+{
+    static int busy;            /* Already dispatching, further up */
+    struct itimerspec its;
+    conn_t *c;
+    long t;
+    int n;
+
+    if (busy)
+	return;
+    busy = 1;
+    for (n = nidle; running && n > 0 && nidle > 0; n--) {
+	t = rate > 0 ? due_at(issued) : now_ns();
+	if (t > now_ns() || t >= end)
+	    break;
+	c = idle[--nidle];
+	if (conn_start(c, t) < 0)
+	    idle[nidle++] = c;
+	if (rate > 0)
+	    issued++;           /* Even if lost to a connect error */
+    }
+    if (rate > 0 && running && due_at(issued) < end) {
+	memset(&its, 0, sizeof(its));
+	t = due_at(issued);
+	its.it_value.tv_sec = t / 1000000000L;
+	its.it_value.tv_nsec = t % 1000000000L;
+	timerfd_settime(timerfd, TFD_TIMER_ABSTIME, &its, NULL);
+    }
+    busy = 0;
+}
+
+/*
+ * report - print the percentiles of h in microseconds
+ */
+static void report(char *name, lat_hist_t *h)
+{
+    printf("  %-12s %10.1f %10.1f %10.1f %10.1f %10.1f\n", name,
+	   lat_hist_percentile(h, 0.5) / 1e3, lat_hist_percentile(h, 0.9) / 1e3,
+	   lat_hist_percentile(h, 0.99) / 1e3,
+	   lat_hist_percentile(h, 0.999) / 1e3, h->max / 1e3);
+}
+
+static void usage(char *prog)
+{
+    fprintf(stderr, "usage: %s [-c conns] [-d secs] [-r rate] [-k] "
+	    "host port uri...\n", prog);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    int c, i, n, nconns = 10;
+    double secs = 10;
+    long t, unsent = 0;
+    unsigned long interval;
+    char buf[MAXLINE];
+    conn_t *conns, *cp;
+    struct epoll_event ev, events[MAXEVENTS];
+    lat_hist_t corrected;
+    uint64_t expirations;
+
+    while ((c = getopt(argc, argv, "c:d:r:k")) != -1) {
+	switch (c) {
+	case 'c':
+	    nconns = atoi(optarg);
+	    break;
+	case 'd':
+	    secs = atof(optarg);
+	    break;
+	case 'r':
+	    rate = atof(optarg);
+	    break;
+	case 'k':
+	    keepalive = 1;
+	    break;
+	default:
+	    usage(argv[0]);
+	}
+    }
+    if (argc - optind < 3 || nconns < 1 || secs <= 0 || rate < 0)
+	usage(argv[0]);
+    host = argv[optind];
+    port = argv[optind + 1];
+    Signal(SIGPIPE, SIG_IGN);
+
+    nreqs = argc - optind - 2;
+    reqs = Malloc(nreqs * sizeof(char *));
+    reqlens = Malloc(nreqs * sizeof(size_t));
+    for (i = 0; i < nreqs; i++) {
+	n = snprintf(buf, MAXLINE, "GET %s HTTP/1.1\r\nHost: %s:%s\r\n%s\r\n",
+		     argv[optind + 2 + i], host, port,
+		     keepalive ? "" : "Connection: close\r\n");
+	if (n >= MAXLINE)
+	    app_error("uri too long");
+	reqs[i] = Malloc(n);
+	memcpy(reqs[i], buf, n);
+	reqlens[i] = n;
+    }
+
+    if ((epfd = epoll_create1(0)) < 0)
+	unix_error("epoll_create1 error");
+    if ((timerfd = timerfd_create(CLOCK_MONOTONIC, 0)) < 0)
+	unix_error("timerfd_create error");
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, timerfd, &ev) < 0)
+	unix_error("epoll_ctl error");
+
+    conns = Calloc(nconns, sizeof(conn_t));
+    idle = Malloc(nconns * sizeof(conn_t *));
+    for (i = nconns - 1; i >= 0; i--) {
+	conns[i].fd = -1;
+	idle[nidle++] = &conns[i];
+    }
+
+    start = now_ns();
+    end = start + (long)(secs * 1e9);
+    dispatch();
+    while (1) {
+	t = now_ns();
+	if (running && t >= end) {
+	    running = 0;
+	    if (rate > 0)
+		unsent = (long)(secs * rate + 0.999999) - issued;
+	}
+	if (!running && (inflight == 0 || t >= end + DRAINSECS * 1000000000L))
+	    break;
+
+	/* A closed loop retries connections that couldn't connect */
+	n = epoll_wait(epfd, events, MAXEVENTS,
+		       rate == 0 && nidle > 0 ? 10 : 100);
+	for (i = 0; i < n; i++) {
+	    cp = events[i].data.ptr;
+	    if (cp == NULL) {
+		Read(timerfd, &expirations, sizeof(expirations));
+		dispatch();
+	    }
+	    else if (cp->fd < 0)
+		continue;       /* Closed earlier in this batch */
+	    else if (cp->state == C_SEND)
+		conn_send(cp);
+	    else
+		conn_recv(cp);
+	}
+	if (rate == 0 && nidle > 0)
+	    dispatch();
+    }
+
+    printf("%lu requests in %.1f s: %.0f requests/s, %.1f MB/s read\n",
+	   ndone, secs, ndone / secs, bytes / secs / (1 << 20));
+    printf("%lu not 2xx, %lu connect errors, %lu read/write errors, "
+	   "%d unanswered", nbad, nconnerr, nioerr, inflight);
+    if (rate > 0)
+	printf(", %ld never sent (%.0f requests/s asked for)", unsent, rate);
+    printf("\n%-14s %10s %10s %10s %10s %10s\n", "latency (us)", "p50", "p90",
+	   "p99", "p99.9", "max");
+    if (rate > 0) {
+	report("from due", &measured);
+	report("service", &service);
+    }
+    else {
+	interval = lat_hist_percentile(&measured, 0.5);
+	memset(&corrected, 0, sizeof(corrected));
+	lat_hist_correct(&corrected, &measured, interval);
+	report("measured", &measured);
+	report("corrected", &corrected);
+	printf("(corrected for an interval of %.1f us per connection)\n",
+	       interval / 1e3);
+    }
+    exit(0);
+}
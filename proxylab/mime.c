@@ -0,0 +1,134 @@
+/*
+ * mime.c - Media types by file name extension. See mime.h.
+ */
+#include "csapp.h"
+#include "mime.h"
+#include "mimetab.h"
+
+typedef struct {
+    char *ext;                 /* NULL if the slot is empty */
+    char *type;
+} extra_t;
+
+static extra_t *extra;         /* Types from mime_load, or NULL */
+static size_t extramask;       /* Slots in extra, less one */
+static size_t nextra;
+
+/* hash - FNV-1a hash of an extension (the same as mimegen's) */
+static unsigned long hash(const char *key)
+{
+    unsigned long h = 14695981039346656037UL;
+
+    while (*key) {
+	h ^= (unsigned char)*key++;
+	h *= 1099511628211UL;
+    }
+    return h;
+}
+
+/* mix - the splitmix64 finalizer (the same as mimegen's) */
+static unsigned long mix(unsigned long h)
+{
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9UL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebUL;
+    return h ^ (h >> 31);
+}
+
+/*
+ * extra_slot - the slot of extra that holds ext, or the empty one
+ *     where it would go
+ */
+static extra_t *extra_slot(char *ext, unsigned long h)
+{
+    size_t i;
+
+    for (i = h & extramask; extra[i].ext; i = (i + 1) & extramask)
+	if (!strcmp(extra[i].ext, ext))
+	    break;
+    return &extra[i];
+}
+
+/*
+ * extra_add - map ext onto type in extra, growing it to keep it at
+ *     most half full
+ */
+static void extra_add(char *ext, char *type)
+{
+    extra_t *old = extra, *e;
+    size_t i, oldslots = extra ? extramask + 1 : 0;
+
+    if (2 * (nextra + 1) > oldslots) {
+	extramask = (oldslots ? 2 * oldslots : 64) - 1;
+	extra = Calloc(extramask + 1, sizeof(extra_t));
+	for (i = 0; i < oldslots; i++)
+	    if (old[i].ext)
+		*extra_slot(old[i].ext, hash(old[i].ext)) = old[i];
+	Free(old);
+    }
+    e = extra_slot(ext, hash(ext));
+    if (!e->ext) {
+	e->ext = strdup(ext);
+	nextra++;
+    }
+    e->type = type;
+}
+
+/*
+ * mime_load - add the types in the mime.types-style file path to those
+ *     built in, overriding them where both have an extension. Returns
+ *     0, or -1 with errno set if path can't be read. Call it before
+ *     the server starts serving.
+ */
+int mime_load(char *path)
+{
+    FILE *fp;
+    char line[MAXLINE], *p, *type, *ext;
+
+    if (!(fp = fopen(path, "r")))
+	return -1;
+    while (fgets(line, sizeof(line), fp)) {
+	if ((p = strchr(line, '#')))
+	    *p = '\0';
+	if (!(type = strtok(line, " \t\r\n")))
+	    continue;
+	type = strdup(type);
+	while ((ext = strtok(NULL, " \t\r\n"))) {
+	    for (p = ext; *p; p++)
+		*p = tolower((unsigned char)*p);
+	    if (p - ext < MIME_MAXEXT)
+		extra_add(ext, type);
+	}
+    }
+    fclose(fp);
+    return 0;
+}
+
+/*
+ * mime_type - the media type of filename, by the extension of its last
+ *     path component (case-insensitively), or MIME_DEFAULT
+ */
+char *mime_type(char *filename)
+{
+    char ext[MIME_MAXEXT], *dot, *p;
+    unsigned long h;
+    size_t n;
+    extra_t *e;
+    int s;
+
+    if (!(dot = strrchr(filename, '.')) || strchr(dot, '/') ||
+	(n = strlen(++dot)) == 0 || n >= MIME_MAXEXT)
+	return MIME_DEFAULT;
+    for (p = ext; *dot; )
+	*p++ = tolower((unsigned char)*dot++);
+    *p = '\0';
+
+    h = hash(ext);
+    if (extra && (e = extra_slot(ext, h))->ext)
+	return e->type;
+    s = mix(h + mime_disp[h % MIME_NBUCKETS]) % MIME_NSLOTS;
+    if (mime_slots[s].ext && !strcmp(mime_slots[s].ext, ext))
+	return mime_slots[s].type;
+    return MIME_DEFAULT;
+}
@@ -0,0 +1,25 @@
+/*
+ * mime.h - Media types by file name extension, for Tiny's Content-type.
+ *
+ * The types tiny knows from the start are in mime.types. mimegen
+ * (mimegen.c) turns that file into mimetab.h, a perfect hash table:
+ * each extension's FNV-1a hash picks a bucket, and the bucket's
+ * displacement, chosen by mimegen so no two extensions collide, picks
+ * the extension's slot. Looking a type up is one hash, one mix and one
+ * string compare, however many types there are.
+ *
+ * mime_load adds the types in another file of the same form at
+ * startup, in an open-addressed table that is looked in first, so they
+ * can override the built-in ones. Both tables are read-only once the
+ * server is running, and need no lock.
+ */
+#ifndef __MIME_H__
+#define __MIME_H__
+
+#define MIME_DEFAULT "text/plain"  /* Type of a file we can't tell */
+#define MIME_MAXEXT  32            /* Longer extensions are never known */
+
+int mime_load(char *path);
+char *mime_type(char *filename);
+
+#endif /* __MIME_H__ */
@@ -0,0 +1,203 @@
+/*
+ * mimegen.c - Build Tiny's table of media types (mimetab.h) from a
+ *     mime.types file.
+ *
+ *     usage: mimegen [mime.types] > mimetab.h
+ *
+ * Reads lines of a media type followed by its extensions (from stdin
+ * if no file is given) and writes a C header holding a perfect hash
+ * table of the extensions, for mime.c. Each extension's FNV-1a hash h
+ * picks one of MIME_NBUCKETS buckets, h % MIME_NBUCKETS; the extension
+ * then sits in slot mix(h + d) % MIME_NSLOTS, where d is its bucket's
+ * displacement. The buckets are placed biggest first, each with the
+ * smallest d that lands all of its extensions in empty slots, so that
+ * no two extensions ever share a slot, and a lookup needs just one
+ * probe. The table is kept about 80% full, which lets the search for
+ * each d finish quickly.
+ *
+ * Extensions are lowercased, and an extension listed twice gets the
+ * type from its last line, as mime_load does at run time.
+ */
+#include "csapp.h"
+#include "mime.h"
+
+#define MAXDISP 65535          /* Displacements are unsigned shorts */
+
+typedef struct {
+    char *ext;
+    char *type;
+    unsigned long hash;
+} entry_t;
+
+typedef struct {
+    int index;                 /* Bucket number */
+    int n;                     /* Entries in it */
+    int *entries;
+} bucket_t;
+
+static entry_t *entries;
+static int nentries, entrycap;
+
+/* hash - FNV-1a hash of an extension (the same as mime.c's) */
+static unsigned long hash(const char *key)
+{
+    unsigned long h = 14695981039346656037UL;
+
+    while (*key) {
+	h ^= (unsigned char)*key++;
+	h *= 1099511628211UL;
+    }
+    return h;
+}
+
+/* mix - the splitmix64 finalizer (the same as mime.c's) */
+static unsigned long mix(unsigned long h)
+{
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9UL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebUL;
+    return h ^ (h >> 31);
+}
+
+/*
+ * add - map ext onto type, replacing whatever ext was mapped onto
+ */
+static void add(char *ext, char *type, char *filename, int lineno)
+{
+    char *p;
+    int i;
+
+    for (p = ext; *p; p++)
+	*p = tolower((unsigned char)*p);
+    if (strlen(ext) >= MIME_MAXEXT || strchr(ext, '.')) {
+	fprintf(stderr, "%s:%d: bad extension %s\n", filename, lineno, ext);
+	exit(1);
+    }
+    for (i = 0; i < nentries; i++)
+	if (!strcmp(entries[i].ext, ext))
+	    break;
+    if (i == nentries) {
+	if (nentries == entrycap) {
+	    entrycap = entrycap ? 2 * entrycap : 256;
+	    entries = Realloc(entries, entrycap * sizeof(entry_t));
+	}
+	entries[nentries].ext = strdup(ext);
+	entries[nentries].hash = hash(ext);
+	nentries++;
+    }
+    entries[i].type = type;
+}
+
+/*
+ * read_types - add the types in fp (called filename in messages)
+ */
+static void read_types(FILE *fp, char *filename)
+{
+    char line[MAXLINE], *p, *type, *ext;
+    int lineno = 0;
+
+    while (fgets(line, sizeof(line), fp)) {
+	lineno++;
+	if ((p = strchr(line, '#')))
+	    *p = '\0';
+	if (!(type = strtok(line, " \t\r\n")))
+	    continue;
+	if (!strchr(type, '/') || strpbrk(type, "\"\\")) {
+	    fprintf(stderr, "%s:%d: bad type %s\n", filename, lineno, type);
+	    exit(1);
+	}
+	type = strdup(type);
+	while ((ext = strtok(NULL, " \t\r\n")))
+	    add(ext, type, filename, lineno);
+    }
+}
+
+/* bigger - qsort order of buckets: most entries first, then by number */
+static int bigger(const void *a, const void *b)
+{
+    const bucket_t *x = a, *y = b;
+
+    if (x->n != y->n)
+	return y->n - x->n;
+    return x->index - y->index;
+}
+
+int main(int argc, char **argv)
+{
+    FILE *fp = stdin;
+    char *filename = "<stdin>";
+    int nbuckets, nslots, *slot, *disp, i, j, k, d;
+    bucket_t *buckets, *b;
+    unsigned long s;
+
+    if (argc > 2) {
+	fprintf(stderr, "usage: %s [mime.types] > mimetab.h\n", argv[0]);
+	exit(1);
+    }
+    if (argc == 2 && !(fp = fopen(filename = argv[1], "r")))
+	unix_error(filename);
+    read_types(fp, filename);
+    if (nentries == 0) {
+	fprintf(stderr, "%s: no extensions\n", filename);
+	exit(1);
+    }
+
+    nbuckets = nentries / 4 + 1;
+    nslots = nentries + nentries / 4 + 1;
+    buckets = Calloc(nbuckets, sizeof(bucket_t));
+    for (i = 0; i < nbuckets; i++) {
+	buckets[i].index = i;
+	buckets[i].entries = Malloc(nentries * sizeof(int));
+    }
+    for (i = 0; i < nentries; i++) {
+	b = &buckets[entries[i].hash % nbuckets];
+	b->entries[b->n++] = i;
+    }
+    qsort(buckets, nbuckets, sizeof(bucket_t), bigger);
+
+    /* Place each bucket's entries with the first displacement that fits */
+    slot = Malloc(nslots * sizeof(int));
+    disp = Calloc(nbuckets, sizeof(int));
+    for (i = 0; i < nslots; i++)
+	slot[i] = -1;
+    for (b = buckets; b < buckets + nbuckets && b->n > 0; b++) {
+	for (d = 0; d <= MAXDISP; d++) {
+	    for (j = 0; j < b->n; j++) {
+		s = mix(entries[b->entries[j]].hash + d) % nslots;
+		if (slot[s] >= 0)
+		    break;
+		slot[s] = b->entries[j];
+	    }
+	    if (j == b->n)
+		break;
+	    for (k = 0; k < j; k++)    /* Take back what did fit */
+		slot[mix(entries[b->entries[k]].hash + d) % nslots] = -1;
+	}
+	if (d > MAXDISP) {
+	    fprintf(stderr, "%s: no perfect hash found\n", filename);
+	    exit(1);
+	}
+	disp[b->index] = d;
+    }
+
+    printf("/*\n * mimetab.h - Tiny's built-in media types: a perfect hash "
+	   "table of\n *     %d extensions. Generated by mimegen from %s; "
+	   "don't edit.\n */\n", nentries, filename);
+    printf("#define MIME_NBUCKETS %d\n#define MIME_NSLOTS   %d\n\n",
+	   nbuckets, nslots);
+    printf("static const unsigned short mime_disp[MIME_NBUCKETS] = {");
+    for (i = 0; i < nbuckets; i++)
+	printf("%s%d%s", i % 12 ? " " : "\n    ", disp[i],
+	       i < nbuckets - 1 ? "," : "\n");
+    printf("};\n\nstatic const struct {\n    char *ext;\n    char *type;\n"
+	   "} mime_slots[MIME_NSLOTS] = {\n");
+    for (i = 0; i < nslots; i++)
+	if (slot[i] < 0)
+	    printf("    { NULL, NULL },\n");
+	else
+	    printf("    { \"%s\", \"%s\" },\n", entries[slot[i]].ext,
+		   entries[slot[i]].type);
+    printf("};\n");
+    exit(0);
+}
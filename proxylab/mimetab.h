@@ -0,0 +1,787 @@
+/*
+ * mimetab.h - Tiny's built-in media types: a perfect hash table of
+ *     607 extensions. Generated by mimegen from mime.types; don't edit.
+ */
+#define MIME_NBUCKETS 152
+#define MIME_NSLOTS   759
+
+static const unsigned short mime_disp[MIME_NBUCKETS] = {
+    4, 1, 16, 3, 2, 7, 0, 7, 0, 0, 0, 4,
+    16, 47, 0, 0, 1, 5, 0, 0, 14, 24, 6, 0,
+    12, 0, 13, 22, 11, 2, 0, 15, 88, 28, 47, 1,
+    0, 0, 7, 60, 14, 4, 15, 7, 0, 14, 20, 1,
+    3, 4, 24, 29, 20, 0, 1, 3, 5, 7, 12, 21,
+    36, 8, 0, 3, 1, 5, 6, 5, 27, 64, 5, 0,
+    9, 0, 38, 22, 23, 21, 0, 4, 12, 10, 2, 5,
+    17, 5, 12, 0, 47, 7, 13, 3, 4, 21, 187, 12,
+    190, 35, 0, 0, 12, 28, 0, 27, 61, 62, 65, 0,
+    0, 2, 1, 2, 0, 0, 9, 1, 23, 0, 0, 0,
+    0, 0, 3, 41, 4, 8, 3, 1, 2, 2, 50, 27,
+    37, 6, 2, 1, 18, 56, 12, 5, 18, 0, 1, 13,
+    108, 17, 6, 42, 34, 2, 0, 1
+};
+
+static const struct {
+    char *ext;
+    char *type;
+} mime_slots[MIME_NSLOTS] = {
+    { "run", "application/x-makeself" },
+    { "xla", "application/vnd.ms-excel" },
+    { "xlc", "application/vnd.ms-excel" },
+    { NULL, NULL },
+    { "mpc", "audio/x-musepack" },
+    { "sd", "chemical/x-mdl-sdfile" },
+    { NULL, NULL },
+    { "sit", "application/x-stuffit" },
+    { NULL, NULL },
+    { "dcr", "application/x-director" },
+    { "tar", "application/x-tar" },
+    { "gsf", "application/x-font" },
+    { "h", "text/x-c" },
+    { "cab", "application/vnd.ms-cab-compressed" },
+    { "ktx", "image/ktx" },
+    { "bib", "text/x-bibtex" },
+    { "cmake", "text/x-cmake" },
+    { "rdf", "application/rdf+xml" },
+    { "cdr", "image/x-coreldraw" },
+    { "br", "application/x-brotli" },
+    { "xpm", "image/x-xpixmap" },
+    { "moc", "text/x-moc" },
+    { "rq", "application/sparql-query" },
+    { "usdz", "model/vnd.usdz+zip" },
+    { "tsv", "text/tab-separated-values" },
+    { "jfif", "image/jpeg" },
+    { "cpio", "application/x-cpio" },
+    { "odt", "application/vnd.oasis.opendocument.text" },
+    { "erl", "text/x-erlang" },
+    { NULL, NULL },
+    { "pmr", "application/x-perfmon" },
+    { "hdf5", "application/x-hdf5" },
+    { "dsf", "audio/x-dsf" },
+    { "dv", "video/x-dv" },
+    { "mpt", "application/vnd.ms-project" },
+    { NULL, NULL },
+    { "bat", "application/x-msdownload" },
+    { "js", "text/javascript" },
+    { "m4u", "video/vnd.mpegurl" },
+    { NULL, NULL },
+    { "wdb", "application/vnd.ms-works" },
+    { "xml", "text/xml" },
+    { "mp3", "audio/mpeg" },
+    { "flv", "video/x-flv" },
+    { "p7s", "application/pkcs7-signature" },
+    { NULL, NULL },
+    { NULL, NULL },
+    { "n3", "text/n3" },
+    { "info", "application/x-info" },
+    { "pl", "text/x-perl" },
+    { "heic", "image/heic" },
+    { "php4", "application/x-httpd-php" },
+    { NULL, NULL },
+    { "vsd", "application/vnd.visio" },
+    { "cls", "text/x-tex" },
+    { "cer", "application/pkix-cert" },
+    { "weba", "audio/webm" },
+    { "wm", "video/x-ms-wm" },
+    { "xspf", "application/xspf+xml" },
+    { "mo", "application/x-gettext-translation" },
+    { "z", "application/x-compress" },
+    { "kmz", "application/vnd.google-earth.kmz" },
+    { "text", "text/plain" },
+    { "ppsx", "application/vnd.openxmlformats-officedocument.presentationml.slideshow" },
+    { "dta", "application/x-stata-dta" },
+    { "uris", "text/uri-list" },
+    { "pages", "application/vnd.apple.pages" },
+    { "odg", "application/vnd.oasis.opendocument.graphics" },
+    { "hpp", "text/x-c" },
+    { "tex", "text/x-tex" },
+    { "mht", "multipart/related" },
+    { "mts", "video/mp2t" },
+    { "doc", "application/msword" },
+    { "nfo", "text/x-nfo" },
+    { "graphql", "application/graphql" },
+    { "list", "text/plain" },
+    { NULL, NULL },
+    { "rs", "text/x-rust" },
+    { "yaml", "text/yaml" },
+    { NULL, NULL },
+    { NULL, NULL },
+    { NULL, NULL },
+    { NULL, NULL },
+    { "mpga", "audio/mpeg" },
+    { "msh", "model/mesh" },
+    { "ustar", "application/x-ustar" },
+    { "hbs", "text/x-handlebars-template" },
+    { "h264", "video/h264" },
+    { NULL, NULL },
+    { "jpx", "image/jpx" },
+    { "parquet", "application/x-parquet" },
+    { NULL, NULL },
+    { NULL, NULL },
+    { "mli", "text/x-ocaml" },
+    { "scm", "text/x-scheme" },
+    { "fb2", "application/x-fictionbook+xml" },
+    { "ex", "text/x-elixir" },
+    { "pgm", "image/x-portable-graymap" },
+    { "xcf", "image/x-xcf" },
+    { "mtl", "model/mtl" },
+    { "vcs", "text/x-vcalendar" },
+    { "txt", "text/plain" },
+    { "p", "text/x-pascal" },
+    { "vtt", "text/vtt" },
+    { "woff2", "font/woff2" },
+    { "prc", "application/x-mobipocket-ebook" },
+    { "sid", "audio/x-sid" },
+    { "f", "text/x-fortran" },
+    { NULL, NULL },
+    { NULL, NULL },
+    { NULL, NULL },
+    { "abw", "application/x-abiword" },
+    { "mpkg", "application/vnd.apple.installer+xml" },
+    { "pma", "application/x-perfmon" },
+    { "mime", "message/rfc822" },
+    { "dic", "text/x-c" },
+    { "mesh", "model/mesh" },
+    { NULL, NULL },
+    { "ogg", "audio/ogg" },
+    { "mxf", "application/mxf" },
+    { "mid", "audio/midi" },
+    { "aifc", "audio/x-aiff" },
+    { "svg", "image/svg+xml" },
+    { "img", "application/x-raw-disk-image" },
+    { "mk", "text/x-makefile" },
+    { NULL, NULL },
+    { "zig", "text/x-zig" },
+    { "epsf", "application/postscript" },
+    { "xlw", "application/vnd.ms-excel" },
+    { NULL, NULL },
+    { "json5", "application/json5" },
+    { "dng", "image/x-adobe-dng" },
+    { "vss", "application/vnd.visio" },
+    { NULL, NULL },
+    { NULL, NULL },
+    { "webmanifest", "application/manifest+json" },
+    { "h265", "video/h265" },
+    { "gmo", "application/x-gettext-translation" },
+    { "kwt", "application/x-kword" },
+    { "nq", "application/n-quads" },
+    { "lnk", "application/x-ms-shortcut" },
+    { "shn", "audio/x-shorten" },
+    { "der", "application/x-x509-ca-cert" },
+    { "pas", "text/x-pascal" },
+    { "aif", "audio/x-aiff" },
+    { "org", "text/x-org" },
+    { "md", "text/markdown" },
+    { "h5", "application/x-hdf5" },
+    { NULL, NULL },
+    { "ief", "image/ief" },
+    { NULL, NULL },
+    { "sea", "application/x-sea" },
+    { "ttf", "font/ttf" },
+    { "zip", "application/zip" },
+    { "toml", "text/x-toml" },
+    { "p7m", "application/pkcs7-mime" },
+    { NULL, NULL },
+    { "ics", "text/calendar" },
+    { "xyz", "chemical/x-xyz" },
+    { "mng", "video/x-mng" },
+    { "xlsm", "application/vnd.ms-excel.sheet.macroEnabled.12" },
+    { "dot", "application/msword" },
+    { "spx", "audio/ogg" },
+    { "bpk", "application/octet-stream" },
+    { "m3u", "audio/x-mpegurl" },
+    { NULL, NULL },
+    { "t", "text/troff" },
+    { "ifb", "text/calendar" },
+    { "hs", "text/x-haskell" },
+    { NULL, NULL },
+    { "wav", "audio/wav" },
+    { "wmx", "video/x-ms-wmx" },
+    { NULL, NULL },
+    { NULL, NULL },
+    { NULL, NULL },
+    { "pptx", "application/vnd.openxmlformats-officedocument.presentationml.presentation" },
+    { NULL, NULL },
+    { "p8", "application/pkcs8" },
+    { "ppt", "application/vnd.ms-powerpoint" },
+    { NULL, NULL },
+    { "wmf", "image/x-wmf" },
+    { "m4v", "video/mp4" },
+    { NULL, NULL },
+    { "in", "text/plain" },
+    { "mpg4", "video/mp4" },
+    { "texi", "application/x-texinfo" },
+    { "xsd", "text/xml" },
+    { "msgpack", "application/msgpack" },
+    { "tta", "audio/x-tta" },
+    { "ass", "application/x-ass" },
+    { "uri", "text/uri-list" },
+    { "afm", "application/x-font-type1" },
+    { "pjp", "image/jpeg" },
+    { "sv4crc", "application/x-sv4crc" },
+    { NULL, NULL },
+    { NULL, NULL },
+    { "udeb", "application/vnd.debian.binary-package" },
+    { "ini", "text/plain" },
+    { "tgz", "application/x-gtar" },
+    { "ots", "application/vnd.oasis.opendocument.spreadsheet-template" },
+    { "ogv", "video/ogg" },
+    { NULL, NULL },
+    { NULL, NULL },
+    { "p7c", "application/pkcs7-mime" },
+    { "xap", "application/x-silverlight-app" },
+    { NULL, NULL },
+    { "patch", "text/plain" },
+    { "opus", "audio/ogg" },
+    { "rar", "application/x-rar-compressed" },
+    { "wax", "audio/x-ms-wax" },
+    { "buffer", "application/octet-stream" },
+    { NULL, NULL },
+    { NULL, NULL },
+    { "ipynb", "application/x-ipynb+json" },
+    { "pfr", "application/x-font-pfr" },
+    { "deploy", "application/octet-stream" },
+    { "pps", "application/vnd.ms-powerpoint" },
+    { "mvb", "application/x-msmediaview" },
+    { "rm", "audio/x-pn-realaudio" },
+    { "pyo", "application/x-python-code" },
+    { "arw", "image/x-sony-arw" },
+    { NULL, NULL },
+    { NULL, NULL },
+    { "m3u8", "application/vnd.apple.mpegurl" },
+    { "cml", "chemical/x-cml" },
+    { NULL, NULL },
+    { "gsm", "audio/x-gsm" },
+    { "json", "application/json" },
+    { "mod", "audio/x-mod" },
+    { "jardiff", "application/x-java-archive-diff" },
+    { "xz", "application/x-xz" },
+    { NULL, NULL },
+    { "war", "application/java-archive" },
+    { "psd", "image/x-photoshop" },
+    { "wvx", "video/x-ms-wvx" },
+    { "cpp", "text/x-c" },
+    { "tcl", "text/x-tcl" },
+    { "odp", "application/vnd.oasis.opendocument.presentation" },
+    { "tfm", "application/x-tex-tfm" },
+    { "vrml", "model/vrml" },
+    { NULL, NULL },
+    { NULL, NULL },
+    { "otp", "application/vnd.oasis.opendocument.presentation-template" },
+    { NULL, NULL },
+    { "dll", "application/x-msdownload" },
+    { NULL, NULL },
+    { "rtf", "application/rtf" },
+    { "cbz", "application/x-cbz" },
+    { "wrl", "model/vrml" },
+    { "docx", "application/vnd.openxmlformats-officedocument.wordprocessingml.document" },
+    { "manifest", "text/cache-manifest" },
+    { "mpeg", "video/mpeg" },
+    { "pjpeg", "image/jpeg" },
+    { "mka", "audio/x-matroska" },
+    { "dae", "model/vnd.collada+xml" },
+    { "mak", "text/x-makefile" },
+    { NULL, NULL },
+    { "avif", "image/avif" },
+    { "xsl", "text/xml" },
+    { NULL, NULL },
+    { "man", "text/troff" },
+    { "exs", "text/x-elixir" },
+    { NULL, NULL },
+    { "trig", "application/trig" },
+    { "3g2", "video/3gpp2" },
+    { "po", "application/x-po" },
+    { "ear", "application/java-archive" },
+    { "dump", "application/octet-stream" },
+    { NULL, NULL },
+    { "avi", "video/x-msvideo" },
+    { "m14", "application/x-msmediaview" },
+    { "wmv", "video/x-ms-wmv" },
+    { "nim", "text/x-nim" },
+    { NULL, NULL },
+    { NULL, NULL },
+    { "mks", "video/x-matroska" },
+    { "bmp", "image/bmp" },
+    { NULL, NULL },
+    { "onepkg", "application/onenote" },
+    { "odi", "application/vnd.oasis.opendocument.image" },
+    { "jar", "application/java-archive" },
+    { NULL, NULL },
+    { "sgml", "text/sgml" },
+    { "c", "text/x-c" },
+    { NULL, NULL },
+    { NULL, NULL },
+    { "swf", "application/x-shockwave-flash" },
+    { "accdb", "application/x-msaccess" },
+    { "sgm", "text/sgml" },
+    { "coffee", "text/coffeescript" },
+    { "rtx", "text/richtext" },
+    { "dff", "audio/x-dff" },
+    { "nc", "application/x-netcdf" },
+    { NULL, NULL },
+    { NULL, NULL },
+    { "wv", "audio/x-wavpack" },
+    { NULL, NULL },
+    { "mol", "chemical/x-mdl-molfile" },
+    { "less", "text/less" },
+    { "pfx", "application/x-pkcs12" },
+    { "odm", "application/vnd.oasis.opendocument.text-master" },
+    { "sql", "text/x-sql" },
+    { NULL, NULL },
+    { "el", "text/x-lisp" },
+    { "ms", "text/troff" },
+    { NULL, NULL },
+    { NULL, NULL },
+    { "azw", "application/vnd.amazon.ebook" },
+    { "pk", "application/x-tex-pk" },
+    { "adts", "audio/aac" },
+    { NULL, NULL },
+    { "ras", "image/x-cmu-raster" },
+    { "hdf", "application/x-hdf" },
+    { "m2v", "video/mpeg" },
+    { "cc", "text/x-c" },
+    { "gltf", "model/gltf+json" },
+    { "lha", "application/x-lzh" },
+    { "otf", "font/otf" },
+    { "d", "text/x-dsrc" },
+    { "xhtml", "text/html" },
+    { "elc", "application/octet-stream" },
+    { "deb", "application/vnd.debian.binary-package" },
+    { "svgz", "image/svg+xml" },
+    { "wma", "audio/x-ms-wma" },
+    { "cbr", "application/x-cbr" },
+    { NULL, NULL },
+    { "jsonl", "application/x-ndjson" },
+    { "djv", "image/vnd.djvu" },
+    { NULL, NULL },
+    { "lisp", "text/x-lisp" },
+    { "asm", "text/x-asm" },
+    { "sz", "application/x-snappy-framed" },
+    { "mml", "text/mathml" },
+    { NULL, NULL },
+    { "conf", "text/plain" },
+    { "txz", "application/x-xz" },
+    { "ris", "application/x-research-info-systems" },
+    { "mhtml", "multipart/related" },
+    { NULL, NULL },
+    { "ods", "application/vnd.oasis.opendocument.spreadsheet" },
+    { "php", "application/x-httpd-php" },
+    { NULL, NULL },
+    { "mpp", "application/vnd.ms-project" },
+    { "m2ts", "video/mp2t" },
+    { "rmi", "audio/midi" },
+    { "tlz", "application/x-lzma" },
+    { "lz", "application/x-lzip" },
+    { NULL, NULL },
+    { "kra", "application/x-krita" },
+    { "onetoc2", "application/onenote" },
+    { "vdi", "application/x-virtualbox-vdi" },
+    { "html", "text/html" },
+    { "it", "audio/x-mod" },
+    { "com", "application/x-msdownload" },
+    { "jpf", "image/jpx" },
+    { "smil", "application/smil+xml" },
+    { "latex", "application/x-latex" },
+    { "3gpp", "video/3gpp" },
+    { "pot", "application/vnd.ms-powerpoint" },
+    { "mxu", "video/vnd.mpegurl" },
+    { "p7b", "application/x-pkcs7-certificates" },
+    { "uu", "text/x-uuencode" },
+    { "webm", "video/webm" },
+    { "igs", "model/iges" },
+    { "pcx", "image/x-pcx" },
+    { "etx", "text/x-setext" },
+    { "diff", "text/plain" },
+    { "kml", "application/vnd.google-earth.kml+xml" },
+    { "dxf", "image/vnd.dxf" },
+    { "wmd", "application/x-ms-wmd" },
+    { "docm", "application/vnd.ms-word.document.macroEnabled.12" },
+    { "mp4v", "video/mp4" },
+    { "rgb", "image/x-rgb" },
+    { "f77", "text/x-fortran" },
+    { "kts", "text/x-kotlin" },
+    { NULL, NULL },
+    { "bz2", "application/x-bzip2" },
+    { "geojson", "application/geo+json" },
+    { NULL, NULL },
+    { "cgi", "application/x-cgi" },
+    { "msi", "application/x-msdownload" },
+    { "3mf", "model/3mf" },
+    { "dif", "video/x-dv" },
+    { NULL, NULL },
+    { "nef", "image/x-nikon-nef" },
+    { "kwd", "application/x-kword" },
+    { "mpe", "video/mpeg" },
+    { "pgp", "application/pgp-encrypted" },
+    { "caf", "audio/x-caf" },
+    { NULL, NULL },
+    { NULL, NULL },
+    { "pem", "application/x-pem-file" },
+    { "plist", "application/x-apple-plist" },
+    { "cb7", "application/x-cb7" },
+    { "distz", "application/octet-stream" },
+    { "msg", "application/vnd.ms-outlook" },
+    { "mov", "video/quicktime" },
+    { "java", "text/x-java" },
+    { NULL, NULL },
+    { "owl", "application/rdf+xml" },
+    { "sfv", "text/x-sfv" },
+    { "asx", "video/x-ms-asf" },
+    { NULL, NULL },
+    { "sv4cpio", "application/x-sv4cpio" },
+    { "luac", "application/x-lua-bytecode" },
+    { "trm", "application/x-msterminal" },
+    { "odf", "application/vnd.oasis.opendocument.formula" },
+    { "ts", "video/mp2t" },
+    { "xltx", "application/vnd.openxmlformats-officedocument.spreadsheetml.template" },
+    { NULL, NULL },
+    { "pls", "audio/x-scpls" },
+    { NULL, NULL },
+    { "ott", "application/vnd.oasis.opendocument.text-template" },
+    { "crw", "image/x-canon-crw" },
+    { NULL, NULL },
+    { "smi", "application/smil+xml" },
+    { "mat", "application/x-matlab-data" },
+    { NULL, NULL },
+    { NULL, NULL },
+    { "sqlite", "application/x-sqlite3" },
+    { "heif", "image/heif" },
+    { "pbm", "image/x-portable-bitmap" },
+    { "ml", "text/x-ocaml" },
+    { "ksp", "application/x-kspread" },
+    { "bz", "application/x-bzip" },
+    { "pyc", "application/x-python-code" },
+    { "ace", "application/x-ace-compressed" },
+    { "taz", "application/x-gtar" },
+    { NULL, NULL },
+    { NULL, NULL },
+    { "avro", "application/x-avro" },
+    { "pmw", "application/x-perfmon" },
+    { "pam", "image/x-portable-arbitrarymap" },
+    { "voc", "audio/x-voc" },
+    { "xlm", "application/vnd.ms-excel" },
+    { "odb", "application/vnd.oasis.opendocument.database" },
+    { "asf", "video/x-ms-asf" },
+    { NULL, NULL },
+    { NULL, NULL },
+    { "crt", "application/x-x509-ca-cert" },
+    { "exr", "image/x-exr" },
+    { "silo", "model/mesh" },
+    { "roff", "text/troff" },
+    { "m13", "application/x-msmediaview" },
+    { NULL, NULL },
+    { "pmc", "application/x-perfmon" },
+    { "texinfo", "application/x-texinfo" },
+    { "arc", "application/x-freearc" },
+    { "sh", "text/x-sh" },
+    { "xls", "application/vnd.ms-excel" },
+    { NULL, NULL },
+    { NULL, NULL },
+    { "mp4a", "audio/mp4" },
+    { "iges", "model/iges" },
+    { "atom", "application/atom+xml" },
+    { "py", "text/x-python" },
+    { "oda", "application/oda" },
+    { "pml", "application/x-perfmon" },
+    { "arj", "application/x-arj" },
+    { "class", "application/java-vm" },
+    { "clp", "application/x-msclip" },
+    { NULL, NULL },
+    { "epsi", "application/postscript" },
+    { NULL, NULL },
+    { NULL, NULL },
+    { "log", "text/plain" },
+    { "kt", "text/x-kotlin" },
+    { "one", "application/onenote" },
+    { "sd2", "audio/x-sd2" },
+    { "x3dz", "model/x3d+xml" },
+    { NULL, NULL },
+    { NULL, NULL },
+    { "cxx", "text/x-c" },
+    { NULL, NULL },
+    { "hqx", "application/mac-binhex40" },
+    { NULL, NULL },
+    { "dwg", "image/vnd.dwg" },
+    { NULL, NULL },
+    { "csh", "application/x-csh" },
+    { "ivf", "video/x-ivf" },
+    { "f90", "text/x-fortran" },
+    { "dmg", "application/x-apple-diskimage" },
+    { "lzma", "application/x-lzma" },
+    { "crd", "application/x-mscardfile" },
+    { "dotx", "application/vnd.openxmlformats-officedocument.wordprocessingml.template" },
+    { NULL, NULL },
+    { "s", "text/x-asm" },
+    { "s3m", "audio/x-mod" },
+    { "potx", "application/vnd.openxmlformats-officedocument.presentationml.template" },
+    { "xlsb", "application/vnd.ms-excel.sheet.binary.macroEnabled.12" },
+    { "pb", "application/x-protobuf" },
+    { "x3d", "model/x3d+xml" },
+    { NULL, NULL },
+    { NULL, NULL },
+    { "tk", "text/x-tcl" },
+    { "jp2", "image/jp2" },
+    { "apng", "image/apng" },
+    { "markdown", "text/markdown" },
+    { NULL, NULL },
+    { "vcard", "text/vcard" },
+    { "xlsx", "application/vnd.openxmlformats-officedocument.spreadsheetml.sheet" },
+    { "ape", "audio/x-ape" },
+    { "pfa", "application/x-font-type1" },
+    { "mp2", "audio/mpeg" },
+    { NULL, NULL },
+    { "jpg2", "image/jp2" },
+    { "lsf", "video/x-la-asf" },
+    { "pcf", "application/x-font-pcf" },
+    { "gif", "image/gif" },
+    { "hh", "text/x-c" },
+    { "appcache", "text/cache-manifest" },
+    { "ra", "audio/x-realaudio" },
+    { NULL, NULL },
+    { NULL, NULL },
+    { NULL, NULL },
+    { "f4v", "video/x-f4v" },
+    { "p10", "application/pkcs10" },
+    { "tga", "image/x-tga" },
+    { NULL, NULL },
+    { "bdf", "application/x-font-bdf" },
+    { "stl", "model/stl" },
+    { "p7r", "application/x-pkcs7-certreqresp" },
+    { NULL, NULL },
+    { "php3", "application/x-httpd-php" },
+    { "xlt", "application/vnd.ms-excel" },
+    { "iso", "application/x-iso9660-image" },
+    { "vsw", "application/vnd.visio" },
+    { "ps", "application/postscript" },
+    { "tif", "image/tiff" },
+    { "bin", "application/octet-stream" },
+    { "ndjson", "application/x-ndjson" },
+    { "zst", "application/zstd" },
+    { "jpeg", "image/jpeg" },
+    { "ico", "image/x-icon" },
+    { "dir", "application/x-director" },
+    { "woff", "font/woff" },
+    { "css", "text/css" },
+    { "numbers", "application/vnd.apple.numbers" },
+    { "pdb", "application/x-pilot" },
+    { "ttml", "application/ttml+xml" },
+    { "ai", "application/postscript" },
+    { "eps", "application/postscript" },
+    { "flac", "audio/flac" },
+    { "lua", "text/x-lua" },
+    { "a", "application/x-archive" },
+    { "key", "application/pgp-keys" },
+    { "xm", "audio/x-mod" },
+    { "cr2", "image/x-canon-cr2" },
+    { NULL, NULL },
+    { "application", "application/x-ms-application" },
+    { "jpe", "image/jpeg" },
+    { "db3", "application/x-sqlite3" },
+    { "dist", "application/octet-stream" },
+    { "gpx", "application/gpx+xml" },
+    { "xbm", "image/x-xbitmap" },
+    { "p12", "application/x-pkcs12" },
+    { "pptm", "application/vnd.ms-powerpoint.presentation.macroEnabled.12" },
+    { "srx", "application/sparql-results+xml" },
+    { "sig", "application/pgp-signature" },
+    { "eot", "application/vnd.ms-fontobject" },
+    { "rej", "text/x-diff" },
+    { "sitx", "application/x-stuffitx" },
+    { NULL, NULL },
+    { "png", "image/png" },
+    { NULL, NULL },
+    { "rpm", "application/x-redhat-package-manager" },
+    { NULL, NULL },
+    { "oga", "audio/ogg" },
+    { "phtml", "application/x-httpd-php" },
+    { "spc", "application/x-pkcs7-certificates" },
+    { "src", "application/x-wais-source" },
+    { "mkv", "video/x-matroska" },
+    { "lit", "application/x-ms-reader" },
+    { "cif", "chemical/x-cif" },
+    { "def", "text/plain" },
+    { "nt", "application/n-triples" },
+    { "exe", "application/x-msdownload" },
+    { "wasm", "application/wasm" },
+    { NULL, NULL },
+    { "rst", "text/x-rst" },
+    { "awb", "audio/amr-wb" },
+    { "gtar", "application/x-gtar" },
+    { "go", "text/x-go" },
+    { "aiff", "audio/x-aiff" },
+    { "gz", "application/gzip" },
+    { NULL, NULL },
+    { "cpt", "image/x-corelphotopaint" },
+    { "qt", "video/quicktime" },
+    { "map", "application/json" },
+    { "snd", "audio/basic" },
+    { "asc", "application/pgp-signature" },
+    { "ktx2", "image/ktx2" },
+    { "tiff", "image/tiff" },
+    { NULL, NULL },
+    { "vmdk", "application/x-virtualbox-vmdk" },
+    { "emf", "image/x-emf" },
+    { "jnlp", "application/x-java-jnlp-file" },
+    { "nzb", "application/x-nzb" },
+    { "srt", "application/x-subrip" },
+    { "xpi", "application/x-xpinstall" },
+    { NULL, NULL },
+    { "vst", "application/vnd.visio" },
+    { NULL, NULL },
+    { "dms", "application/octet-stream" },
+    { "ppm", "image/x-portable-pixmap" },
+    { "boz", "application/x-bzip2" },
+    { "ttc", "font/collection" },
+    { "scss", "text/x-scss" },
+    { "phps", "text/x-php" },
+    { NULL, NULL },
+    { "jsx", "text/jsx" },
+    { "jpm", "image/jpm" },
+    { "qcow2", "application/x-qemu-disk" },
+    { "pm", "text/x-perl" },
+    { "midi", "audio/midi" },
+    { NULL, NULL },
+    { NULL, NULL },
+    { "nuv", "video/x-nuv" },
+    { NULL, NULL },
+    { NULL, NULL },
+    { "csv", "text/csv" },
+    { "amr", "audio/amr" },
+    { "wbmp", "image/vnd.wap.wbmp" },
+    { NULL, NULL },
+    { "jpg", "image/jpeg" },
+    { "lz4", "application/x-lz4" },
+    { "sty", "text/x-tex" },
+    { "pnm", "image/x-portable-anymap" },
+    { NULL, NULL },
+    { "ssa", "application/x-ass" },
+    { "rss", "application/rss+xml" },
+    { "ser", "application/java-serialized-object" },
+    { "lzh", "application/x-lzh" },
+    { "smv", "video/x-smv" },
+    { "cur", "image/x-icon" },
+    { "mrc", "application/marc" },
+    { "obj", "model/obj" },
+    { "wcm", "application/vnd.ms-works" },
+    { "3gp", "video/3gpp" },
+    { "ltx", "text/x-tex" },
+    { "ttl", "text/turtle" },
+    { "gpg", "application/pgp-keys" },
+    { NULL, NULL },
+    { "lyx", "application/x-lyx" },
+    { "litcoffee", "text/coffeescript" },
+    { NULL, NULL },
+    { "pfm", "application/x-font-type1" },
+    { "urls", "text/uri-list" },
+    { "sqlite3", "application/x-sqlite3" },
+    { "swift", "text/x-swift" },
+    { "ram", "audio/x-pn-realaudio" },
+    { "apk", "application/vnd.android.package-archive" },
+    { "sav", "application/x-spss-sav" },
+    { "lrf", "application/octet-stream" },
+    { NULL, NULL },
+    { "vcf", "text/vcard" },
+    { "epub", "application/epub+zip" },
+    { "cbor", "application/cbor" },
+    { "mk3d", "video/x-matroska" },
+    { "cdf", "application/x-netcdf" },
+    { "gnumeric", "application/x-gnumeric" },
+    { "shar", "application/x-shar" },
+    { "pkg", "application/octet-stream" },
+    { "au", "audio/basic" },
+    { NULL, NULL },
+    { "mpg", "video/mpeg" },
+    { NULL, NULL },
+    { NULL, NULL },
+    { NULL, NULL },
+    { "pfb", "application/x-font-type1" },
+    { "php5", "application/x-httpd-php" },
+    { NULL, NULL },
+    { "o", "application/x-object" },
+    { "dvi", "application/x-dvi" },
+    { NULL, NULL },
+    { "crx", "application/x-chrome-extension" },
+    { "lsx", "video/x-la-asf" },
+    { "7z", "application/x-7z-compressed" },
+    { "xht", "application/xhtml+xml" },
+    { "blend", "application/x-blender" },
+    { "cbt", "application/x-cbt" },
+    { "wri", "application/x-mswrite" },
+    { "movie", "video/x-sgi-movie" },
+    { "scd", "application/x-msschedule" },
+    { "mjs", "text/javascript" },
+    { "rhtml", "application/x-httpd-eruby" },
+    { "otg", "application/vnd.oasis.opendocument.graphics-template" },
+    { "mbox", "application/mbox" },
+    { "wks", "application/vnd.ms-works" },
+    { "dxr", "application/x-director" },
+    { "rb", "text/x-ruby" },
+    { "cs", "text/x-csharp" },
+    { "wps", "application/vnd.ms-works" },
+    { NULL, NULL },
+    { "torrent", "application/x-bittorrent" },
+    { "gf", "application/x-tex-gf" },
+    { "glb", "model/gltf-binary" },
+    { "jng", "image/x-jng" },
+    { NULL, NULL },
+    { "aac", "audio/aac" },
+    { NULL, NULL },
+    { "snf", "application/x-font-snf" },
+    { "xwd", "image/x-xwindowdump" },
+    { "mif", "application/x-mif" },
+    { NULL, NULL },
+    { "webp", "image/webp" },
+    { NULL, NULL },
+    { "sass", "text/x-sass" },
+    { "crl", "application/pkix-crl" },
+    { "m4a", "audio/mp4" },
+    { NULL, NULL },
+    { "sdf", "chemical/x-mdl-sdfile" },
+    { "elf", "application/x-elf" },
+    { "pdf", "application/pdf" },
+    { "bcpio", "application/x-bcpio" },
+    { "for", "text/x-fortran" },
+    { NULL, NULL },
+    { NULL, NULL },
+    { "mp4", "video/mp4" },
+    { "htm", "text/html" },
+    { NULL, NULL },
+    { "yml", "text/yaml" },
+    { NULL, NULL },
+    { "chm", "application/vnd.ms-htmlhelp" },
+    { "xps", "application/vnd.ms-xpsdocument" },
+    { "me", "text/troff" },
+    { NULL, NULL },
+    { NULL, NULL },
+    { "tr", "text/troff" },
+    { "keynote", "application/vnd.apple.keynote" },
+    { NULL, NULL },
+    { "jxl", "image/jxl" },
+    { "m2a", "audio/mpeg" },
+    { "djvu", "image/vnd.djvu" },
+    { "gql", "application/graphql" },
+    { NULL, NULL },
+    { NULL, NULL },
+    { "so", "application/x-sharedlib" },
+    { "mdb", "application/vnd.ms-access" },
+    { "wmz", "application/x-msmetafile" },
+    { "kar", "audio/midi" },
+    { NULL, NULL },
+    { "shtml", "text/html" },
+    { "htc", "text/x-component" },
+    { "onetmp", "application/onenote" },
+    { "scala", "text/x-scala" },
+    { "odc", "application/vnd.oasis.opendocument.chart" },
+    { "orf", "image/x-olympus-orf" },
+    { "xslt", "application/xslt+xml" },
+    { "mobi", "application/x-mobipocket-ebook" },
+    { "jks", "application/x-java-keystore" },
+    { "ogx", "application/ogg" },
+    { "mpega", "audio/mpeg" },
+    { "dib", "image/bmp" },
+    { "jsonld", "application/ld+json" },
+    { "eml", "message/rfc822" },
+    { "oth", "application/vnd.oasis.opendocument.text-web" },
+    { "hrl", "text/x-erlang" },
+    { "m1v", "video/mpeg" },
+};
@@ -0,0 +1,691 @@
+/*
+ * proxy.c - A concurrent, caching HTTP/1.0 web proxy.
+ *
+ *     usage: proxy [-t nthreads] [-c cachebytes] [-o maxobject] [-l]
+ *                  [-p maxidle] [-P maxconns] [-i idlesecs] [-a maxage]
+ *                  [-d dnsttl] [-v] <port>
+ *
+ *     -t  Serve clients from a pool of nthreads threads (default 16).
+ *     -c  Keep up to cachebytes (default MAX_CACHE_SIZE; 0 turns the
+ *         cache off) of origin responses in memory.
+ *     -o  Never cache a response bigger than maxobject bytes (default
+ *         MAX_OBJECT_SIZE).
+ *     -l  Admit objects to a full cache through a TinyLFU frequency
+ *         filter (tinylfu.h) instead of always evicting for them.
+ *     -p  Keep up to maxidle (default POOL_MAXIDLE; 0 turns pooling
+ *         off) idle keep-alive connections to each origin server.
+ *     -P  Open at most maxconns connections to any one origin at once
+ *         (default 0, no limit).
+ *     -i  Close a pooled connection after idlesecs idle seconds
+ *         (default POOL_IDLE).
+ *     -a  Stop reusing an origin connection maxage seconds after it
+ *         was opened (default POOL_MAXAGE).
+ *     -d  Cache origin name lookups for dnsttl seconds (default
+ *         DNS_TTL; 0 looks names up on every connect), and failed
+ *         ones for DNS_NEGTTL seconds (resolver.c).
+ *     -v  Print each accepted connection and each request head on
+ *         stderr (for debugging: every line is a locked, synchronous
+ *         write on the request path).
+ *
+ * The main thread accepts connections and hands them to the pool
+ * through an sbuf. A worker reads one request from its client, which
+ * must name its target in absolute form (GET http://host[:port]/path
+ * HTTP/1.x), and answers it from the cache if it can. Otherwise it
+ * takes a connection to the origin server from connpool.c, sends it
+ * the request as HTTP/1.0 with the path in origin form and the headers
+ * rewritten (a Host header, a fixed User-Agent, and Connection and
+ * Proxy-Connection set to keep-alive), and streams the origin's
+ * response back to the client as it arrives, telling the client the
+ * connection closes after it. A successful response that ends within
+ * the object limit is then added to the cache under its URI.
+ *
+ * Concurrent misses on one URI are coalesced by flight.c: the first
+ * fetches, and the others stream the same response as it arrives
+ * instead of each asking the origin.
+ *
+ * A response whose end the proxy can tell without the origin closing
+ * the connection (it has a Content-length, or no body) and whose
+ * origin agreed to keep-alive leaves its connection in the pool for
+ * the next request to that origin, saving the lookup and handshake.
+ * An origin may close an idle connection at any moment, so a request
+ * sent on a pooled connection that yields no response at all is
+ * simply sent again on another.
+ *
+ * The cache is cache.c: shared by every thread, bounded in bytes,
+ * evicting in (approximately) least-recently-used order, with lookups
+ * under a reader-preferring read lock so hits never wait on each
+ * other. SIGUSR1 prints its counters on stderr.
+ *
+ * Any origin will do, including a local Tiny:
+ *
+ *     tiny 8000 & proxy 8001 &
+ *     curl -x localhost:8001 http://localhost:8000/home.html
+ */
+#include "csapp.h"
+#include "sbuf.h"
+#include "cache.h"
+#include "httpparse.h"
+#include "connpool.h"
+#include "flight.h"
+
+#define NTHREADS        16
+#define SBUFSIZE        64
+#define MAX_CACHE_SIZE  1049000
+#define MAX_OBJECT_SIZE 102400
+#define CLIENT_TIMEOUT  10     /* Seconds to wait for a client's request */
+#define ORIGIN_TIMEOUT  30     /* Seconds to wait on a silent origin */
+#define POOL_MAXIDLE    8      /* Idle connections kept per origin */
+#define POOL_IDLE       30     /* Seconds a pooled connection may idle */
+#define POOL_MAXAGE     300    /* Seconds an origin connection is reused */
+#define DNS_TTL         60     /* Seconds an origin's addresses are kept */
+#define DNS_NEGTTL      5      /* Seconds a failed lookup is kept */
+#define FLIGHT_MAXBYTES (16 << 20) /* Bytes a fetch keeps for joiners */
+
+static char *user_agent_hdr = "User-Agent: Mozilla/5.0 (X11; Linux x86_64; "
+    "rv:10.0.3) Gecko/20120305 Firefox/10.0.3\r\n";
+
+static sbuf_t sbuf;            /* Connected descriptors awaiting a worker */
+static cache_t cache;
+static cache_t *proxy_cache;   /* &cache, or NULL if caching is off */
+static resolver_t resolver;
+static resolver_t *proxy_resolver; /* &resolver, or NULL: no DNS cache */
+static connpool_t pool;        /* Connections to origin servers */
+static flights_t flights;      /* Fetches in progress, by URI */
+static int verbose;            /* Print connections and requests (-v) */
+
+static void *worker(void *vargp);
+static void *reporter(void *vargp);
+static void proxy_client(int connfd);
+static int parse_url(char *uri, char *host, char *port, char *path);
+static int hop_by_hop(char *name);
+static void proxy_fetch(int connfd, http_req_t *req, char *buf, char *uri,
+			char *host, char *port, char *path, flight_t *f);
+static int forward_request(int serverfd, http_req_t *req, char *buf,
+			   char *host, char *port, char *path);
+static int read_response(rio_t *rp, http_req_t *resp);
+static int rewrite_head(http_req_t *resp, char *buf, char *head, size_t size);
+static int relay_response(rio_t *rp, http_req_t *resp, int connfd, char *uri,
+			  flight_t *f);
+static void proxy_error(int fd, char *cause, char *errnum,
+			char *shortmsg, char *longmsg);
+
+static void usage(char *prog)
+{
+    fprintf(stderr, "usage: %s [-t nthreads] [-c cachebytes] "
+	    "[-o maxobject] [-l]\n\t[-p maxidle] [-P maxconns] [-i idlesecs] "
+	    "[-a maxage] [-d dnsttl] [-v] <port>\n", prog);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    int i, c, listenfd, connfd, nthreads = NTHREADS;
+    int maxidle = POOL_MAXIDLE, maxconns = 0, tinylfu = 0;
+    int idlesecs = POOL_IDLE, maxage = POOL_MAXAGE, dnsttl = DNS_TTL;
+    long cachebytes = MAX_CACHE_SIZE, maxobject = MAX_OBJECT_SIZE;
+    char hostname[MAXLINE], port[MAXLINE];
+    socklen_t clientlen;
+    struct sockaddr_storage clientaddr;
+    static sigset_t mask;
+    pthread_t tid;
+
+    while ((c = getopt(argc, argv, "t:c:o:lp:P:i:a:d:v")) != -1) {
+	switch (c) {
+	case 't':
+	    nthreads = atoi(optarg);
+	    break;
+	case 'c':
+	    cachebytes = strtol(optarg, NULL, 0);
+	    break;
+	case 'o':
+	    maxobject = strtol(optarg, NULL, 0);
+	    break;
+	case 'l':
+	    tinylfu = 1;
+	    break;
+	case 'p':
+	    maxidle = atoi(optarg);
+	    break;
+	case 'P':
+	    maxconns = atoi(optarg);
+	    break;
+	case 'i':
+	    idlesecs = atoi(optarg);
+	    break;
+	case 'a':
+	    maxage = atoi(optarg);
+	    break;
+	case 'd':
+	    dnsttl = atoi(optarg);
+	    break;
+	case 'v':
+	    verbose = 1;
+	    break;
+	default:
+	    usage(argv[0]);
+	}
+    }
+    if (optind != argc - 1 || nthreads < 1 || cachebytes < 0 ||
+	maxobject < 1 || maxidle < 0 || maxconns < 0 || idlesecs < 1 ||
+	maxage < 1 || dnsttl < 0)
+	usage(argv[0]);
+
+    Signal(SIGPIPE, SIG_IGN);   /* A vanished peer must not kill the proxy */
+    if (cachebytes > 0) {
+	cache_init(&cache, cachebytes, maxobject);
+	proxy_cache = &cache;
+	if (tinylfu)
+	    cache_tinylfu(&cache);
+    }
+
+    /* Only the reporter thread takes SIGUSR1: block it before any other
+       thread (the resolver's included) is created */
+    Sigemptyset(&mask);
+    Sigaddset(&mask, SIGUSR1);
+    Sigprocmask(SIG_BLOCK, &mask, NULL);
+    Pthread_create(&tid, NULL, reporter, &mask);
+
+    if (dnsttl > 0) {
+	resolv_init(&resolver, dnsttl, DNS_NEGTTL);
+	proxy_resolver = &resolver;
+    }
+    connpool_init(&pool, proxy_resolver, maxidle, maxconns, idlesecs, maxage);
+    flight_init(&flights, FLIGHT_MAXBYTES);
+
+    listenfd = Open_listenfd(argv[optind]);
+    sbuf_init(&sbuf, SBUFSIZE);
+    for (i = 0; i < nthreads; i++)
+	Pthread_create(&tid, NULL, worker, NULL);
+
+    while (1) {
+	clientlen = sizeof(clientaddr);
+	if ((connfd = accept(listenfd, (SA *)&clientaddr, &clientlen)) < 0) {
+	    if (errno != EINTR && errno != ECONNABORTED) {
+		fprintf(stderr, "accept error: %s\n", strerror(errno));
+		usleep(10000);  /* e.g. EMFILE: let workers close some */
+	    }
+	    continue;
+	}
+	if (verbose &&
+	    getnameinfo((SA *)&clientaddr, clientlen, hostname, MAXLINE,
+			port, MAXLINE, NI_NUMERICHOST | NI_NUMERICSERV) == 0)
+	    fprintf(stderr, "Accepted connection from (%s, %s)\n", hostname,
+		    port);
+	sbuf_insert(&sbuf, connfd);
+    }
+}
+
+/*
+ * worker - thread routine: serve clients handed over by the main thread
+ */
+static void *worker(void *vargp)
+{
+    int connfd;
+
+    Pthread_detach(pthread_self());
+    while (1) {
+	connfd = sbuf_remove(&sbuf);
+	proxy_client(connfd);
+	Close(connfd);
+    }
+    return NULL;
+}
+
+/*
+ * reporter - thread routine: print the cache's and the connection
+ *     pool's counters on stderr each time SIGUSR1 arrives
+ */
+static void *reporter(void *vargp)
+{
+    int sig;
+    sigset_t *mask = vargp;
+    cache_stats_t st;
+    connpool_stats_t ps;
+    resolv_stats_t rs;
+
+    Pthread_detach(pthread_self());
+    while (sigwait(mask, &sig) == 0) {
+	if (proxy_cache) {
+	    cache_getstats(proxy_cache, &st);
+	    fprintf(stderr, "proxy: cache: %lu hits, %lu misses, "
+		    "%lu insertions, %lu evictions, %lu rejections, "
+		    "%lu refusals; %d objects, %zu/%zu bytes\n",
+		    st.hits, st.misses, st.insertions, st.evictions,
+		    st.rejections, st.refusals, st.count, st.bytes,
+		    st.maxbytes);
+	}
+	connpool_getstats(&pool, &ps);
+	fprintf(stderr, "proxy: origins: %lu connects, %lu reuses, "
+		"%lu stale, %lu expired, %lu waits; %d idle\n",
+		ps.connects, ps.reuses, ps.stale, ps.expired, ps.waits,
+		ps.nidle);
+	if (proxy_resolver) {
+	    resolv_getstats(proxy_resolver, &rs);
+	    fprintf(stderr, "proxy: names: %lu hits (%lu negative), "
+		    "%lu misses, %lu refreshes; %d cached\n", rs.hits,
+		    rs.negative, rs.misses, rs.refreshes, rs.entries);
+	}
+	pthread_mutex_lock(&flights.lock);
+	fprintf(stderr, "proxy: fetches: %lu led, %lu joined\n",
+		flights.flights, flights.joins);
+	pthread_mutex_unlock(&flights.lock);
+    }
+    return NULL;
+}
+
+/*
+ * proxy_client - read one request from the client on connfd and answer
+ *     it from the cache or the origin server
+ */
+static void proxy_client(int connfd)
+{
+    int rc, leader;
+    ssize_t n;
+    char *buf, *method, *uri, *version;
+    char host[MAXLINE], port[MAXLINE], path[MAXLINE];
+    struct timeval timeout = { CLIENT_TIMEOUT, 0 };
+    http_req_t req;
+    cache_obj_t *obj;
+    flight_t *f;
+    rio_t rio;
+
+    /* Read and parse the request head in place */
+    setsockopt(connfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    Rio_readinitb(&rio, connfd);
+    http_init(&req);
+    while ((rc = http_parse(&req, rio.rio_bufptr, rio.rio_cnt)) == HTTP_AGAIN) {
+	if ((n = rio_fill(&rio)) > 0)
+	    continue;
+	if (n < 0 && errno == ENOBUFS)
+	    break;              /* Headers will never fit */
+	return;                 /* Closed, too slow, or failed */
+    }
+    if (rc != HTTP_DONE) {
+	proxy_error(connfd, "request", "400", "Bad Request",
+		    "Proxy couldn't parse the request headers");
+	return;
+    }
+    buf = rio.rio_bufptr;
+    if (verbose)
+	fprintf(stderr, "%.*s", (int)req.hdrlen, buf);
+    http_terminate(&req, buf);
+    method = http_str(buf, req.method);
+    uri = http_str(buf, req.uri);
+    version = http_str(buf, req.version);
+
+    if (strcasecmp(method, "GET")) {
+	proxy_error(connfd, method, "501", "Not Implemented",
+		    "Proxy does not implement this method");
+	return;
+    }
+    if (strncmp(version, "HTTP/1.", 7) ||
+	parse_url(uri, host, port, path) < 0) {
+	proxy_error(connfd, uri, "400", "Bad Request",
+		    "Proxy needs an absolute http:// URI");
+	return;
+    }
+
+    /* Serve it from the cache if we can */
+    if (proxy_cache && (obj = cache_lookup(proxy_cache, uri)) != NULL) {
+	rio_writen(connfd, obj->data, obj->size);
+	cache_release(proxy_cache, obj);
+	return;
+    }
+
+    /* Otherwise fetch it, unless another thread already is */
+    f = flight_join(&flights, uri, &leader);
+    if (leader)
+	proxy_fetch(connfd, &req, buf, uri, host, port, path, f);
+    else if (flight_relay(f, connfd) < 0)
+	proxy_error(connfd, host, "502", "Bad Gateway",
+		    "Proxy couldn't get a response from the origin server");
+    flight_release(f);
+}
+
+/*
+ * proxy_fetch - as the leader of flight f, get the parsed, terminated
+ *     request req in buf from the origin at host:port and relay the
+ *     response to the client on connfd and f's followers. A pooled
+ *     connection that turns out to be dead before answering costs only
+ *     a retry.
+ */
+static void proxy_fetch(int connfd, http_req_t *req, char *buf, char *uri,
+			char *host, char *port, char *path, flight_t *f)
+{
+    int rc;
+    pconn_t pc;
+    rio_t rio;
+    http_req_t resp;
+    struct timeval timeout = { ORIGIN_TIMEOUT, 0 };
+
+    while (1) {
+	if (connpool_get(&pool, host, port, &pc) < 0) {
+	    flight_finish(&flights, f, 0);
+	    proxy_error(connfd, host, "502", "Bad Gateway",
+			"Proxy couldn't connect to the origin server");
+	    return;
+	}
+	if (!pc.reused)
+	    setsockopt(pc.fd, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+		       sizeof(timeout));
+	rio_readinitb(&rio, pc.fd);
+	rc = HTTP_AGAIN;
+	if (forward_request(pc.fd, req, buf, host, port, path) == 0 &&
+	    (rc = read_response(&rio, &resp)) == HTTP_DONE)
+	    break;
+	connpool_put(&pool, &pc, 0);
+	if (!pc.reused || rc == HTTP_BAD || rio.rio_cnt > 0) {
+	    flight_finish(&flights, f, 0);
+	    proxy_error(connfd, host, "502", "Bad Gateway",
+			"Proxy got no valid response from the origin server");
+	    return;
+	}
+    }
+    connpool_put(&pool, &pc, relay_response(&rio, &resp, connfd, uri, f));
+}
+
+/*
+ * parse_url - split an absolute http URI into host, port (default 80),
+ *     and path (default "/"). An IPv6 literal host is given in
+ *     brackets, which are dropped. Returns -1 if uri isn't of that form.
+ */
+static int parse_url(char *uri, char *host, char *port, char *path)
+{
+    char *hostp, *hostend, *p;
+    size_t len;
+
+    if (strncasecmp(uri, "http://", 7))
+	return -1;
+    hostp = uri + 7;
+    if (*hostp == '[') {                /* [IPv6 literal] */
+	if (!(hostend = strchr(hostp, ']')))
+	    return -1;
+	hostp++;
+	p = hostend + 1;
+    }
+    else
+	p = hostend = hostp + strcspn(hostp, ":/");
+    if ((len = hostend - hostp) == 0 || len >= MAXLINE)
+	return -1;
+    memcpy(host, hostp, len);
+    host[len] = '\0';
+
+    strcpy(port, "80");
+    if (*p == ':') {
+	len = strcspn(++p, "/");
+	if (len == 0 || len >= MAXLINE)
+	    return -1;
+	memcpy(port, p, len);
+	port[len] = '\0';
+	p += len;
+    }
+    if (*p && *p != '/')
+	return -1;
+    if (strlen(p) >= MAXLINE - 1)
+	return -1;
+    strcpy(path, *p ? p : "/");
+    return 0;
+}
+
+/*
+ * hop_by_hop - is name a header the proxy replaces or must not pass
+ *     on to the origin?
+ */
+static int hop_by_hop(char *name)
+{
+    static char *names[] = { "Host", "User-Agent", "Connection",
+	"Proxy-Connection", "Keep-Alive", "Proxy-Authorization", "TE",
+	"Trailer", "Transfer-Encoding", "Upgrade", NULL };
+    char **np;
+
+    for (np = names; *np; np++)
+	if (!strcasecmp(name, *np))
+	    return 1;
+    return 0;
+}
+
+/*
+ * forward_request - send the client's request to the origin on
+ *     serverfd as an HTTP/1.0 request for path, with the headers
+ *     rewritten, in one write. req is the parsed, terminated request
+ *     in buf. Returns -1 on error.
+ */
+static int forward_request(int serverfd, http_req_t *req, char *buf,
+			   char *host, char *port, char *path)
+{
+    int i;
+    char *name, *conn = pool.maxidle > 0 ? "keep-alive" : "close";
+    http_header_t *h;
+    riow_t out;
+
+    rio_writeinitb(&out, serverfd);
+    rio_printfb(&out, "GET %s HTTP/1.0\r\n", path);
+    if ((h = http_header(req, buf, "Host")) != NULL)
+	rio_printfb(&out, "Host: %s\r\n", http_str(buf, h->value));
+    else if (!strcmp(port, "80"))
+	rio_printfb(&out, strchr(host, ':') ? "Host: [%s]\r\n"
+		    : "Host: %s\r\n", host);
+    else
+	rio_printfb(&out, strchr(host, ':') ? "Host: [%s]:%s\r\n"
+		    : "Host: %s:%s\r\n", host, port);
+    rio_printfb(&out, "%s", user_agent_hdr);
+    rio_printfb(&out, "Connection: %s\r\n", conn);
+    rio_printfb(&out, "Proxy-Connection: %s\r\n", conn);
+
+    for (i = 0; i < req->nheaders; i++) {
+	h = &req->headers[i];
+	name = http_str(buf, h->name);
+	if (!hop_by_hop(name))
+	    rio_printfb(&out, "%s: %s\r\n", name, http_str(buf, h->value));
+    }
+    rio_printfb(&out, "\r\n");
+    return rio_flushb(&out) < 0 ? -1 : 0;
+}
+
+/*
+ * read_response - read and parse the head of the origin's response
+ *     into rp's (freshly initialized) buffer. Returns HTTP_DONE,
+ *     HTTP_BAD, or HTTP_AGAIN if the origin closed the connection,
+ *     failed, or timed out first.
+ */
+static int read_response(rio_t *rp, http_req_t *resp)
+{
+    int rc;
+    ssize_t n;
+
+    http_init_response(resp);
+    while ((rc = http_parse(resp, rp->rio_bufptr, rp->rio_cnt)) == HTTP_AGAIN) {
+	if ((n = rio_fill(rp)) > 0)
+	    continue;
+	return n < 0 && errno == ENOBUFS ? HTTP_BAD : HTTP_AGAIN;
+    }
+    return rc;
+}
+
+/*
+ * rewrite_head - copy the terminated response head resp in buf into
+ *     head (size bytes) with the origin's connection headers replaced
+ *     by "Connection: close", and return its length, or -1 if it
+ *     doesn't fit.
+ *
+ * A head is at most RIO_BUFSIZE bytes, and the rewrite makes it longer
+ * by at most PROXY_HEADSLACK: 2 for a status line with no reason
+ * ("HTTP/1.1 200\n" becomes "HTTP/1.1 200 \r\n"), 2 for each header
+ * recorded ("n:v\n" becomes "n: v\r\n"; later ones are dropped), and
+ * 20 for the blank line ("\n" becomes "Connection: close\r\n\r\n").
+ */
+#define PROXY_HEADSLACK (2 + 2 * HTTP_MAXHEADERS + 20)
+#define PROXY_HEADMAX   (RIO_BUFSIZE + PROXY_HEADSLACK + 1)  /* And a NUL */
+
+static int rewrite_head(http_req_t *resp, char *buf, char *head, size_t size)
+{
+    int i, rc;
+    size_t len;
+    char *name;
+    http_header_t *h;
+
+    rc = snprintf(head, size, "%s %s %s\r\n", http_str(buf, resp->version),
+		  http_str(buf, resp->status), http_str(buf, resp->reason));
+    if (rc < 0 || (len = rc) >= size)
+	return -1;
+    for (i = 0; i < resp->nheaders; i++) {
+	h = &resp->headers[i];
+	name = http_str(buf, h->name);
+	if (!strcasecmp(name, "Connection") ||
+	    !strcasecmp(name, "Keep-Alive") ||
+	    !strcasecmp(name, "Proxy-Connection"))
+	    continue;
+	rc = snprintf(head + len, size - len, "%s: %s\r\n", name,
+		      http_str(buf, h->value));
+	if (rc < 0 || (len += rc) >= size)
+	    return -1;
+    }
+    rc = snprintf(head + len, size - len, "Connection: close\r\n\r\n");
+    if (rc < 0 || (len += rc) >= size)
+	return -1;
+    return len;
+}
+
+/*
+ * relay_response - relay the response whose head resp has been read
+ *     into rp's buffer to the client on connfd and to the followers of
+ *     flight f as it arrives, keeping a copy to cache under uri if it
+ *     is a 200 that is complete within the object limit. Keeps going
+ *     for the followers if the client leaves. A body that is neither
+ *     cached nor followed is moved with rio_splice, socket to socket.
+ *     Returns 1 if the origin connection can carry another request,
+ *     and ends f.
+ */
+static int relay_response(rio_t *rp, http_req_t *resp, int connfd, char *uri,
+			  flight_t *f)
+{
+    int hlen, keepalive, ok = 1, client = 1;
+    char *buf = rp->rio_bufptr, *status, *value, *obj = NULL;
+    char head[PROXY_HEADMAX];
+    ssize_t n;
+    size_t size = 0, maxobj = proxy_cache ? proxy_cache->maxobj : 0;
+    long remaining = -1;        /* Body bytes still to come; -1: until EOF */
+    http_header_t *h;
+    riow_t out;
+
+    /* Work out where the body ends and whether the origin keeps the line */
+    http_terminate(resp, buf);
+    status = http_str(buf, resp->status);
+    h = http_header(resp, buf, "Connection");
+    value = h ? http_str(buf, h->value) : "";
+    if (!strcmp(http_str(buf, resp->version), "HTTP/1.1"))
+	keepalive = strcasecmp(value, "close") != 0;
+    else
+	keepalive = strcasecmp(value, "keep-alive") == 0;
+    if (status[0] == '1' || !strcmp(status, "204") || !strcmp(status, "304"))
+	remaining = 0;
+    else if ((h = http_header(resp, buf, "Content-length")) &&
+	     !http_header(resp, buf, "Transfer-Encoding"))
+	remaining = strtol(http_str(buf, h->value), NULL, 10);
+    if (remaining < 0)
+	keepalive = 0;
+
+    /* Send the head and whatever of the body came with it */
+    if ((hlen = rewrite_head(resp, buf, head, sizeof(head))) < 0) {
+	flight_finish(&flights, f, 0);
+	proxy_error(connfd, uri, "502", "Bad Gateway",
+		    "Proxy got a response head it couldn't relay");
+	return 0;
+    }
+    rio_consume(rp, resp->hdrlen);
+    n = rp->rio_cnt;
+    if (remaining >= 0 && n > remaining) {
+	n = remaining;          /* Origin sent more than it said: don't reuse */
+	keepalive = 0;
+    }
+    if (maxobj > 0 && !strcmp(status, "200") &&
+	(remaining < 0 || hlen + remaining <= maxobj)) {
+	obj = Malloc(maxobj);
+	memcpy(obj, head, hlen);
+	size = hlen;
+    }
+    rio_writeinitb(&out, connfd);
+    rio_writeb_ref(&out, head, hlen);
+    flight_append(&flights, f, head, hlen);
+
+    /* Then stream the rest of the body from the origin */
+    while (1) {
+	if (n > 0) {
+	    if (remaining > 0)
+		remaining -= n;
+	    flight_append(&flights, f, rp->rio_bufptr, n);
+	    if (client)
+		rio_writeb_ref(&out, rp->rio_bufptr, n);
+	    if (obj && size + n <= maxobj) {
+		memcpy(obj + size, rp->rio_bufptr, n);
+		size += n;
+	    }
+	    else if (obj) {     /* Too big to cache: just relay the rest */
+		free(obj);
+		obj = NULL;
+	    }
+	}
+	if (client && out.riow_niov > 0 && rio_flushb(&out) < 0)
+	    client = 0;         /* Our client went away */
+	if (n > 0)
+	    rio_consume(rp, n);
+	if (!client && flight_followers(f) == 0) {
+	    ok = 0;             /* Nobody is left to relay to */
+	    break;
+	}
+	if (remaining == 0)
+	    break;
+	if (!obj && client && flight_bypass(&flights, f)) {
+	    /* Nobody needs the rest in user space: splice it across */
+	    n = rio_splice(connfd, rp->rio_fd,
+			   remaining < 0 ? RIO_ALL : (size_t)remaining);
+	    ok = n >= 0 && (remaining < 0 || n == remaining);
+	    break;
+	}
+	if ((n = rio_fill(rp)) <= 0) {
+	    ok = n == 0 && remaining < 0;   /* EOF ends only unframed bodies */
+	    break;
+	}
+	if (remaining >= 0 && n > remaining) {
+	    n = remaining;
+	    keepalive = 0;
+	}
+    }
+
+    /* Cache it before ending the flight, so no later miss refetches it */
+    if (ok && obj) {
+	obj = Realloc(obj, size);
+	cache_release(proxy_cache,
+		      cache_insert(proxy_cache, uri, obj, size, 0, NULL));
+    }
+    else
+	free(obj);
+    flight_finish(&flights, f, ok);
+    return ok && keepalive;
+}
+
+/*
+ * proxy_error - send the client an error page
+ */
+static void proxy_error(int fd, char *cause, char *errnum,
+			char *shortmsg, char *longmsg)
+{
+    char body[MAXBUF];
+    int len;
+    riow_t out;
+
+    len = snprintf(body, sizeof(body), "<html><title>Proxy Error</title>"
+		   "<body bgcolor=ffffff>\r\n%s: %s\r\n<p>%s: %.*s\r\n"
+		   "<hr><em>The proxy</em>\r\n", errnum, shortmsg, longmsg,
+		   MAXLINE, cause);
+    if (len >= (int)sizeof(body))
+	len = sizeof(body) - 1;
+
+    rio_writeinitb(&out, fd);
+    rio_printfb(&out, "HTTP/1.0 %s %s\r\n", errnum, shortmsg);
+    rio_printfb(&out, "Connection: close\r\n");
+    rio_printfb(&out, "Content-type: text/html\r\n");
+    rio_printfb(&out, "Content-length: %d\r\n\r\n", len);
+    rio_writeb(&out, body, len);
+    rio_flushb(&out);
+}
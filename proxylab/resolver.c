@@ -0,0 +1,307 @@
+/*
+ * resolver.c - A thread-safe, caching name resolver. See resolver.h.
+ */
+#include "resolver.h"
+
+#define REFRESH_PERIOD 1       /* Seconds between refresher passes */
+
+#define atomic_inc(p) __atomic_add_fetch((p), 1, __ATOMIC_RELAXED)
+#define atomic_dec(p) __atomic_sub_fetch((p), 1, __ATOMIC_ACQ_REL)
+
+static void *refresher(void *vargp);
+
+/* now - seconds on a clock that never jumps */
+static time_t now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
+
+/* hash - FNV-1a hash of a host */
+static unsigned long hash(const char *key)
+{
+    unsigned long h = 14695981039346656037UL;
+
+    while (*key) {
+	h ^= (unsigned char)*key++;
+	h *= 1099511628211UL;
+    }
+    return h;
+}
+
+/* dupstr - a malloc'd copy of s */
+static char *dupstr(const char *s)
+{
+    char *p = Malloc(strlen(s) + 1);
+
+    strcpy(p, s);
+    return p;
+}
+
+/*
+ * resolv_init - create an empty resolver that keeps answers for ttl
+ *     seconds and failures for negttl seconds, and start its refresher
+ */
+void resolv_init(resolver_t *rs, int ttl, int negttl)
+{
+    int rc;
+    pthread_t tid;
+
+    if ((rc = pthread_mutex_init(&rs->lock, NULL)) != 0)
+	posix_error(rc, "pthread_mutex_init error");
+    pthread_cond_init(&rs->done, NULL);
+    rs->nbuckets = 256;
+    rs->buckets = Calloc(rs->nbuckets, sizeof(rentry_t *));
+    rs->ttl = ttl;
+    rs->negttl = negttl;
+    memset(&rs->stats, 0, sizeof(rs->stats));
+    Pthread_create(&tid, NULL, refresher, rs);
+}
+
+/*
+ * query - look e up for real, without the lock, and return a new
+ *     answer holding one reference
+ */
+static resolv_answer_t *query(rentry_t *e)
+{
+    struct addrinfo hints;
+    char name[NI_MAXHOST];
+    resolv_answer_t *ans = Calloc(1, sizeof(resolv_answer_t));
+
+    ans->refcnt = 1;
+    if (e->reverse) {
+	ans->err = getnameinfo((SA *)&e->addr, e->addrlen, name, sizeof(name),
+			       NULL, 0, NI_NAMEREQD);
+	if (!ans->err)
+	    ans->name = dupstr(name);
+    }
+    else {
+	memset(&hints, 0, sizeof(struct addrinfo));
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_NUMERICSERV | AI_ADDRCONFIG;
+	ans->err = getaddrinfo(e->host, e->port, &hints, &ans->ai);
+    }
+    return ans;
+}
+
+/*
+ * resolv_release - give back a reference to an answer
+ */
+void resolv_release(resolv_answer_t *ans)
+{
+    if (atomic_dec(&ans->refcnt) > 0)
+	return;
+    if (ans->ai)
+	freeaddrinfo(ans->ai);
+    free(ans->name);
+    Free(ans);
+}
+
+/*
+ * install - make ans e's answer (dropping the old one). Caller holds
+ *     the lock.
+ */
+static void install(resolver_t *rs, rentry_t *e, resolv_answer_t *ans)
+{
+    if (e->ans)
+	resolv_release(e->ans);
+    e->ans = ans;
+    e->expires = now() + (ans->err ? rs->negttl : rs->ttl);
+    pthread_cond_broadcast(&rs->done);
+}
+
+/*
+ * cached - return a referenced answer for the entry (reverse, host,
+ *     port), looking it up if it isn't cached or has expired. sa is
+ *     the address to look up if reverse.
+ */
+static resolv_answer_t *cached(resolver_t *rs, int reverse, const char *host,
+			       const char *port, const struct sockaddr *sa,
+			       socklen_t salen)
+{
+    rentry_t *e, **bucket;
+    resolv_answer_t *ans;
+
+    pthread_mutex_lock(&rs->lock);
+    bucket = &rs->buckets[hash(host) & (rs->nbuckets - 1)];
+    for (e = *bucket; e; e = e->next)
+	if (e->reverse == reverse && !strcmp(e->host, host) &&
+	    (reverse || !strcmp(e->port, port)))
+	    break;
+
+    if (!e) {                   /* First time: look it up ourselves */
+	e = Calloc(1, sizeof(rentry_t));
+	e->host = dupstr(host);
+	e->reverse = reverse;
+	if (reverse) {
+	    memcpy(&e->addr, sa, salen);
+	    e->addrlen = salen;
+	}
+	else
+	    e->port = dupstr(port);
+	e->next = *bucket;
+	*bucket = e;
+	rs->stats.entries++;
+	rs->stats.misses++;
+	pthread_mutex_unlock(&rs->lock);
+	ans = query(e);
+	pthread_mutex_lock(&rs->lock);
+	install(rs, e, ans);
+    }
+    else if (!e->ans) {         /* Someone else is looking it up */
+	rs->stats.misses++;
+	while (!e->ans)
+	    pthread_cond_wait(&rs->done, &rs->lock);
+    }
+    else if (e->expires <= now() && !e->refreshing) {
+	/* Expired, and the refresher didn't get to it: look it up again,
+	   letting other callers use the old answer meanwhile */
+	e->refreshing = 1;
+	rs->stats.misses++;
+	pthread_mutex_unlock(&rs->lock);
+	ans = query(e);
+	pthread_mutex_lock(&rs->lock);
+	install(rs, e, ans);
+	e->refreshing = 0;
+    }
+    else {
+	rs->stats.hits++;
+	if (e->ans->err)
+	    rs->stats.negative++;
+    }
+
+    e->used = 1;
+    ans = e->ans;
+    atomic_inc(&ans->refcnt);
+    pthread_mutex_unlock(&rs->lock);
+    return ans;
+}
+
+/*
+ * refresher - thread routine: look up used names shortly before their
+ *     answers expire, and drop names nobody used before they expired.
+ *     Only this thread removes entries, so an entry it is refreshing
+ *     (without the lock) stays put.
+ */
+static void *refresher(void *vargp)
+{
+    resolver_t *rs = vargp;
+    rentry_t *e, **pp;
+    resolv_answer_t *ans;
+    time_t t, ahead = rs->ttl / 5 > 1 ? rs->ttl / 5 : 1;
+    size_t i;
+
+    Pthread_detach(pthread_self());
+    while (1) {
+	sleep(REFRESH_PERIOD);
+	pthread_mutex_lock(&rs->lock);
+	for (i = 0; i < rs->nbuckets; i++) {
+	    for (pp = &rs->buckets[i]; (e = *pp) != NULL; ) {
+		t = now();
+		if (!e->ans || e->refreshing) {
+		    pp = &e->next;
+		    continue;
+		}
+		if (e->expires <= t && !e->used) {
+		    *pp = e->next;
+		    resolv_release(e->ans);
+		    free(e->host);
+		    free(e->port);
+		    Free(e);
+		    rs->stats.entries--;
+		    continue;
+		}
+		if (e->used && !e->ans->err && e->expires - t <= ahead) {
+		    e->refreshing = 1;
+		    e->used = 0;
+		    pthread_mutex_unlock(&rs->lock);
+		    ans = query(e);
+		    pthread_mutex_lock(&rs->lock);
+		    if (ans->err)       /* Keep serving the old answer */
+			resolv_release(ans);
+		    else
+			install(rs, e, ans);
+		    e->refreshing = 0;
+		    rs->stats.refreshes++;
+		}
+		pp = &e->next;
+	    }
+	}
+	pthread_mutex_unlock(&rs->lock);
+    }
+    return NULL;
+}
+
+/*
+ * resolv_lookup - return a referenced answer with the addresses of
+ *     host:port (port numeric), or with err set if it doesn't resolve
+ */
+resolv_answer_t *resolv_lookup(resolver_t *rs, const char *host,
+			       const char *port)
+{
+    return cached(rs, 0, host, port, NULL, 0);
+}
+
+/*
+ * resolv_reverse - copy the host name of the address sa into host, or
+ *     its numeric form if it has none. Returns 0, or a getnameinfo
+ *     error if not even the numeric form could be had.
+ */
+int resolv_reverse(resolver_t *rs, const struct sockaddr *sa, socklen_t salen,
+		   char *host, size_t hostlen)
+{
+    int rc;
+    char numeric[NI_MAXHOST];
+    resolv_answer_t *ans;
+
+    if ((rc = getnameinfo(sa, salen, numeric, sizeof(numeric), NULL, 0,
+			  NI_NUMERICHOST)) != 0)
+	return rc;
+    ans = cached(rs, 1, numeric, NULL, sa, salen);
+    snprintf(host, hostlen, "%s", ans->name ? ans->name : numeric);
+    resolv_release(ans);
+    return 0;
+}
+
+/*
+ * resolv_connect - open_clientfd, with the name lookup from the cache.
+ *     Returns a connected descriptor, -2 if host:port doesn't resolve,
+ *     or -1 with errno set if no address could be connected to.
+ */
+int resolv_connect(resolver_t *rs, char *host, char *port)
+{
+    int clientfd = -1, saved;
+    struct addrinfo *p;
+    resolv_answer_t *ans;
+
+    ans = resolv_lookup(rs, host, port);
+    if (ans->err) {
+	resolv_release(ans);
+	return -2;
+    }
+    for (p = ans->ai; p; p = p->ai_next) {
+	if ((clientfd = socket(p->ai_family, p->ai_socktype,
+			       p->ai_protocol)) < 0)
+	    continue;
+	if (connect(clientfd, p->ai_addr, p->ai_addrlen) == 0)
+	    break;
+	saved = errno;
+	close(clientfd);
+	errno = saved;
+	clientfd = -1;
+    }
+    resolv_release(ans);
+    return clientfd;
+}
+
+/*
+ * resolv_getstats - copy out the resolver's counters
+ */
+void resolv_getstats(resolver_t *rs, resolv_stats_t *st)
+{
+    pthread_mutex_lock(&rs->lock);
+    *st = rs->stats;
+    pthread_mutex_unlock(&rs->lock);
+}
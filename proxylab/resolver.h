@@ -0,0 +1,72 @@
+/*
+ * resolver.h - A thread-safe, caching name resolver.
+ *
+ * getaddrinfo and getnameinfo are reentrant but slow: each call may
+ * read /etc/hosts and query DNS. The resolver remembers their answers,
+ * forward (host and port to addresses) and reverse (address to host
+ * name), for ttl seconds, and failures for negttl seconds, so a name
+ * that doesn't resolve doesn't cost a query per request either.
+ *
+ * Neither call reports a TTL, so every answer gets the same one. A
+ * background thread looks names up again shortly before their answers
+ * expire, as long as they have been used since the last lookup, so
+ * hot names never make a caller wait; names nobody asks for are
+ * dropped when they expire. Threads that miss on the same name at once
+ * wait for one lookup instead of each making their own.
+ *
+ * Answers are reference counted: the addresses from resolv_lookup stay
+ * valid until resolv_release, even if a refresh replaces them.
+ */
+#ifndef __RESOLVER_H__
+#define __RESOLVER_H__
+
+#include "csapp.h"
+
+typedef struct {
+    int refcnt;
+    int err;                   /* getaddrinfo/getnameinfo error, or 0 */
+    struct addrinfo *ai;       /* Forward answers: the addresses */
+    char *name;                /* Reverse answers: the host name */
+} resolv_answer_t;
+
+typedef struct rentry {
+    char *host;                /* Host name, or numeric address if reverse */
+    char *port;                /* Forward lookups: the port */
+    int reverse;               /* Is this a reverse lookup? */
+    struct sockaddr_storage addr; /* Reverse lookups: the address */
+    socklen_t addrlen;
+    resolv_answer_t *ans;      /* NULL while the first lookup runs */
+    time_t expires;
+    int used;                  /* Asked for since the last lookup? */
+    int refreshing;            /* Is the refresher looking it up? */
+    struct rentry *next;       /* Hash chain */
+} rentry_t;
+
+typedef struct {
+    unsigned long hits;        /* Answered from the cache */
+    unsigned long misses;      /* Had to wait for a lookup */
+    unsigned long negative;    /* Hits on a cached failure */
+    unsigned long refreshes;   /* Lookups made ahead of expiry */
+    int entries;
+} resolv_stats_t;
+
+typedef struct {
+    pthread_mutex_t lock;      /* Protects everything below */
+    pthread_cond_t done;       /* Broadcast when a lookup finishes */
+    rentry_t **buckets;        /* Hash table of entries by host */
+    size_t nbuckets;           /* Power of two */
+    int ttl;                   /* Seconds an answer is kept */
+    int negttl;                /* Seconds a failure is kept */
+    resolv_stats_t stats;
+} resolver_t;
+
+void resolv_init(resolver_t *rs, int ttl, int negttl);
+resolv_answer_t *resolv_lookup(resolver_t *rs, const char *host,
+			       const char *port);
+int resolv_reverse(resolver_t *rs, const struct sockaddr *sa, socklen_t salen,
+		   char *host, size_t hostlen);
+void resolv_release(resolv_answer_t *ans);
+int resolv_connect(resolver_t *rs, char *host, char *port);
+void resolv_getstats(resolver_t *rs, resolv_stats_t *st);
+
+#endif /* __RESOLVER_H__ */
@@ -0,0 +1,126 @@
+/*
+ * staticbench.c - Compare Tiny's two static body paths by file size.
+ *
+ *     usage: staticbench [-s secs] [maxsize]
+ *
+ * For file sizes from 1 KB up to maxsize (default 64 MB), repeatedly
+ * sends a small response header followed by the file over a loopback
+ * TCP connection, once with the mmap path (rio_mmapwrite, which maps
+ * the file and writes from the mapping) and once with the sendfile
+ * path (rio_sendfile). Like serve_static, every response opens the
+ * file afresh and sends the header with rio_sendmore. A second thread
+ * drains the other end of the connection. Reports responses per
+ * second, throughput, and sender CPU time per response for each path.
+ */
+#include "csapp.h"
+
+#define HDRLEN 128     /* About the size of Tiny's static response head */
+
+typedef ssize_t (*bodyfn_t)(int outfd, int infd, off_t offset, size_t n);
+
+/* drain - thread routine: read and discard everything on fd */
+static void *drain(void *vargp)
+{
+    int fd = *(int *)vargp;
+    char *buf = Malloc(1 << 20);
+
+    while (read(fd, buf, 1 << 20) > 0)
+	;
+    return NULL;
+}
+
+static double now(clockid_t clock)
+{
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * run - send header+body responses of size bytes through body for
+ *     secs seconds; report responses/s, MB/s, and CPU us/response
+ */
+static void run(int sockfd, char *filename, size_t size, bodyfn_t body,
+		double secs, double *rps, double *mbps, double *cpuus)
+{
+    int fd;
+    long n = 0;
+    char hdr[HDRLEN];
+    double start, stop, cpu;
+
+    memset(hdr, 'h', HDRLEN);
+    start = now(CLOCK_MONOTONIC);
+    cpu = now(CLOCK_THREAD_CPUTIME_ID);
+    do {
+	fd = Open(filename, O_RDONLY, 0);
+	if (rio_sendmore(sockfd, hdr, HDRLEN) < 0 ||
+	    body(sockfd, fd, 0, size) != size)
+	    unix_error("send error");
+	Close(fd);
+	n++;
+    } while ((stop = now(CLOCK_MONOTONIC)) - start < secs);
+    cpu = now(CLOCK_THREAD_CPUTIME_ID) - cpu;
+
+    *rps = n / (stop - start);
+    *mbps = *rps * (size + HDRLEN) / (1 << 20);
+    *cpuus = cpu * 1e6 / n;
+}
+
+int main(int argc, char **argv)
+{
+    int c, listenfd, clientfd, serverfd, filefd;
+    size_t size, maxsize = 64 << 20;
+    double secs = 1.0, rps[2], mbps[2], cpuus[2];
+    char port[16], filename[] = "/tmp/staticbenchXXXXXX", *buf;
+    struct sockaddr_storage addr;
+    socklen_t addrlen = sizeof(addr);
+    pthread_t tid;
+
+    while ((c = getopt(argc, argv, "s:")) != -1) {
+	if (c == 's')
+	    secs = atof(optarg);
+	else {
+	    fprintf(stderr, "usage: %s [-s secs] [maxsize]\n", argv[0]);
+	    exit(1);
+	}
+    }
+    if (optind < argc)
+	maxsize = strtoul(argv[optind], NULL, 0);
+    Signal(SIGPIPE, SIG_IGN);
+
+    /* A file big enough for the largest size */
+    filefd = mkstemp(filename);
+    if (filefd < 0)
+	unix_error("mkstemp error");
+    buf = Malloc(1 << 20);
+    memset(buf, 'x', 1 << 20);
+    for (size = 0; size < maxsize; size += 1 << 20)
+	Write(filefd, buf, 1 << 20);
+    Close(filefd);
+
+    /* A loopback connection with a thread draining the far end */
+    listenfd = Open_listenfd("0");
+    if (getsockname(listenfd, (SA *)&addr, &addrlen) < 0)
+	unix_error("getsockname error");
+    Getnameinfo((SA *)&addr, addrlen, NULL, 0, port, sizeof(port),
+		NI_NUMERICSERV);
+    clientfd = Open_clientfd("localhost", port);
+    serverfd = Accept(listenfd, NULL, NULL);
+    Pthread_create(&tid, NULL, drain, &clientfd);
+
+    printf("%10s %12s %10s %9s %12s %10s %9s\n", "size",
+	   "mmap resp/s", "MB/s", "cpu us", "sendfile/s", "MB/s", "cpu us");
+    for (size = 1024; size <= maxsize; size *= 4) {
+	run(serverfd, filename, size, rio_mmapwrite, secs,
+	    &rps[0], &mbps[0], &cpuus[0]);
+	run(serverfd, filename, size, rio_sendfile, secs,
+	    &rps[1], &mbps[1], &cpuus[1]);
+	printf("%10zu %12.0f %10.1f %9.1f %12.0f %10.1f %9.1f\n", size,
+	       rps[0], mbps[0], cpuus[0], rps[1], mbps[1], cpuus[1]);
+	fflush(stdout);
+    }
+
+    unlink(filename);
+    exit(0);
+}
@@ -0,0 +1,200 @@
+/*
+ * timerwheel.c - A hierarchical timing wheel. See timerwheel.h.
+ */
+#include "csapp.h"
+#include "timerwheel.h"
+
+#define TW_MASK  (TW_SLOTS - 1)
+#define TW_SPAN  (1UL << (TW_BITS * TW_LEVELS))  /* Ticks the wheel reaches */
+
+static void list_add(tw_timer_t *head, tw_timer_t *t)
+{
+    t->prev = head->prev;
+    t->next = head;
+    head->prev->next = t;
+    head->prev = t;
+}
+
+static void list_del(tw_timer_t *t)
+{
+    t->prev->next = t->next;
+    t->next->prev = t->prev;
+    t->prev = t->next = NULL;
+}
+
+static int list_empty(tw_timer_t *head)
+{
+    return head->next == head;
+}
+
+/*
+ * tw_clock - the monotonic clock in milliseconds
+ */
+long tw_clock(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
+/*
+ * tw_init - start an empty wheel of tickms ticks at time now (ms)
+ */
+void tw_init(tw_t *w, long tickms, long now)
+{
+    int l, s;
+
+    w->tickms = tickms;
+    w->origin = now;
+    w->now = 0;
+    w->count = 0;
+    for (l = 0; l < TW_LEVELS; l++)
+	for (s = 0; s < TW_SLOTS; s++)
+	    w->slots[l][s].prev = w->slots[l][s].next = &w->slots[l][s];
+    w->expired.prev = w->expired.next = &w->expired;
+}
+
+/*
+ * tw_timer_init - set up a timer, unarmed, for its owner data
+ */
+void tw_timer_init(tw_timer_t *t, void *data)
+{
+    t->expires = 0;
+    t->kind = -1;
+    t->data = data;
+    t->prev = t->next = NULL;
+}
+
+/*
+ * place - link t into the slot for its tick: on the lowest level whose
+ *     span covers the time left until it is due
+ */
+static void place(tw_t *w, tw_timer_t *t)
+{
+    unsigned long delta;
+    int l;
+
+    if (t->expires < w->now)
+	t->expires = w->now;
+    if ((delta = t->expires - w->now) >= TW_SPAN)
+	t->expires = w->now + (delta = TW_SPAN - 1);
+    for (l = 0; l < TW_LEVELS - 1; l++)
+	if (delta < 1UL << (TW_BITS * (l + 1)))
+	    break;
+    list_add(&w->slots[l][(t->expires >> (TW_BITS * l)) & TW_MASK], t);
+}
+
+/*
+ * tw_arm - arm t to expire at time when (ms), or move it there if it
+ *     is armed already, noting kind in it
+ */
+void tw_arm(tw_t *w, tw_timer_t *t, int kind, long when)
+{
+    if (t->next)
+	list_del(t);
+    else
+	w->count++;
+    t->kind = kind;
+    t->expires = when <= w->origin ? 0 :
+	(when - w->origin + w->tickms - 1) / w->tickms;  /* Never early */
+    place(w, t);
+}
+
+/*
+ * tw_cancel - disarm t, if it is armed
+ */
+void tw_cancel(tw_t *w, tw_timer_t *t)
+{
+    if (t->next) {
+	list_del(t);
+	w->count--;
+    }
+}
+
+/*
+ * tick - advance the wheel by one tick: whenever a level comes round,
+ *     spread the next slot of the level above it out over the levels
+ *     below, then move the timers due now onto the expired list
+ */
+static void tick(tw_t *w)
+{
+    tw_timer_t *head, *t;
+    int l;
+
+    for (l = 1; l < TW_LEVELS &&
+	     (w->now & ((1UL << (TW_BITS * l)) - 1)) == 0; l++) {
+	head = &w->slots[l][(w->now >> (TW_BITS * l)) & TW_MASK];
+	while ((t = head->next) != head) {
+	    list_del(t);
+	    place(w, t);
+	}
+    }
+    head = &w->slots[0][w->now & TW_MASK];
+    while ((t = head->next) != head) {
+	list_del(t);
+	list_add(&w->expired, t);
+    }
+    w->now++;
+}
+
+/*
+ * tw_expire - bring the wheel up to time now (ms) and return a timer
+ *     that is due, disarmed, or NULL if none is. Call it until it
+ *     returns NULL.
+ */
+tw_timer_t *tw_expire(tw_t *w, long now)
+{
+    unsigned long target;
+    tw_timer_t *t;
+
+    if (now >= w->origin) {
+	target = (now - w->origin) / w->tickms;
+	if (w->count == 0 && w->now <= target)
+	    w->now = target + 1;        /* Nothing to pass on the way */
+	while (w->now <= target)
+	    tick(w);
+    }
+    if (list_empty(&w->expired))
+	return NULL;
+    t = w->expired.next;
+    list_del(t);
+    w->count--;
+    return t;
+}
+
+/*
+ * tw_timeout - milliseconds from now until the next tick at which a
+ *     timer may expire, for epoll_wait and the like: up to maxms, or
+ *     -1 (forever) if nothing is armed and maxms is -1. Looks no more
+ *     than one turn of level 1 ahead.
+ */
+int tw_timeout(tw_t *w, long now, int maxms)
+{
+    unsigned long t, end;
+    long ms;
+    int l, found;
+
+    if (w->count == 0)
+	return maxms;
+    if (!list_empty(&w->expired))
+	return 0;
+    end = w->now + TW_SLOTS * TW_SLOTS;
+    if (maxms >= 0 && w->now + maxms / w->tickms + 1 < end)
+	end = w->now + maxms / w->tickms + 1;
+    for (t = w->now; t < end; t++) {
+	found = !list_empty(&w->slots[0][t & TW_MASK]);
+	/* A level coming round may bring timers down to level 0 */
+	for (l = 1; !found && l < TW_LEVELS &&
+		 (t & ((1UL << (TW_BITS * l)) - 1)) == 0; l++)
+	    found = !list_empty(&w->slots[l][(t >> (TW_BITS * l)) & TW_MASK]);
+	if (found)
+	    break;
+    }
+    ms = w->origin + (long)t * w->tickms - now;
+    if (ms < 0)
+	ms = 0;
+    if (maxms >= 0 && ms > maxms)
+	ms = maxms;
+    return ms;
+}
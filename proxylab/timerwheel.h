@@ -0,0 +1,50 @@
+/*
+ * timerwheel.h - A hierarchical timing wheel for connection deadlines.
+ *
+ * Time is counted in ticks of tickms milliseconds. The wheel has
+ * TW_LEVELS levels of TW_SLOTS slots each: a slot on level 0 holds the
+ * timers due in one tick, a slot on level 1 those due in one turn of
+ * level 0, and so on, so four levels of 64 reach 2^24 ticks ahead
+ * (nearly two days of 10 ms ticks; anything later waits in the last
+ * slot). Timers are linked into their slot's list through themselves,
+ * so arming, re-arming and cancelling one are a few pointer updates
+ * whatever the number of timers. As time passes, the slots of level 0
+ * are emptied in turn, and each time level 0 comes round, the next
+ * slot up is spread out over the level below it.
+ *
+ * The wheel takes no lock: it belongs to one event loop.
+ */
+#ifndef __TIMERWHEEL_H__
+#define __TIMERWHEEL_H__
+
+#define TW_BITS   6
+#define TW_SLOTS  (1 << TW_BITS)
+#define TW_LEVELS 4
+
+typedef struct tw_timer {
+    unsigned long expires;     /* Tick it is due in */
+    int kind;                  /* The owner's: why it was armed */
+    void *data;                /* The owner's */
+    struct tw_timer *prev;     /* Neighbors in its slot (or the expired */
+    struct tw_timer *next;     /*   list); NULL while it isn't armed */
+} tw_timer_t;
+
+typedef struct {
+    long tickms;               /* Milliseconds per tick */
+    long origin;               /* Time (ms) of tick 0 */
+    unsigned long now;         /* Next tick whose slot is emptied */
+    unsigned long count;       /* Timers armed, including those expired
+				  but not yet collected */
+    tw_timer_t slots[TW_LEVELS][TW_SLOTS];  /* List heads */
+    tw_timer_t expired;        /* Due, not yet collected by tw_expire */
+} tw_t;
+
+long tw_clock(void);
+void tw_init(tw_t *w, long tickms, long now);
+void tw_timer_init(tw_timer_t *t, void *data);
+void tw_arm(tw_t *w, tw_timer_t *t, int kind, long when);
+void tw_cancel(tw_t *w, tw_timer_t *t);
+tw_timer_t *tw_expire(tw_t *w, long now);
+int tw_timeout(tw_t *w, long now, int maxms);
+
+#endif /* __TIMERWHEEL_H__ */
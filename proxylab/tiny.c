@@ -1,114 +1,628 @@
 /* $begin tinymain */
 /*
  * tiny.c - A simple, iterative HTTP/1.0 Web server that uses the 
- *     GET method to serve static and dynamic content.
+ *     GET method to serve static and dynamic content. Connections
+ *     persist across requests (HTTP/1.1, or HTTP/1.0 with
+ *     "Connection: keep-alive"), and pipelined requests are answered
+ *     in order.
+ *
+ *     usage: tiny [-e | -u] [-t nthreads [-T maxthreads]] [-s nshards [-C]]
+ *                 [-k maxreqs] [-i idlesecs] [-H headersecs] [-W writesecs]
+ *                 [-m] [-c cachebytes] [-r] [-f cgiworkers] [-l every]
+ *                 [-M mimetypes] <port>
+ *
+ *     -e  Serve every connection from one edge-triggered epoll event
+ *         loop (tiny_epoll.c) instead of one connection at a time.
+ *     -u  Serve every connection from one io_uring event loop
+ *         (tiny_uring.c), which submits its accepts, reads and writes
+ *         in batches; falls back to -e if the kernel can't.
+ *     -t  Accept on the main thread and serve connections from a pool
+ *         of nthreads prespawned workers (tiny_pool.c) that may grow
+ *         to maxthreads (default 8*nthreads) under load.
+ *     -s  Listen with nshards SO_REUSEPORT sockets, each accepted from
+ *         and served by its own thread (tiny_shard.c), one connection
+ *         at a time (with keep-alive off, so that no idle client
+ *         holds up a shard's queue) or, with -e, from its own epoll
+ *         loop.
+ *     -C  Pin shard i to CPU i, and have the kernel hand it the
+ *         connections that arrive on that CPU.
+ *     -k  Close a persistent connection after maxreqs requests
+ *         (default 100; 1 turns keep-alive off). Ignored, with a
+ *         notice, by -s without -e.
+ *     -i  Close a persistent connection after idlesecs seconds without
+ *         a request (default 5).
+ *     -H  Close a connection whose request head hasn't all arrived
+ *         headersecs seconds after its first byte (default 10).
+ *     -W  Close a connection whose client hasn't taken any more of the
+ *         response for writesecs seconds (default 30).
+ *     -m  Send static file bodies from an mmap of the file rather than
+ *         with sendfile (for comparison; see staticbench.c).
+ *     -c  Keep up to cachebytes (default 16 MB; 0 turns the cache off)
+ *         of small static responses in memory (cache.c), shared by
+ *         every thread and revalidated against the file's size and
+ *         modification time on each hit.
+ *     -r  Log clients by host name rather than by address. Reverse
+ *         lookups go through a caching resolver (resolver.c), so only
+ *         a client's first connection in a while waits for DNS. The
+ *         event loops (-e, -u) always log addresses, since they can't
+ *         wait.
+ *     -f  Run each CGI program as up to cgiworkers persistent worker
+ *         processes (cgipool.c) that answer request after request,
+ *         rather than forking it for every request. Programs must be
+ *         written around cgi_accept (cgiworker.c); others are still
+ *         forked. The event loops (-e, -u) also fork a request that
+ *         finds every worker busy, rather than wait for one.
+ *     -l  Log one connection and one request in every (default 1; 0
+ *         turns the log off). Serving threads queue log records in
+ *         rings of their own, and a background thread writes them to
+ *         stdout in batches (accesslog.c); records that don't fit are
+ *         dropped and counted rather than waited for.
+ *     -M  Read more media types, or other types for known extensions,
+ *         from the file mimetypes (in the form of mime.types) on top of
+ *         those built in (mime.c). May be given more than once.
+ *
+ *     The event loops (-e, -u) keep these deadlines on a timer wheel
+ *     (timerwheel.c); the threads that serve a connection at a time
+ *     keep them with socket timeouts.
+ *
+ *     GET /__stats (or /__stats?json) answers with histograms of how
+ *     long requests spend in each phase, by outcome (latency.c).
+ *
+ *     SIGUSR1 prints the cache's counters (and, with -t, the state of
+ *     the worker pool; with -s, each shard's share of the connections;
+ *     with -f, the CGI workers), the log's counters, and how many
+ *     connections missed each deadline on stderr.
  */
-#include "csapp.h"
+#include "tiny.h"
+#include <spawn.h>
 
-void doit(int fd);
-void read_requesthdrs(rio_t *rp);
-int parse_uri(char *uri, char *filename, char *cgiargs);
-void serve_static(int fd, char *filename, int filesize);
-void get_filetype(char *filename, char *filetype);
-void serve_dynamic(int fd, char *filename, char *cgiargs);
-void clienterror(int fd, char *cause, char *errnum, 
-		 char *shortmsg, char *longmsg);
+int keepalive_max = 100;    /* Requests served per connection */
+int keepalive_timeout = 5;  /* Idle seconds before a connection is closed */
+int header_timeout = 10;    /* Seconds to send a whole request head */
+int write_timeout = 30;     /* Seconds a response may make no progress */
+int static_mmap = 0;        /* Send static bodies with mmap, not sendfile */
+cache_t *static_cache;      /* Cached static responses, or NULL if off */
+resolver_t *client_names;   /* Reverse lookups of clients, or NULL if off */
+cgipool_t *cgi_pool;        /* Persistent CGI workers, or NULL if off */
+
+static cache_t cache;
+static __thread lat_req_t req_lat;  /* Request the thread is serving (doit) */
+static resolver_t resolver;
+static cgipool_t cgipool;
+static unsigned long evictions[DL_NKINDS];  /* Deadlines missed, by kind */
+
+/* CGI children started by spawn_dynamic, for the reporter to reap. The
+   persistent workers (cgipool.c) are the pool's own to wait for. */
+static pid_t *children;
+static int nchildren, maxchildren;
+static pthread_mutex_t children_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Response head templates. Everything in a response head that doesn't
+ * vary per request is spelled out here once, indexed by the RESP_*
+ * flags (bit 0: HTTP/1.1, bit 1: keep-alive), so building a head is a
+ * few memcpys rather than a chain of sprintfs.
+ */
+typedef struct {
+    char *str;
+    size_t len;
+} tmpl_t;
+
+#define TMPL(s) { s, sizeof(s) - 1 }
+
+static tmpl_t status_tmpl[4] = {    /* Static content: status to Connection */
+    TMPL("HTTP/1.0 200 OK\r\nServer: Tiny Web Server\r\nConnection: close\r\n"),
+    TMPL("HTTP/1.1 200 OK\r\nServer: Tiny Web Server\r\nConnection: close\r\n"),
+    TMPL("HTTP/1.0 200 OK\r\nServer: Tiny Web Server\r\n"
+	 "Connection: keep-alive\r\n"),
+    TMPL("HTTP/1.1 200 OK\r\nServer: Tiny Web Server\r\n"
+	 "Connection: keep-alive\r\n"),
+};
+static tmpl_t error_tmpl[4] = {     /* Errors: from after the status line */
+    TMPL("\r\nConnection: close\r\nContent-type: text/html\r\n"),
+    TMPL("\r\nConnection: close\r\nContent-type: text/html\r\n"),
+    TMPL("\r\nConnection: keep-alive\r\nContent-type: text/html\r\n"),
+    TMPL("\r\nConnection: keep-alive\r\nContent-type: text/html\r\n"),
+};
+static tmpl_t cgi_tmpl = TMPL("HTTP/1.0 200 OK\r\nServer: Tiny Web Server\r\n");
+
+#define put(p, s, n)  ((char *)memcpy((p), (s), (n)) + (n))
+#define putlit(p, s)  put((p), (s), sizeof(s) - 1)
+
+static void usage(char *prog)
+{
+    fprintf(stderr, "usage: %s [-e | -u] [-t nthreads [-T maxthreads]] "
+	    "[-s nshards [-C]] [-k maxreqs] [-i idlesecs] [-H headersecs] "
+	    "[-W writesecs] [-m] [-c cachebytes] [-r] [-f cgiworkers] "
+	    "[-l every] [-M mimetypes] <port>\n", prog);
+    exit(1);
+}
+
+/*
+ * child_add - note a CGI child for reap_children, unless it has exited
+ *     already (and is reaped here)
+ */
+static void child_add(pid_t pid)
+{
+    pthread_mutex_lock(&children_lock);
+    if (waitpid(pid, NULL, WNOHANG) == 0) {
+	if (nchildren == maxchildren) {
+	    maxchildren = maxchildren ? 2 * maxchildren : 64;
+	    children = Realloc(children, maxchildren * sizeof(pid_t));
+	}
+	children[nchildren++] = pid;
+    }
+    pthread_mutex_unlock(&children_lock);
+}
+
+/*
+ * reap_children - reap the CGI children that have exited. A pid is
+ *     forgotten as it is reaped, with the lock held, so none is ever
+ *     waited for twice.
+ */
+static void reap_children(void)
+{
+    int i;
+
+    pthread_mutex_lock(&children_lock);
+    for (i = 0; i < nchildren; )
+	if (waitpid(children[i], NULL, WNOHANG) != 0)
+	    children[i] = children[--nchildren];
+	else
+	    i++;
+    pthread_mutex_unlock(&children_lock);
+}
+
+/*
+ * reporter - thread routine: print the server's counters on stderr
+ *     each time SIGUSR1 arrives, and reap CGI children each time
+ *     SIGCHLD does. Every other thread blocks both, so neither ever
+ *     interrupts a request, and no thread serving one waits for a child.
+ */
+static void *reporter(void *vargp)
+{
+    int sig;
+    sigset_t *mask = vargp;
+    cache_stats_t st;
+    cgipool_stats_t cst;
+    alog_stats_t lst;
+
+    Pthread_detach(pthread_self());
+    while (sigwait(mask, &sig) == 0) {
+	if (sig == SIGCHLD) {
+	    reap_children();
+	    continue;
+	}
+	if (static_cache) {
+	    cache_getstats(static_cache, &st);
+	    fprintf(stderr, "tiny: cache: %lu hits, %lu misses, "
+		    "%lu insertions, %lu evictions, %lu invalidations; "
+		    "%d objects, %zu/%zu bytes\n", st.hits, st.misses,
+		    st.insertions, st.evictions, st.invalidations, st.count,
+		    st.bytes, st.maxbytes);
+	}
+	if (cgi_pool) {
+	    cgipool_getstats(cgi_pool, &cst);
+	    fprintf(stderr, "tiny: cgi: %lu requests, %lu waits, %lu forked; "
+		    "%d workers (%d busy), %lu spawns, %lu slow starts, "
+		    "%lu crashes\n", cst.requests, cst.waits, cst.forks,
+		    cst.nworkers, cst.busy, cst.spawns, cst.slowstarts,
+		    cst.crashes);
+	}
+	if (alog_on) {
+	    alog_getstats(&lst);
+	    fprintf(stderr, "tiny: log: %lu records, %lu sampled out, "
+		    "%lu dropped; %d rings\n", lst.logged, lst.skipped,
+		    lst.dropped, lst.rings);
+	}
+	fprintf(stderr, "tiny: deadlines: %lu header, %lu write, %lu idle "
+		"evictions\n",
+		__atomic_load_n(&evictions[DL_HEADER], __ATOMIC_RELAXED),
+		__atomic_load_n(&evictions[DL_WRITE], __ATOMIC_RELAXED),
+		__atomic_load_n(&evictions[DL_IDLE], __ATOMIC_RELAXED));
+	pool_report("pool");
+	shard_report();
+    }
+    return NULL;
+}
 
 int main(int argc, char **argv) 
 {
-    int listenfd, connfd;
-    char hostname[MAXLINE], port[MAXLINE];
+    int listenfd, connfd, c, evented = 0, nthreads = 0, maxthreads = 0;
+    int reverse = 0, nshards = 0, pin = 0, cgiworkers = 0, logevery = 1;
+    int maxreqs = 0;
+    long cachebytes = CACHE_BYTES;
     socklen_t clientlen;
     struct sockaddr_storage clientaddr;
+    static sigset_t mask;
+    pthread_t tid;
 
     /* Check command line args */
-    if (argc != 2) {
-	fprintf(stderr, "usage: %s <port>\n", argv[0]);
-	exit(1);
+    while ((c = getopt(argc, argv, "eut:T:s:Ck:i:H:W:mc:rf:l:M:")) != -1) {
+	switch (c) {
+	case 'e':
+	    evented = 1;
+	    break;
+	case 'u':
+	    evented = 2;
+	    break;
+	case 't':
+	    nthreads = atoi(optarg);
+	    break;
+	case 'T':
+	    maxthreads = atoi(optarg);
+	    break;
+	case 's':
+	    nshards = atoi(optarg);
+	    break;
+	case 'C':
+	    pin = 1;
+	    break;
+	case 'k':
+	    keepalive_max = maxreqs = atoi(optarg);
+	    break;
+	case 'i':
+	    keepalive_timeout = atoi(optarg);
+	    break;
+	case 'H':
+	    header_timeout = atoi(optarg);
+	    break;
+	case 'W':
+	    write_timeout = atoi(optarg);
+	    break;
+	case 'm':
+	    static_mmap = 1;
+	    break;
+	case 'c':
+	    cachebytes = strtol(optarg, NULL, 0);
+	    break;
+	case 'r':
+	    reverse = 1;
+	    break;
+	case 'f':
+	    cgiworkers = atoi(optarg);
+	    break;
+	case 'l':
+	    logevery = atoi(optarg);
+	    break;
+	case 'M':
+	    if (mime_load(optarg) < 0)
+		unix_error(optarg);
+	    break;
+	default:
+	    usage(argv[0]);
+	}
+    }
+    if (optind != argc - 1 || nthreads < 0 || (evented && nthreads) ||
+	nshards < 0 || (nshards && (nthreads || evented == 2)) ||
+	(pin && !nshards) || cgiworkers < 0 || logevery < 0 ||
+	keepalive_max < 1 || keepalive_timeout < 1 || header_timeout < 1 ||
+	write_timeout < 1 || cachebytes < 0)
+	usage(argv[0]);
+
+    if (cachebytes > 0) {
+	cache_init(&cache, cachebytes, CACHE_MAXOBJ);
+	static_cache = &cache;
     }
 
-    listenfd = Open_listenfd(argv[1]);
+    if (cgiworkers > 0) {
+	cgipool_init(&cgipool, cgiworkers);
+	cgi_pool = &cgipool;
+    }
+
+    Signal(SIGPIPE, SIG_IGN);   /* A vanished client must not kill the server */
+
+    /* Block SIGUSR1 and SIGCHLD here so every thread created later
+       inherits the mask, and only the reporter ever takes them */
+    Sigemptyset(&mask);
+    Sigaddset(&mask, SIGUSR1);
+    Sigaddset(&mask, SIGCHLD);
+    Sigprocmask(SIG_BLOCK, &mask, NULL);
+    Pthread_create(&tid, NULL, reporter, &mask);
+    if (logevery > 0)
+	alog_init(logevery);
+
+    if (reverse && !evented) {
+	resolv_init(&resolver, NAMES_TTL, NAMES_NEGTTL);
+	client_names = &resolver;
+    }
+
+    if (nshards && !evented && maxreqs > 1)
+	fprintf(stderr, "tiny: -k %d ignored: without -e, a shard serves "
+		"one request per connection\n", maxreqs);
+    if (nshards)
+	shard_serve(argv[optind], nshards, pin, evented);  /* Does not return */
+    listenfd = Open_listenfd(argv[optind]);
+    if (evented == 2)
+	uring_serve(listenfd);  /* Does not return */
+    if (evented)
+	epoll_serve(listenfd);  /* Does not return */
+    if (nthreads)
+	pool_serve(listenfd, nthreads, maxthreads ? maxthreads : 8 * nthreads);
+
     while (1) {
 	clientlen = sizeof(clientaddr);
 	connfd = Accept(listenfd, (SA *)&clientaddr, &clientlen); //line:netp:tiny:accept
-        Getnameinfo((SA *) &clientaddr, clientlen, hostname, MAXLINE, 
-                    port, MAXLINE, 0);
-        printf("Accepted connection from (%s, %s)\n", hostname, port);
-	doit(connfd);                                             //line:netp:tiny:doit
+	log_client((SA *)&clientaddr, clientlen);
+	serve_client(connfd);                                     //line:netp:tiny:doit
 	Close(connfd);                                            //line:netp:tiny:close
     }
 }
 /* $end tinymain */
 
 /*
- * doit - handle one HTTP request/response transaction
+ * log_client - print the address of a newly accepted client, with
+ *     its host name in place of the address if -r asked for one
  */
-/* $begin doit */
-void doit(int fd) 
+void log_client(struct sockaddr *sa, socklen_t salen)
 {
-    int is_static;
-    struct stat sbuf;
-    char buf[MAXLINE], method[MAXLINE], uri[MAXLINE], version[MAXLINE];
-    char filename[MAXLINE], cgiargs[MAXLINE];
+    char hostname[MAXLINE], port[MAXLINE];
+
+    if (!alog_on || !alog_sample(ALOG_ACCEPT))
+	return;
+    if (getnameinfo(sa, salen, hostname, MAXLINE, port, MAXLINE,
+		    NI_NUMERICHOST | NI_NUMERICSERV) != 0)
+	return;
+    if (client_names)
+	resolv_reverse(client_names, sa, salen, hostname, MAXLINE);
+    alog_accept(hostname, port);
+}
+
+/*
+ * idle_timeout - make a read on fd that waits keepalive_timeout for
+ *     the next request fail with EAGAIN
+ */
+static void idle_timeout(int fd)
+{
+    struct timeval idle = { keepalive_timeout, 0 };
+
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &idle, sizeof(idle));
+}
+
+/*
+ * head_timeout - shorten fd's read timeout to what is left of the
+ *     header_timeout that started with the first byte of the request
+ *     head (*headby, 0 until then). Returns -1 if nothing is left.
+ */
+static int head_timeout(int fd, long *headby)
+{
+    long now = tw_clock(), left;
+    struct timeval tv;
+
+    if (!*headby)
+	*headby = now + deadline_ms(DL_HEADER);
+    if ((left = *headby - now) <= 0)
+	return -1;
+    tv.tv_sec = left / 1000;
+    tv.tv_usec = left % 1000 * 1000;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    return 0;
+}
+
+/*
+ * write_failed - note why a write to a client failed: on a blocking
+ *     socket, one the client has taken nothing of for write_timeout
+ *     fails with EAGAIN (SO_SNDTIMEO)
+ */
+static void write_failed(void)
+{
+    if (errno == EAGAIN || errno == EWOULDBLOCK)
+	deadline_missed(DL_WRITE);
+}
+
+/*
+ * serve_client - answer requests on a connection until the client
+ *     closes it, asks for it to be closed, stays idle for longer than
+ *     keepalive_timeout, or reaches keepalive_max requests, or misses
+ *     the header or write deadline. One rio_t lives for the whole
+ *     connection, so requests the client has pipelined are served
+ *     from its buffer in order.
+ */
+void serve_client(int fd)
+{
+    int nrequests = 0;
+    struct timeval stall = { write_timeout, 0 };
     rio_t rio;
 
-    /* Read request line and headers */
+    idle_timeout(fd);
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &stall, sizeof(stall));
     Rio_readinitb(&rio, fd);
-    if (!Rio_readlineb(&rio, buf, MAXLINE))  //line:netp:doit:readrequest
-        return;
-    printf("%s", buf);
-    sscanf(buf, "%s %s %s", method, uri, version);       //line:netp:doit:parserequest
+    lat_reset(&req_lat);
+    lat_mark(&req_lat, LAT_ACCEPT);
+    while (doit(&rio, ++nrequests))
+	;
+}
+
+/*
+ * doit - handle one HTTP request/response transaction. nrequests
+ *     counts this request among those served on the connection.
+ *     Returns nonzero if the connection should be kept open.
+ *     The request head is parsed where it lies in rp's buffer, and
+ *     the method, URI, and version handed on are strings inside it.
+ *     Its progress is stamped in req_lat and recorded when it is done.
+ *     Once the head has begun, the rest of it must arrive within
+ *     header_timeout.
+ */
+/* $begin doit */
+int doit(rio_t *rp, int nrequests) 
+{
+    int fd = rp->rio_fd, flags, rc, keep;
+    long headby = 0;
+    ssize_t n;
+    char *buf, *method, *uri, *version;
+    http_req_t req;
+    route_t rt;
+
+    /* Read request line and headers */
+    http_init(&req);
+    if (rp->rio_cnt > 0)
+	lat_mark(&req_lat, LAT_FIRST);  /* Pipelined behind the last one */
+    while ((rc = http_parse(&req, rp->rio_bufptr, rp->rio_cnt)) == HTTP_AGAIN) { //line:netp:doit:readrequest
+	if (rp->rio_cnt > 0 && head_timeout(fd, &headby) < 0) {
+	    deadline_missed(DL_HEADER);
+	    return 0;
+	}
+	if ((n = rio_fill(rp)) > 0) {
+	    lat_mark(&req_lat, LAT_FIRST);
+	    continue;
+	}
+	if (n < 0 && errno == ENOBUFS)
+	    break;      /* Headers will never fit */
+	if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+	    deadline_missed(rp->rio_cnt > 0 ? DL_HEADER : DL_IDLE);
+	return 0;       /* Closed, too slow, or failed */
+    }
+    if (headby)
+	idle_timeout(fd);               /* For the next request */
+    lat_mark(&req_lat, LAT_PARSED);
+    if (rc != HTTP_DONE) {
+	req_lat.outcome = LAT_ERROR;
+	keep = clienterror(fd, "request", "400", "Bad Request",
+			   "Tiny couldn't parse the request headers", 0);
+	lat_record(&req_lat);
+	return keep;
+    }
+
+    buf = rp->rio_bufptr;
+    req_lat.in = req.hdrlen;
+    if (alog_on && alog_sample(ALOG_REQUEST))
+	alog_request(buf, req.hdrlen);
+    http_terminate(&req, buf);                           //line:netp:doit:parserequest
+    method = http_str(buf, req.method);
+    uri = http_str(buf, req.uri);
+    version = http_str(buf, req.version);
+    rio_consume(rp, req.hdrlen);        /* Strings stay until the next read */
+    flags = response_flags(method, version,
+			   connection_header(&req, buf), nrequests); //line:netp:doit:readrequesthdrs
+
+    route_request(method, uri, &rt);
+    lat_mark(&req_lat, LAT_ROUTED);
+    if (rt.kind == ROUTE_STATIC) {      /* Serve static content */
+	req_lat.outcome = LAT_STATIC;
+	keep = serve_static(fd, rt.filename, &rt.sbuf, flags); //line:netp:doit:servestatic
+    }
+    else if (rt.kind == ROUTE_DYNAMIC) {/* Serve dynamic content */
+	req_lat.outcome = LAT_DYNAMIC;
+	serve_dynamic(fd, rt.filename, rt.cgiargs);      //line:netp:doit:servedynamic
+	lat_mark(&req_lat, LAT_HEAD);
+	keep = 0;       /* CGI output ends when the connection does */
+    }
+    else if (rt.kind == ROUTE_STATS) {  /* Not recorded itself */
+	char resp[RESPBUF];
+
+	n = stats_response(resp, rt.cgiargs, flags);
+	keep = rio_writen(fd, resp, n) == n && (flags & RESP_KEEPALIVE);
+    }
+    else {
+	req_lat.outcome = LAT_ERROR;
+	keep = clienterror(fd, rt.errcause, rt.errnum, rt.shortmsg,
+			   rt.longmsg, flags);
+    }
+    lat_record(&req_lat);
+    return keep;
+}
+/* $end doit */
+
+/*
+ * response_flags - decide how to answer a request: in HTTP/1.1 if it
+ *     was asked in HTTP/1.1, and whether the connection persists.
+ *     connhdr is the request's Connection header as returned by
+ *     connection_header (-1 if absent). HTTP/1.1 persists unless told
+ *     to close; HTTP/1.0 only on "Connection: keep-alive". Requests
+ *     Tiny doesn't implement may carry a body it can't skip, so they
+ *     always close the connection.
+ */
+int response_flags(char *method, char *version, int connhdr, int nrequests)
+{
+    int flags = 0, keepalive;
+
+    if (!strcmp(version, "HTTP/1.1"))
+	flags |= RESP_HTTP11;
+    keepalive = connhdr < 0 ? (flags & RESP_HTTP11) != 0 : connhdr;
+    if (keepalive && nrequests < keepalive_max && !strcasecmp(method, "GET"))
+	flags |= RESP_KEEPALIVE;
+    return flags;
+}
+
+/*
+ * connection_header - return 1 if the parsed and terminated request
+ *     req in buf asks for keep-alive, 0 if it asks for close, and -1
+ *     if it has no Connection header that says either
+ */
+int connection_header(http_req_t *req, char *buf)
+{
+    char *value;
+    http_header_t *h;
+
+    if (!(h = http_header(req, buf, "Connection")))
+	return -1;
+    value = http_str(buf, h->value);
+    if (!strncasecmp(value, "close", 5))
+	return 0;
+    if (!strncasecmp(value, "keep-alive", 10))
+	return 1;
+    return -1;
+}
+
+/*
+ * route_request - decide how to answer a request for uri. Fills in
+ *     rt->filename, rt->cgiargs, and rt->sbuf, and sets rt->kind to
+ *     ROUTE_STATIC, ROUTE_DYNAMIC, or ROUTE_ERROR (with the error page
+ *     fields set), or to ROUTE_STATS for LAT_URI (with the query in
+ *     rt->cgiargs). Shared by doit and the event loop so both serve
+ *     exactly the same content.
+ */
+void route_request(char *method, char *uri, route_t *rt)
+{
+    int is_static;
+
+    rt->kind = ROUTE_ERROR;
     if (strcasecmp(method, "GET")) {                     //line:netp:doit:beginrequesterr
-        clienterror(fd, method, "501", "Not Implemented",
-                    "Tiny does not implement this method");
-        return;
+	rt->errcause = method;
+	rt->errnum = "501";
+	rt->shortmsg = "Not Implemented";
+	rt->longmsg = "Tiny does not implement this method";
+	return;
     }                                                    //line:netp:doit:endrequesterr
-    read_requesthdrs(&rio);                              //line:netp:doit:readrequesthdrs
+
+    if (!strncmp(uri, LAT_URI, sizeof(LAT_URI) - 1) &&
+	(uri[sizeof(LAT_URI) - 1] == '\0' || uri[sizeof(LAT_URI) - 1] == '?')) {
+	rt->kind = ROUTE_STATS;
+	strncpy(rt->cgiargs, uri[sizeof(LAT_URI) - 1] ? uri + sizeof(LAT_URI) :
+		"", MAXLINE - 1);
+	rt->cgiargs[MAXLINE - 1] = '\0';
+	return;
+    }
 
     /* Parse URI from GET request */
-    is_static = parse_uri(uri, filename, cgiargs);       //line:netp:doit:staticcheck
-    if (stat(filename, &sbuf) < 0) {                     //line:netp:doit:beginnotfound
-	clienterror(fd, filename, "404", "Not found",
-		    "Tiny couldn't find this file");
+    is_static = parse_uri(uri, rt->filename, rt->cgiargs); //line:netp:doit:staticcheck
+    rt->errcause = rt->filename;
+    if (stat(rt->filename, &rt->sbuf) < 0) {             //line:netp:doit:beginnotfound
+	rt->errnum = "404";
+	rt->shortmsg = "Not found";
+	rt->longmsg = "Tiny couldn't find this file";
 	return;
     }                                                    //line:netp:doit:endnotfound
 
     if (is_static) { /* Serve static content */          
-	if (!(S_ISREG(sbuf.st_mode)) || !(S_IRUSR & sbuf.st_mode)) { //line:netp:doit:readable
-	    clienterror(fd, filename, "403", "Forbidden",
-			"Tiny couldn't read the file");
+	if (!(S_ISREG(rt->sbuf.st_mode)) || !(S_IRUSR & rt->sbuf.st_mode)) { //line:netp:doit:readable
+	    rt->errnum = "403";
+	    rt->shortmsg = "Forbidden";
+	    rt->longmsg = "Tiny couldn't read the file";
 	    return;
 	}
-	serve_static(fd, filename, sbuf.st_size);        //line:netp:doit:servestatic
+	rt->kind = ROUTE_STATIC;
     }
     else { /* Serve dynamic content */
-	if (!(S_ISREG(sbuf.st_mode)) || !(S_IXUSR & sbuf.st_mode)) { //line:netp:doit:executable
-	    clienterror(fd, filename, "403", "Forbidden",
-			"Tiny couldn't run the CGI program");
+	if (!(S_ISREG(rt->sbuf.st_mode)) || !(S_IXUSR & rt->sbuf.st_mode)) { //line:netp:doit:executable
+	    rt->errnum = "403";
+	    rt->shortmsg = "Forbidden";
+	    rt->longmsg = "Tiny couldn't run the CGI program";
 	    return;
 	}
-	serve_dynamic(fd, filename, cgiargs);            //line:netp:doit:servedynamic
-    }
-}
-/* $end doit */
-
-/*
- * read_requesthdrs - read HTTP request headers
- */
-/* $begin read_requesthdrs */
-void read_requesthdrs(rio_t *rp) 
-{
-    char buf[MAXLINE];
-
-    Rio_readlineb(rp, buf, MAXLINE);
-    printf("%s", buf);
-    while(strcmp(buf, "\r\n")) {          //line:netp:readhdrs:checkterm
-	Rio_readlineb(rp, buf, MAXLINE);
-	printf("%s", buf);
+	rt->kind = ROUTE_DYNAMIC;
     }
-    return;
 }
-/* $end read_requesthdrs */
 
 /*
  * parse_uri - parse URI into filename and CGI args
@@ -143,98 +657,425 @@ int parse_uri(char *uri, char *filename, char *cgiargs)
 /* $end parse_uri */
 
 /*
- * serve_static - copy a file back to the client 
+ * serve_static - copy a file back to the client. Small files come from
+ *     the static cache when it is on: the head template, the Date
+ *     line, and the cached headers and body go out by reference in a
+ *     single writev. Otherwise the body goes from the page cache to
+ *     the socket with sendfile (or from an mmap of the file with -m),
+ *     and the headers are sent flagged MSG_MORE so they leave in the
+ *     same segment as the start of the body. Errors (the client
+ *     hanging up, the file vanishing after the stat) abandon the
+ *     response instead of exiting, so one bad connection can't take
+ *     down a server that is handling others. Returns nonzero if the
+ *     connection may be kept open.
  */
 /* $begin serve_static */
-void serve_static(int fd, char *filename, int filesize) 
+int serve_static(int fd, char *filename, struct stat *sbuf, int flags) 
 {
-    int srcfd;
-    char *srcp, filetype[MAXLINE], buf[MAXBUF];
+    int srcfd = -1, n, filesize = sbuf->st_size;
+    ssize_t rc = 0;
+    size_t datelen, total;
+    char buf[MAXBUF], *date = date_header(&datelen);
+    tmpl_t *status = &status_tmpl[flags & 3];
+    cache_obj_t *obj;
+    riow_t out;
+
+    rio_writeinitb(&out, fd);
+    rio_writeb_ref(&out, status->str, status->len);
+    rio_writeb_ref(&out, date, datelen);
+
+    if ((obj = static_object(filename, sbuf)) != NULL) {
+	rio_writeb_ref(&out, obj->data, obj->size);
+	total = status->len + datelen + obj->size;
+	if ((rc = rio_flushb(&out)) != (ssize_t)total)
+	    write_failed();
+	lat_mark(&req_lat, LAT_HEAD);   /* Head and body went together */
+	lat_mark(&req_lat, LAT_BODY);
+	req_lat.out = rc > 0 ? rc : 0;
+	if (alog_on)
+	    alog_response(status->str, status->len, date, datelen,
+			  obj->data, obj->hdrlen);
+	cache_release(static_cache, obj);
+	return rc == (ssize_t)total && (flags & RESP_KEEPALIVE);
+    }
  
+    if (filesize > 0 &&
+	(srcfd = open(filename, O_RDONLY | O_CLOEXEC, 0)) < 0) { //line:netp:servestatic:open
+	req_lat.outcome = LAT_ERROR;
+	return clienterror(fd, filename, "403", "Forbidden",
+			   "Tiny couldn't read the file", flags);
+    }
+
     /* Send response headers to client */
-    get_filetype(filename, filetype);       //line:netp:servestatic:getfiletype
-    sprintf(buf, "HTTP/1.0 200 OK\r\n");    //line:netp:servestatic:beginserve
-    sprintf(buf, "%sServer: Tiny Web Server\r\n", buf);
-    sprintf(buf, "%sConnection: close\r\n", buf);
-    sprintf(buf, "%sContent-length: %d\r\n", buf, filesize);
-    sprintf(buf, "%sContent-type: %s\r\n\r\n", buf, filetype);
-    Rio_writen(fd, buf, strlen(buf));       //line:netp:servestatic:endserve
-    printf("Response headers:\n");
-    printf("%s", buf);
+    n = entity_headers(buf, filename, filesize);
+    rio_writeb(&out, buf, n);
+    if ((filesize > 0 ? rio_flushb_more(&out) : rio_flushb(&out)) < 0) { //line:netp:servestatic:endserve
+	write_failed();
+	if (srcfd >= 0)
+	    Close(srcfd);
+	return 0;
+    }
+    lat_mark(&req_lat, LAT_HEAD);
+    req_lat.out = status->len + datelen + n;
+    if (alog_on)
+	alog_response(status->str, status->len, date, datelen, buf, n);
+    if (filesize == 0)
+	return flags & RESP_KEEPALIVE;
 
     /* Send response body to client */
-    srcfd = Open(filename, O_RDONLY, 0);    //line:netp:servestatic:open
-    srcp = Mmap(0, filesize, PROT_READ, MAP_PRIVATE, srcfd, 0);//line:netp:servestatic:mmap
+    if (static_mmap)
+	rc = rio_mmapwrite(fd, srcfd, 0, filesize); //line:netp:servestatic:mmap
+    else
+	rc = rio_sendfile(fd, srcfd, 0, filesize);  //line:netp:servestatic:write
+    if (rc < 0)
+	write_failed();
     Close(srcfd);                           //line:netp:servestatic:close
-    Rio_writen(fd, srcp, filesize);         //line:netp:servestatic:write
-    Munmap(srcp, filesize);                 //line:netp:servestatic:munmap
+    lat_mark(&req_lat, LAT_BODY);
+    if (rc > 0)
+	req_lat.out += rc;
+    return rc == filesize && (flags & RESP_KEEPALIVE);
 }
 
 /*
- * get_filetype - derive file type from file name
+ * static_object - return a referenced cache object holding the entity
+ *     headers and body of the static file filename, whose stat is
+ *     sbuf, reading the file into the cache on a miss or if the cached
+ *     copy's size or modification time no longer match. Returns NULL
+ *     if the cache is off, the file is too big to cache, or it can't
+ *     be read whole; the caller then serves it from disk.
  */
-void get_filetype(char *filename, char *filetype) 
+cache_obj_t *static_object(char *filename, struct stat *sbuf)
 {
-    if (strstr(filename, ".html"))
-	strcpy(filetype, "text/html");
-    else if (strstr(filename, ".gif"))
-	strcpy(filetype, "image/gif");
-    else if (strstr(filename, ".png"))
-	strcpy(filetype, "image/png");
-    else if (strstr(filename, ".jpg"))
-	strcpy(filetype, "image/jpeg");
-    else
-	strcpy(filetype, "text/plain");
+    int srcfd, hdrlen;
+    char hdr[MAXBUF], *data;
+    cache_obj_t *obj;
+    struct stat before, after;
+
+    if (!static_cache || (size_t)sbuf->st_size > static_cache->maxobj)
+	return NULL;
+
+    if ((obj = cache_lookup(static_cache, filename)) != NULL) {
+	if (cache_fresh(obj, sbuf))
+	    return obj;
+	cache_invalidate(static_cache, obj);  /* Changed since it was cached */
+	cache_release(static_cache, obj);
+    }
+
+    /* Miss: read the file, and cache it only if it held still meanwhile */
+    if ((srcfd = open(filename, O_RDONLY | O_CLOEXEC, 0)) < 0)
+	return NULL;
+    if (fstat(srcfd, &before) < 0 ||
+	(size_t)before.st_size > static_cache->maxobj) {
+	close(srcfd);
+	return NULL;
+    }
+    hdrlen = entity_headers(hdr, filename, before.st_size);
+    data = Malloc(hdrlen + before.st_size);
+    memcpy(data, hdr, hdrlen);
+    if (rio_readn(srcfd, data + hdrlen, before.st_size) != before.st_size ||
+	fstat(srcfd, &after) < 0 || after.st_size != before.st_size ||
+	after.st_mtim.tv_sec != before.st_mtim.tv_sec ||
+	after.st_mtim.tv_nsec != before.st_mtim.tv_nsec) {
+	close(srcfd);
+	free(data);
+	return NULL;
+    }
+    close(srcfd);
+    return cache_insert(static_cache, filename, data, hdrlen + before.st_size,
+			hdrlen, &before);
+}
+
+/*
+ * static_headers - build the response headers for a static file into
+ *     buf (at least MAXBUF bytes) and return their length
+ */
+int static_headers(char *buf, char *filename, int filesize, int flags)
+{
+    int n = status_headers(buf, flags);
+
+    return n + entity_headers(buf + n, filename, filesize);
+}
+
+/*
+ * status_headers - build the part of a static response head that
+ *     depends on the request (status line, Server, Connection, Date)
+ *     into buf and return its length
+ */
+int status_headers(char *buf, int flags)
+{
+    char *p = buf, *date;
+    size_t datelen;
+    tmpl_t *status = &status_tmpl[flags & 3];
+
+    date = date_header(&datelen);
+    p = put(p, status->str, status->len);   //line:netp:servestatic:beginserve
+    p = put(p, date, datelen);
+    *p = '\0';
+    return p - buf;
+}
+
+/*
+ * entity_headers - build the part of a static response head that
+ *     depends only on the file (Content-length, Content-type, and the
+ *     blank line) into buf and return its length
+ */
+int entity_headers(char *buf, char *filename, int filesize)
+{
+    char *p = buf, *filetype;
+
+    filetype = get_filetype(filename);      //line:netp:servestatic:getfiletype
+    p = putlit(p, "Content-length: ");
+    p += fmt_ulong(p, filesize);
+    p = putlit(p, "\r\nContent-type: ");
+    p = put(p, filetype, strlen(filetype));
+    p = putlit(p, "\r\n\r\n");
+    *p = '\0';
+    return p - buf;
+}
+
+/*
+ * date_header - return the "Date: ...\r\n" line for the current
+ *     second and set *lenp to its length. Each thread keeps its own
+ *     copy and formats it again at most once a second.
+ */
+char *date_header(size_t *lenp)
+{
+    static __thread char line[64];
+    static __thread size_t len;
+    static __thread time_t last = -1;
+    time_t now = time(NULL);
+    struct tm tm;
+
+    if (now != last) {
+	gmtime_r(&now, &tm);
+	len = strftime(line, sizeof(line),
+		       "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &tm);
+	last = now;
+    }
+    *lenp = len;
+    return line;
+}
+
+/*
+ * fmt_ulong - write v in decimal at buf (no NUL) and return the number
+ *     of digits
+ */
+int fmt_ulong(char *buf, unsigned long v)
+{
+    char digits[20], *p = digits + sizeof(digits);
+    int n;
+
+    do {
+	*--p = '0' + v % 10;
+	v /= 10;
+    } while (v);
+    n = digits + sizeof(digits) - p;
+    memcpy(buf, p, n);
+    return n;
+}
+
+/*
+ * get_filetype - derive file type from file name's extension (mime.c)
+ */
+char *get_filetype(char *filename) 
+{
+    return mime_type(filename);
 }  
 /* $end serve_static */
 
 /*
- * serve_dynamic - run a CGI program on behalf of the client
+ * serve_dynamic - run a CGI program on behalf of the client. The child
+ *     is not waited for here: tiny's reporter thread reaps it.
  */
 /* $begin serve_dynamic */
 void serve_dynamic(int fd, char *filename, char *cgiargs) 
 {
-    char buf[MAXLINE], *emptylist[] = { NULL };
+    spawn_dynamic(fd, filename, cgiargs, 1);
+}
+/* $end serve_dynamic */
+
+/*
+ * spawn_dynamic - send the first part of the response and start the
+ *     CGI program with its stdout redirected to fd. Returns the child's
+ *     pid without waiting for it, 0 if a persistent worker (-f) took
+ *     the request instead, or -1 if the client has already gone away
+ *     or the program couldn't be started. fd must be in blocking mode.
+ *     The event loops pass wait 0, so that no request of theirs waits
+ *     for a worker to start or come free (see cgipool_serve).
+ *
+ *     The child is started with posix_spawn, which glibc implements
+ *     with a vfork-style clone: nothing of the server's address space
+ *     is copied, however large the cache has grown, and the dup2 of
+ *     fd onto stdout is done by a file action between clone and exec.
+ */
+pid_t spawn_dynamic(int fd, char *filename, char *cgiargs, int wait)
+{
+    pid_t pid;
+    int rc;
+    size_t datelen, n, i, j;
+    char *argv[2], **envp, *query, *date = date_header(&datelen);
+    riow_t out;
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    sigset_t sigs;
 
-    /* Return first part of HTTP response */
-    sprintf(buf, "HTTP/1.0 200 OK\r\n"); 
-    Rio_writen(fd, buf, strlen(buf));
-    sprintf(buf, "Server: Tiny Web Server\r\n");
-    Rio_writen(fd, buf, strlen(buf));
-  
-    if (Fork() == 0) { /* Child */ //line:netp:servedynamic:fork
-	/* Real server would set all CGI vars here */
-	setenv("QUERY_STRING", cgiargs, 1); //line:netp:servedynamic:setenv
-	Dup2(fd, STDOUT_FILENO);         /* Redirect stdout to client */ //line:netp:servedynamic:dup2
-	Execve(filename, emptylist, environ); /* Run CGI program */ //line:netp:servedynamic:execve
+    /* Return first part of HTTP response, in one write */
+    rio_writeinitb(&out, fd);
+    rio_writeb_ref(&out, cgi_tmpl.str, cgi_tmpl.len);
+    rio_writeb_ref(&out, date, datelen);
+    if (rio_flushb(&out) < 0)
+	return -1;
+    if (cgi_pool && cgipool_serve(cgi_pool, filename, cgiargs, fd, wait) == 0)
+	return 0;
+
+    /* Real server would set all CGI vars here. The child gets its own
+       environment: setenv would change the one every thread shares. */
+    for (n = 0; environ[n]; n++)
+	;
+    envp = Malloc((n + 2) * sizeof(char *));
+    for (i = j = 0; i < n; i++)
+	if (strncmp(environ[i], "QUERY_STRING=", 13))
+	    envp[j++] = environ[i];
+    query = Malloc(strlen(cgiargs) + sizeof("QUERY_STRING="));
+    sprintf(query, "QUERY_STRING=%s", cgiargs); //line:netp:servedynamic:setenv
+    envp[j++] = query;
+    envp[j] = NULL;
+    argv[0] = filename;
+    argv[1] = NULL;
+
+    /* Redirect stdout to client, and don't let the child inherit a
+       server's SIG_IGN for SIGPIPE or its blocked SIGUSR1 and SIGCHLD */
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fd, STDOUT_FILENO); //line:netp:servedynamic:dup2
+    posix_spawnattr_init(&attr);
+    sigemptyset(&sigs);
+    posix_spawnattr_setsigmask(&attr, &sigs);
+    sigaddset(&sigs, SIGPIPE);
+    posix_spawnattr_setsigdefault(&attr, &sigs);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK |
+			     POSIX_SPAWN_SETSIGDEF);
+
+    rc = posix_spawn(&pid, filename, &actions, &attr, argv, envp); /* Run CGI program */ //line:netp:servedynamic:execve
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    Free(query);
+    Free(envp);
+    if (rc != 0) {
+	fprintf(stderr, "tiny: can't run %s: %s\n", filename, strerror(rc));
+	return -1;
     }
-    Wait(NULL); /* Parent waits for and reaps child */ //line:netp:servedynamic:wait
+    child_add(pid);
+    return pid;
 }
-/* $end serve_dynamic */
 
 /*
- * clienterror - returns an error message to the client
+ * clienterror - returns an error message to the client. Returns
+ *     nonzero if the connection may be kept open.
  */
 /* $begin clienterror */
-void clienterror(int fd, char *cause, char *errnum, 
-		 char *shortmsg, char *longmsg) 
-{
-    char buf[MAXLINE], body[MAXBUF];
-
-    /* Build the HTTP response body */
-    sprintf(body, "<html><title>Tiny Error</title>");
-    sprintf(body, "%s<body bgcolor=""ffffff"">\r\n", body);
-    sprintf(body, "%s%s: %s\r\n", body, errnum, shortmsg);
-    sprintf(body, "%s<p>%s: %s\r\n", body, longmsg, cause);
-    sprintf(body, "%s<hr><em>The Tiny Web server</em>\r\n", body);
-
-    /* Print the HTTP response */
-    sprintf(buf, "HTTP/1.0 %s %s\r\n", errnum, shortmsg);
-    Rio_writen(fd, buf, strlen(buf));
-    sprintf(buf, "Content-type: text/html\r\n");
-    Rio_writen(fd, buf, strlen(buf));
-    sprintf(buf, "Content-length: %d\r\n\r\n", (int)strlen(body));
-    Rio_writen(fd, buf, strlen(buf));
-    Rio_writen(fd, body, strlen(body));
+int clienterror(int fd, char *cause, char *errnum, 
+		char *shortmsg, char *longmsg, int flags) 
+{
+    int n;
+    char buf[RESPBUF];
+
+    n = error_response(buf, cause, errnum, shortmsg, longmsg, flags);
+    if (rio_writen(fd, buf, n) != n)
+	return 0;
+    lat_mark(&req_lat, LAT_HEAD);
+    req_lat.out = n;
+    return flags & RESP_KEEPALIVE;
 }
 /* $end clienterror */
+
+/*
+ * error_response - build a complete error response (headers and body)
+ *     into buf, which must hold RESPBUF bytes, and return its length.
+ *     Every piece is copied exactly once; a cause too long to fit is
+ *     cut short.
+ */
+int error_response(char *buf, char *cause, char *errnum, 
+		   char *shortmsg, char *longmsg, int flags) 
+{
+    static char body1[] = "<html><title>Tiny Error</title>"
+	"<body bgcolor=ffffff>\r\n";
+    static char body2[] = "\r\n<hr><em>The Tiny Web server</em>\r\n";
+    char *p = buf, *date;
+    size_t numlen = strlen(errnum), shortlen = strlen(shortmsg);
+    size_t longlen = strlen(longmsg), causelen = strlen(cause), datelen;
+    tmpl_t *tmpl = &error_tmpl[flags & 3];
+
+    if (causelen > MAXLINE)
+	causelen = MAXLINE;
+    date = date_header(&datelen);
+
+    /* The HTTP response headers */
+    p = put(p, resp_version(flags), 8);
+    p = putlit(p, " ");
+    p = put(p, errnum, numlen);
+    p = putlit(p, " ");
+    p = put(p, shortmsg, shortlen);
+    p = put(p, tmpl->str, tmpl->len);
+    p = put(p, date, datelen);
+    p = putlit(p, "Content-length: ");
+    p += fmt_ulong(p, sizeof(body1) - 1 + numlen + 2 + shortlen + 5 + longlen +
+		   2 + causelen + sizeof(body2) - 1);
+    p = putlit(p, "\r\n\r\n");
+
+    /* The HTTP response body */
+    p = put(p, body1, sizeof(body1) - 1);
+    p = put(p, errnum, numlen);
+    p = putlit(p, ": ");
+    p = put(p, shortmsg, shortlen);
+    p = putlit(p, "\r\n<p>");
+    p = put(p, longmsg, longlen);
+    p = putlit(p, ": ");
+    p = put(p, cause, causelen);
+    p = put(p, body2, sizeof(body2) - 1);
+    return p - buf;
+}
+
+/*
+ * stats_response - build a complete response to a request for LAT_URI
+ *     (headers, and the latency histograms as text, or as JSON if
+ *     query is "json") into buf, which must hold RESPBUF bytes, and
+ *     return its length
+ */
+int stats_response(char *buf, char *query, int flags)
+{
+    int json = !strcmp(query, "json");
+    char *p = buf, *body = buf + MAXLINE;   /* The head is much shorter */
+    size_t bodylen = lat_render(body, RESPBUF - MAXLINE, json);
+
+    p += status_headers(p, flags);
+    p = putlit(p, "Cache-Control: no-store\r\nContent-length: ");
+    p += fmt_ulong(p, bodylen);
+    if (json)
+	p = putlit(p, "\r\nContent-type: application/json\r\n\r\n");
+    else
+	p = putlit(p, "\r\nContent-type: text/plain\r\n\r\n");
+    memmove(p, body, bodylen);
+    return p + bodylen - buf;
+}
+
+/*
+ * deadline_ms - how long a connection has to meet a deadline of the
+ *     given kind (DL_*), in milliseconds
+ */
+long deadline_ms(int kind)
+{
+    if (kind == DL_HEADER)
+	return header_timeout * 1000L;
+    if (kind == DL_WRITE)
+	return write_timeout * 1000L;
+    return keepalive_timeout * 1000L;
+}
+
+/*
+ * deadline_missed - count a connection closed for missing a deadline
+ *     of the given kind. Any thread may call it.
+ */
+void deadline_missed(int kind)
+{
+    __atomic_fetch_add(&evictions[kind], 1, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,119 @@
+/*
+ * tiny.h - Declarations shared by the translation units of the Tiny
+ *     web server: tiny.c, the event loops in tiny_epoll.c and
+ *     tiny_uring.c, the worker pool in tiny_pool.c, the sharded
+ *     listeners in tiny_shard.c, the static content cache in cache.c,
+ *     the CGI workers in cgipool.c, the access log in accesslog.c, the
+ *     latency histograms in latency.c, the timer wheel that keeps the
+ *     event loops' connection deadlines in timerwheel.c, the media
+ *     types in mime.c, and the request parser in httpparse.c.
+ */
+#ifndef __TINY_H__
+#define __TINY_H__
+
+#include "csapp.h"
+#include "cache.h"
+#include "httpparse.h"
+#include "resolver.h"
+#include "cgipool.h"
+#include "accesslog.h"
+#include "latency.h"
+#include "timerwheel.h"
+#include "mime.h"
+
+/* Room for a response head plus an error page body */
+#define RESPBUF (2*MAXBUF)
+
+/* Static content cache defaults (tiny -c) */
+#define CACHE_BYTES  (16 << 20)  /* Total bytes of cached responses */
+#define CACHE_MAXOBJ (1 << 20)   /* Bigger files are always sent from disk */
+#define NAMES_TTL    300         /* Seconds a client's host name is kept (-r) */
+#define NAMES_NEGTTL 60          /* Seconds an address without one is kept */
+
+/* Connection deadlines (tiny -H, -W, -i), and why a connection missed one */
+#define DL_HEADER 0   /* The whole request head, from its first byte */
+#define DL_WRITE  1   /* More of the response taken by the client */
+#define DL_IDLE   2   /* The next request begun, on a persistent connection */
+#define DL_NKINDS 3
+#define DL_TICK   10  /* Resolution of the event loops' timer wheels (ms) */
+
+/* How route_request decided to answer a request */
+#define ROUTE_STATIC  0   /* Copy filename back to the client */
+#define ROUTE_DYNAMIC 1   /* Run filename as a CGI program */
+#define ROUTE_ERROR   2   /* Send an error page built from the err* fields */
+#define ROUTE_STATS   3   /* Send the latency histograms (LAT_URI) */
+
+/* Outcome of mapping a request line onto the file system */
+typedef struct {
+    int kind;                  /* ROUTE_STATIC, ROUTE_DYNAMIC, ... */
+    char filename[MAXLINE];    /* File to serve or CGI program to run */
+    char cgiargs[MAXLINE];     /* CGI arguments for ROUTE_DYNAMIC, or the
+				  query for ROUTE_STATS */
+    struct stat sbuf;          /* stat of filename if it exists */
+    char *errcause;            /* Error page fields for ROUTE_ERROR */
+    char *errnum;
+    char *shortmsg;
+    char *longmsg;
+} route_t;
+
+/* Response flags, as computed by response_flags */
+#define RESP_HTTP11    0x1  /* Answer in HTTP/1.1 rather than HTTP/1.0 */
+#define RESP_KEEPALIVE 0x2  /* Keep the connection open afterwards */
+
+#define resp_version(flags) \
+    ((flags) & RESP_HTTP11 ? "HTTP/1.1" : "HTTP/1.0")
+#define resp_connection(flags) \
+    ((flags) & RESP_KEEPALIVE ? "keep-alive" : "close")
+
+/* Command line settings (tiny.c) */
+extern int keepalive_max;      /* Requests served per connection */
+extern int keepalive_timeout;  /* Idle seconds before a connection closes */
+extern int header_timeout;     /* Seconds to send a whole request head */
+extern int write_timeout;      /* Seconds a response may make no progress */
+extern int static_mmap;        /* Send static bodies with mmap, not sendfile */
+extern cache_t *static_cache;  /* Cached static responses, or NULL if off */
+extern resolver_t *client_names; /* Reverse lookups of clients, or NULL */
+extern cgipool_t *cgi_pool;    /* Persistent CGI workers, or NULL */
+
+/* Request handling (tiny.c) */
+void serve_client(int fd);
+int doit(rio_t *rp, int nrequests);
+int connection_header(http_req_t *req, char *buf);
+int response_flags(char *method, char *version, int connhdr, int nrequests);
+void route_request(char *method, char *uri, route_t *rt);
+int parse_uri(char *uri, char *filename, char *cgiargs);
+int serve_static(int fd, char *filename, struct stat *sbuf, int flags);
+int static_headers(char *buf, char *filename, int filesize, int flags);
+int status_headers(char *buf, int flags);
+int entity_headers(char *buf, char *filename, int filesize);
+char *date_header(size_t *lenp);
+int fmt_ulong(char *buf, unsigned long v);
+cache_obj_t *static_object(char *filename, struct stat *sbuf);
+char *get_filetype(char *filename);
+void serve_dynamic(int fd, char *filename, char *cgiargs);
+pid_t spawn_dynamic(int fd, char *filename, char *cgiargs, int wait);
+int clienterror(int fd, char *cause, char *errnum,
+		char *shortmsg, char *longmsg, int flags);
+int error_response(char *buf, char *cause, char *errnum,
+		   char *shortmsg, char *longmsg, int flags);
+int stats_response(char *buf, char *query, int flags);
+long deadline_ms(int kind);
+void deadline_missed(int kind);
+
+/* Event-driven server (tiny_epoll.c) */
+void log_client(struct sockaddr *sa, socklen_t salen);
+void epoll_serve(int listenfd);
+
+/* io_uring event-driven server (tiny_uring.c) */
+void uring_serve(int listenfd);
+
+/* Prethreaded server (tiny_pool.c) */
+void pool_serve(int listenfd, int nworkers, int maxworkers);
+void pool_report(char *why);
+
+/* Sharded listeners (tiny_shard.c) */
+void shard_serve(char *port, int n, int pin, int evented);
+void shard_accepted(void);
+void shard_report(void);
+
+#endif /* __TINY_H__ */
@@ -0,0 +1,559 @@
+/*
+ * tiny_epoll.c - Edge-triggered epoll event loop for Tiny (tiny -e).
+ *
+ * Every socket is nonblocking and registered once, for both EPOLLIN and
+ * EPOLLOUT in edge-triggered mode, so the loop never re-arms a
+ * descriptor. Each connection is a small state machine:
+ *
+ *   CONN_READ   append to the request buffer and feed the new bytes to
+ *               the incremental parser until the request head is
+ *               complete, then route the request with the same
+ *               route_request that doit uses
+ *   CONN_WRITE  drain the response head and the body (a file, or a
+ *               shared object from the static cache), then
+ *               either close the connection or, if it persists, drop
+ *               the request from the buffer and go back to CONN_READ
+ *
+ * Because an edge is only reported once, conn_run keeps reading or
+ * writing until the kernel says EAGAIN. Requests the client pipelined
+ * stay in the request buffer and are answered in order before the
+ * socket is read again. An idle connection costs only its conn_t; the
+ * request buffer and parser state exist only while a request is partly
+ * received, so one core can hold tens of thousands of idle clients.
+ *
+ * Every connection has one deadline at a time on the loop's timer
+ * wheel (timerwheel.c), set by its state: the rest of a request head
+ * within header_timeout of its first byte, more of a response taken
+ * by the client within write_timeout, or the next request within
+ * keepalive_timeout of the last. A deadline is only moved when the
+ * state changes or a response makes progress, and moving it costs a
+ * few pointer updates however many connections there are. The loop
+ * sleeps until the next tick at which one may expire, and closes the
+ * connections that missed theirs.
+ */
+#include "tiny.h"
+#include <sys/epoll.h>
+#include <sys/resource.h>
+
+/* accept4 is only declared under _GNU_SOURCE, which makes <netdb.h>
+   declare a gai_error that clashes with the one in csapp.h */
+extern int accept4(int sockfd, struct sockaddr *addr, socklen_t *addrlen,
+		   int flags);
+
+#define EV_MAXEVENTS 256   /* Events handled per epoll_wait */
+
+/* Connection states */
+#define CONN_READ  0
+#define CONN_WRITE 1
+
+typedef struct conn {
+    int fd;
+    int state;            /* CONN_READ or CONN_WRITE */
+    int flags;            /* RESP_* flags for the current response */
+    int nrequests;        /* Requests started on this connection */
+    char *inbuf;          /* Request bytes received so far (MAXLINE) */
+    size_t inlen;
+    http_req_t *req;      /* Parse of the request at the front of inbuf
+			     (allocated along with inbuf) */
+    size_t reqlen;        /* Length of the request being answered (0 if
+			     it was malformed or overflowed inbuf) */
+    char *outbuf;         /* Response head, or a whole error response */
+    size_t outlen, outoff;
+    int filefd;           /* File for a static response body, or -1 */
+    off_t fileoff;        /* Next byte of the file to send */
+    size_t filelen;
+    char *body;           /* The file mapped, when not using sendfile,
+			     or the cached object's data */
+    cache_obj_t *obj;     /* Cache object the body belongs to, or NULL */
+    lat_req_t lat;        /* The current request's progress */
+    tw_timer_t deadline;  /* On the loop's wheel, kind DL_* */
+    int progress;         /* A response moved on since it was set */
+} conn_t;
+
+typedef struct {
+    int epfd;             /* The epoll instance */
+    int listenfd;         /* Nonblocking listening socket */
+    int sparefd;          /* Reserved descriptor for shedding on EMFILE */
+    tw_t wheel;           /* Every connection's deadline */
+    long now;             /* ms, as of the last epoll_wait */
+} evloop_t;
+
+static void ev_accept(evloop_t *ev);
+static void ev_expire(evloop_t *ev);
+static void ev_deadline(evloop_t *ev, conn_t *c);
+static int conn_run(conn_t *c);
+static int conn_read(conn_t *c);
+static int conn_request(conn_t *c);
+static int conn_map(conn_t *c);
+static int conn_write(conn_t *c);
+static void conn_reset(conn_t *c);
+static void conn_close(evloop_t *ev, conn_t *c);
+
+/*
+ * set_nonblocking - turn O_NONBLOCK on or off for fd
+ */
+static int set_nonblocking(int fd, int on)
+{
+    int flags;
+
+    if ((flags = fcntl(fd, F_GETFL, 0)) < 0)
+	return -1;
+    flags = on ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+    return fcntl(fd, F_SETFL, flags);
+}
+
+/*
+ * raise_fd_limit - lift the soft descriptor limit to the hard limit so
+ *     the loop can hold as many connections as the system allows
+ */
+static void raise_fd_limit(void)
+{
+    struct rlimit rl;
+
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+	rl.rlim_cur = rl.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
+
+/*
+ * epoll_serve - serve all connections on listenfd from one event loop.
+ *     Does not return.
+ */
+void epoll_serve(int listenfd)
+{
+    int i, n;
+    evloop_t ev;
+    conn_t *c;
+    struct epoll_event event, events[EV_MAXEVENTS];
+
+    raise_fd_limit();
+
+    ev.listenfd = listenfd;
+    if (set_nonblocking(listenfd, 1) < 0)
+	unix_error("fcntl error");
+    fcntl(listenfd, F_SETFD, FD_CLOEXEC);
+    if ((ev.epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+	unix_error("epoll_create1 error");
+    ev.sparefd = Open("/dev/null", O_RDONLY | O_CLOEXEC, 0);
+    ev.now = tw_clock();
+    tw_init(&ev.wheel, DL_TICK, ev.now);
+
+    event.events = EPOLLIN | EPOLLET;
+    event.data.ptr = NULL;              /* NULL marks the listening socket */
+    if (epoll_ctl(ev.epfd, EPOLL_CTL_ADD, listenfd, &event) < 0)
+	unix_error("epoll_ctl error");
+
+    while (1) {
+	/* Wake in time for the next deadline that may expire */
+	n = epoll_wait(ev.epfd, events, EV_MAXEVENTS,
+		       tw_timeout(&ev.wheel, ev.now, -1));
+	ev.now = tw_clock();
+	if (n < 0) {
+	    if (errno == EINTR)         /* Interrupted by a signal */
+		continue;
+	    unix_error("epoll_wait error");
+	}
+
+	for (i = 0; i < n; i++) {
+	    if ((c = events[i].data.ptr) == NULL) {
+		ev_accept(&ev);
+		continue;
+	    }
+	    if ((events[i].events & EPOLLERR) || conn_run(c) < 0) {
+		conn_close(&ev, c);
+		continue;
+	    }
+	    ev_deadline(&ev, c);
+	}
+	ev_expire(&ev);
+    }
+}
+
+/*
+ * ev_accept - accept every pending connection and register it with
+ *     the loop. On EMFILE, give up the spare descriptor long enough to
+ *     accept and drop one client rather than leaving it stuck in the
+ *     backlog (an edge-triggered listener would never report it again).
+ */
+static void ev_accept(evloop_t *ev)
+{
+    int connfd;
+    conn_t *c;
+    char hostname[MAXLINE], port[MAXLINE];
+    socklen_t clientlen;
+    struct sockaddr_storage clientaddr;
+    struct epoll_event event;
+
+    while (1) {
+	clientlen = sizeof(clientaddr);
+	connfd = accept4(ev->listenfd, (SA *)&clientaddr, &clientlen,
+			 SOCK_NONBLOCK | SOCK_CLOEXEC);
+	if (connfd < 0) {
+	    if (errno == EINTR || errno == ECONNABORTED)
+		continue;
+	    if (errno == EMFILE || errno == ENFILE) {
+		close(ev->sparefd);
+		if ((connfd = accept(ev->listenfd, NULL, NULL)) >= 0)
+		    close(connfd);
+		ev->sparefd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+		fprintf(stderr, "tiny: out of descriptors, dropped a client\n");
+		continue;
+	    }
+	    if (errno != EAGAIN && errno != EWOULDBLOCK)
+		fprintf(stderr, "accept error: %s\n", strerror(errno));
+	    return;
+	}
+
+	shard_accepted();
+
+	/* Numeric lookup only: a reverse DNS query would stall the loop */
+	if (alog_on && alog_sample(ALOG_ACCEPT) &&
+	    getnameinfo((SA *)&clientaddr, clientlen, hostname, MAXLINE,
+			port, MAXLINE, NI_NUMERICHOST | NI_NUMERICSERV) == 0)
+	    alog_accept(hostname, port);
+
+	c = Calloc(1, sizeof(conn_t));
+	c->fd = connfd;
+	c->filefd = -1;
+	lat_reset(&c->lat);
+	lat_mark(&c->lat, LAT_ACCEPT);
+	c->state = CONN_READ;
+	event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+	event.data.ptr = c;
+	if (epoll_ctl(ev->epfd, EPOLL_CTL_ADD, connfd, &event) < 0) {
+	    fprintf(stderr, "epoll_ctl error: %s\n", strerror(errno));
+	    close(connfd);
+	    free(c);
+	    continue;
+	}
+	tw_timer_init(&c->deadline, c);
+	ev_deadline(ev, c);
+    }
+}
+
+/*
+ * ev_deadline - give c the deadline its state calls for: DL_WRITE
+ *     while it has a response to send, DL_HEADER while part of a
+ *     request head is buffered, and DL_IDLE otherwise. A deadline of
+ *     the same kind is moved on only if the response made progress or
+ *     a new request began; more bytes of the same head don't buy time.
+ */
+static void ev_deadline(evloop_t *ev, conn_t *c)
+{
+    int kind = c->state == CONN_WRITE ? DL_WRITE :
+	c->inlen > 0 ? DL_HEADER : DL_IDLE;
+
+    if (kind != c->deadline.kind || c->progress)
+	tw_arm(&ev->wheel, &c->deadline, kind, ev->now + deadline_ms(kind));
+    c->progress = 0;
+}
+
+/*
+ * ev_expire - close the connections whose deadlines have passed,
+ *     counting them by the deadline they missed
+ */
+static void ev_expire(evloop_t *ev)
+{
+    tw_timer_t *t;
+
+    while ((t = tw_expire(&ev->wheel, ev->now)) != NULL) {
+	deadline_missed(t->kind);
+	conn_close(ev, t->data);
+    }
+}
+
+/*
+ * conn_run - drive c's state machine as far as it will go without
+ *     blocking. Returns 0 if the connection is waiting for the socket
+ *     and -1 if it is finished and should be closed.
+ */
+static int conn_run(conn_t *c)
+{
+    int rc;
+
+    while (1) {
+	if (c->state == CONN_READ) {
+	    if ((rc = conn_read(c)) <= 0)
+		return rc;
+	    if (conn_request(c) < 0)
+		return -1;
+	}
+	if ((rc = conn_write(c)) <= 0)
+	    return rc;
+	lat_record(&c->lat);
+	if (!(c->flags & RESP_KEEPALIVE))
+	    return -1;
+	conn_reset(c);                  /* On to the next request */
+    }
+}
+
+/*
+ * conn_read - make sure a whole request head is buffered, reading from
+ *     the socket only if the buffer doesn't already hold one that the
+ *     client pipelined. Only bytes the parser hasn't seen are scanned.
+ *     Returns 1 once the request head is buffered (or is known to be
+ *     malformed or too big for the buffer), 0 if more input is needed,
+ *     and -1 if the client went away first.
+ */
+static int conn_read(conn_t *c)
+{
+    int rc;
+    ssize_t n;
+
+    if (!c->inbuf) {
+	c->inbuf = Malloc(MAXLINE);
+	c->req = Malloc(sizeof(http_req_t));
+	http_init(c->req);
+    }
+    if (c->inlen > 0)
+	lat_mark(&c->lat, LAT_FIRST);   /* Pipelined behind the last one */
+
+    while ((rc = http_parse(c->req, c->inbuf, c->inlen)) == HTTP_AGAIN) {
+	if (c->inlen == MAXLINE)        /* Headers will never fit */
+	    break;
+	n = read(c->fd, c->inbuf + c->inlen, MAXLINE - c->inlen);
+	if (n < 0) {
+	    if (errno == EINTR)
+		continue;
+	    if (errno == EAGAIN || errno == EWOULDBLOCK)
+		return 0;
+	    return -1;
+	}
+	if (n == 0)                     /* Client shut down its side */
+	    return -1;
+	c->inlen += n;
+	lat_mark(&c->lat, LAT_FIRST);
+    }
+    c->reqlen = rc == HTTP_DONE ? c->req->hdrlen : 0;
+    lat_mark(&c->lat, LAT_PARSED);
+    return 1;
+}
+
+/*
+ * conn_request - route the buffered request and set up its response.
+ *     Returns -1 if the connection should be closed now.
+ */
+static int conn_request(conn_t *c)
+{
+    char *method, *uri, *version;
+    route_t rt;
+
+    c->nrequests++;
+    c->outbuf = Malloc(RESPBUF);
+    c->state = CONN_WRITE;
+    if (c->reqlen == 0) {               /* Malformed or too big */
+	c->flags = 0;
+	c->outlen = error_response(c->outbuf, "request", "400", "Bad Request",
+				   "Tiny couldn't parse the request headers",
+				   c->flags);
+	c->lat.outcome = LAT_ERROR;
+	c->lat.out = c->outlen;
+	return 0;
+    }
+    c->lat.in = c->reqlen;
+    if (alog_on && alog_sample(ALOG_REQUEST))
+	alog_request(c->inbuf, c->reqlen);
+
+    http_terminate(c->req, c->inbuf);
+    method = http_str(c->inbuf, c->req->method);
+    uri = http_str(c->inbuf, c->req->uri);
+    version = http_str(c->inbuf, c->req->version);
+    c->flags = response_flags(method, version,
+			      connection_header(c->req, c->inbuf),
+			      c->nrequests);
+    route_request(method, uri, &rt);
+    lat_mark(&c->lat, LAT_ROUTED);
+
+    if (rt.kind == ROUTE_DYNAMIC) {
+	/* The CGI program writes straight to the socket, so hand it a
+	   blocking descriptor and let the child own the rest of the
+	   exchange. The child is reaped by tiny's reporter thread. */
+	if (set_nonblocking(c->fd, 0) < 0)
+	    return -1;
+	spawn_dynamic(c->fd, rt.filename, rt.cgiargs, 0);
+	c->lat.outcome = LAT_DYNAMIC;
+	lat_mark(&c->lat, LAT_HEAD);
+	lat_record(&c->lat);
+	return -1;
+    }
+
+    if (rt.kind == ROUTE_STATS) {       /* Not recorded itself */
+	c->outlen = stats_response(c->outbuf, rt.cgiargs, c->flags);
+	return 0;
+    }
+
+    if (rt.kind == ROUTE_STATIC &&
+	(c->obj = static_object(rt.filename, &rt.sbuf)) != NULL) {
+	/* Cached: per-request headers, then the object in the same writev */
+	c->outlen = status_headers(c->outbuf, c->flags);
+	c->body = c->obj->data;
+	c->filelen = c->obj->size;
+	c->lat.outcome = LAT_STATIC;
+	c->lat.out = c->outlen + c->filelen;
+	if (alog_on)
+	    alog_response(c->outbuf, c->outlen, c->body, c->obj->hdrlen,
+			  NULL, 0);
+	return 0;
+    }
+
+    if (rt.kind == ROUTE_STATIC &&
+	(c->filelen = rt.sbuf.st_size) > 0 &&
+	((c->filefd = open(rt.filename, O_RDONLY | O_CLOEXEC, 0)) < 0 ||
+	 (static_mmap && conn_map(c) < 0))) {
+	rt.kind = ROUTE_ERROR;          /* Lost a race with the file */
+	rt.errnum = "403";
+	rt.shortmsg = "Forbidden";
+	rt.longmsg = "Tiny couldn't read the file";
+	c->filelen = 0;
+    }
+
+    if (rt.kind == ROUTE_STATIC) {
+	c->outlen = static_headers(c->outbuf, rt.filename, rt.sbuf.st_size,
+				   c->flags);
+	c->lat.outcome = LAT_STATIC;
+	if (alog_on)
+	    alog_response(c->outbuf, c->outlen, NULL, 0, NULL, 0);
+    }
+    else {
+	c->outlen = error_response(c->outbuf, rt.errcause, rt.errnum,
+				   rt.shortmsg, rt.longmsg, c->flags);
+	c->lat.outcome = LAT_ERROR;
+    }
+    c->lat.out = c->outlen + c->filelen;
+    return 0;
+}
+
+/*
+ * conn_map - map the response body, for when sendfile
+ *     isn't wanted (tiny -m) or the kernel can't do it for this file
+ */
+static int conn_map(conn_t *c)
+{
+    c->body = mmap(0, c->filelen, PROT_READ, MAP_PRIVATE, c->filefd, 0);
+    if (c->body == MAP_FAILED) {
+	c->body = NULL;
+	return -1;
+    }
+    return 0;
+}
+
+/*
+ * conn_write - write as much of the response as the socket will take.
+ *     With sendfile the head goes out flagged MSG_MORE so that it
+ *     shares a segment with the start of the body; a mapped body goes
+ *     out together with the head in one writev. Returns 1 when the
+ *     response is complete, 0 if the socket is full, and -1 on error.
+ */
+static int conn_write(conn_t *c)
+{
+    ssize_t n;
+    struct iovec iov[2];
+
+    while (c->outoff < c->outlen || (size_t)c->fileoff < c->filelen) {
+	if (c->filefd >= 0 && !c->body) {
+	    if (c->outoff < c->outlen)
+		n = send(c->fd, c->outbuf + c->outoff, c->outlen - c->outoff,
+			 MSG_MORE);
+	    else
+		n = sendfile(c->fd, c->filefd, &c->fileoff,
+			     c->filelen - c->fileoff);
+	}
+	else {
+	    iov[0].iov_base = c->outbuf + c->outoff;
+	    iov[0].iov_len = c->outlen - c->outoff;
+	    iov[1].iov_base = c->body + c->fileoff;
+	    iov[1].iov_len = c->filelen - c->fileoff;
+	    n = writev(c->fd, iov, 2);
+	}
+
+	if (n < 0) {
+	    if (errno == EINTR)
+		continue;
+	    if (errno == EAGAIN || errno == EWOULDBLOCK)
+		return 0;
+	    if ((errno == EINVAL || errno == ENOSYS) &&
+		c->outoff == c->outlen && !c->body && conn_map(c) == 0)
+		continue;               /* No sendfile for this file */
+	    return -1;
+	}
+	if (n == 0 && c->outoff == c->outlen)
+	    return -1;                  /* The file shrank under us */
+	if (n > 0)
+	    c->progress = 1;
+
+	if (c->outoff < c->outlen) {
+	    if ((size_t)n <= c->outlen - c->outoff) {
+		c->outoff += n;
+		continue;
+	    }
+	    n -= c->outlen - c->outoff;  /* writev went into the body */
+	    c->outoff = c->outlen;
+	}
+	lat_mark(&c->lat, LAT_HEAD);
+	if (c->body)                    /* sendfile advanced fileoff itself */
+	    c->fileoff += n;
+    }
+    lat_mark(&c->lat, LAT_HEAD);
+    if (c->filelen > 0)
+	lat_mark(&c->lat, LAT_BODY);
+    return 1;
+}
+
+/*
+ * conn_reset - finish the current request on a persistent connection:
+ *     release its response and shift any pipelined bytes that follow
+ *     it to the front of the request buffer
+ */
+static void conn_reset(conn_t *c)
+{
+    if (c->obj)
+	cache_release(static_cache, c->obj);
+    else if (c->body)
+	munmap(c->body, c->filelen);
+    if (c->filefd >= 0)
+	close(c->filefd);
+    free(c->outbuf);
+    c->obj = NULL;
+    c->body = c->outbuf = NULL;
+    c->filefd = -1;
+    c->fileoff = c->filelen = c->outlen = c->outoff = 0;
+
+    c->inlen -= c->reqlen;
+    if (c->inlen > 0)
+	memmove(c->inbuf, c->inbuf + c->reqlen, c->inlen);
+    else {                              /* Idle: give the buffer back */
+	free(c->inbuf);
+	free(c->req);
+	c->inbuf = NULL;
+	c->req = NULL;
+    }
+    c->reqlen = 0;
+    if (c->req)
+	http_init(c->req);
+    c->state = CONN_READ;
+    c->progress = 1;                    /* A new deadline for the next one */
+}
+
+/*
+ * conn_close - release a connection and everything it holds. The
+ *     descriptor is removed from the epoll set explicitly: a CGI child
+ *     may still hold a copy of the socket, and epoll would keep
+ *     reporting events for it (with a stale pointer) after our close.
+ */
+static void conn_close(evloop_t *ev, conn_t *c)
+{
+    epoll_ctl(ev->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+    tw_cancel(&ev->wheel, &c->deadline);
+    if (c->obj)
+	cache_release(static_cache, c->obj);
+    else if (c->body)
+	munmap(c->body, c->filelen);
+    if (c->filefd >= 0)
+	close(c->filefd);
+    close(c->fd);
+    free(c->inbuf);
+    free(c->req);
+    free(c->outbuf);
+    free(c);
+}
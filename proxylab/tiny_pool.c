@@ -0,0 +1,178 @@
+/*
+ * tiny_pool.c - Prethreaded, self-sizing worker pool for Tiny (tiny -t).
+ *
+ * The main thread only accepts connections and inserts the connected
+ * descriptors into a bounded sbuf. Worker threads remove descriptors
+ * and run serve_client on them. A manager thread samples the pool every
+ * POOL_TICK_MS: when every worker is busy and connections are waiting
+ * it doubles the pool (up to the maximum), and when fewer than a
+ * quarter of the workers have been busy for a whole second it halves
+ * it (down to the initial size) by queueing one retire token (-1) per
+ * surplus worker. Resizes are reported on stderr, as is the pool's
+ * state whenever tiny's reporter thread receives SIGUSR1.
+ */
+#include "tiny.h"
+#include "sbuf.h"
+
+#define POOL_SBUFSIZE 256   /* Connections that may wait for a worker */
+#define POOL_TICK_MS  100   /* Manager sampling period */
+#define POOL_IDLE_TICKS 10  /* Quiet samples before the pool shrinks */
+
+static struct {
+    sbuf_t sbuf;            /* Accepted connections waiting for a worker */
+    sem_t mutex;            /* Protects the counters below */
+    int minworkers;         /* Never shrink below this */
+    int maxworkers;         /* Never grow beyond this */
+    int nworkers;           /* Live workers, including retiring ones */
+    int busy;               /* Workers serving a connection */
+    int retiring;           /* Retire tokens queued but not yet taken */
+    unsigned long accepted; /* Connections handed to the pool */
+} pool;
+
+/*
+ * pool_worker - thread routine: serve connections until handed a
+ *     retire token
+ */
+static void *pool_worker(void *vargp)
+{
+    int connfd;
+
+    Pthread_detach(pthread_self());
+    while ((connfd = sbuf_remove(&pool.sbuf)) >= 0) {
+	P(&pool.mutex);
+	pool.busy++;
+	V(&pool.mutex);
+
+	serve_client(connfd);
+	Close(connfd);
+
+	P(&pool.mutex);
+	pool.busy--;
+	V(&pool.mutex);
+    }
+
+    P(&pool.mutex);
+    pool.nworkers--;
+    pool.retiring--;
+    V(&pool.mutex);
+    return NULL;
+}
+
+/*
+ * pool_spawn - start n more workers
+ */
+static void pool_spawn(int n)
+{
+    pthread_t tid;
+
+    P(&pool.mutex);
+    pool.nworkers += n;
+    V(&pool.mutex);
+    while (n-- > 0)
+	Pthread_create(&tid, NULL, pool_worker, NULL);
+}
+
+/*
+ * pool_report - print a one-line summary of the pool's state, if there
+ *     is a pool
+ */
+void pool_report(char *why)
+{
+    int depth;
+
+    if (pool.maxworkers == 0)   /* Set last by pool_serve */
+	return;
+    depth = sbuf_count(&pool.sbuf);
+
+    P(&pool.mutex);
+    fprintf(stderr, "tiny: %s: %d workers (%d busy, %d retiring), "
+	    "queue %d/%d, %lu accepted\n", why, pool.nworkers, pool.busy,
+	    pool.retiring, depth, POOL_SBUFSIZE, pool.accepted);
+    V(&pool.mutex);
+}
+
+/*
+ * pool_manager - thread routine: grow or shrink the pool with the load
+ */
+static void *pool_manager(void *vargp)
+{
+    int active, busy, depth, idle_ticks = 0, grow = 0, shrink = 0;
+    struct timespec tick = { 0, POOL_TICK_MS * 1000000L };
+
+    Pthread_detach(pthread_self());
+    while (1) {
+	nanosleep(&tick, NULL);
+	depth = sbuf_count(&pool.sbuf);
+
+	P(&pool.mutex);
+	active = pool.nworkers - pool.retiring;
+	busy = pool.busy;
+	if (busy >= active && depth > 0 && active < pool.maxworkers) {
+	    grow = active;      /* Saturated: double the pool */
+	    if (active + grow > pool.maxworkers)
+		grow = pool.maxworkers - active;
+	    idle_ticks = 0;
+	}
+	else if (busy < active / 4 && depth == 0 && active > pool.minworkers) {
+	    if (++idle_ticks >= POOL_IDLE_TICKS) {
+		shrink = active / 2;   /* Mostly idle: halve the pool */
+		if (active - shrink < pool.minworkers)
+		    shrink = active - pool.minworkers;
+		pool.retiring += shrink;
+		idle_ticks = 0;
+	    }
+	}
+	else
+	    idle_ticks = 0;
+	V(&pool.mutex);
+
+	if (grow > 0) {
+	    pool_spawn(grow);
+	    pool_report("pool grew");
+	    grow = 0;
+	}
+	if (shrink > 0) {
+	    while (shrink-- > 0)
+		sbuf_insert(&pool.sbuf, -1);
+	    pool_report("pool shrank");
+	    shrink = 0;
+	}
+    }
+    return NULL;
+}
+
+/*
+ * pool_serve - accept connections on listenfd and serve them with a
+ *     pool of between nworkers and maxworkers threads. Does not return.
+ */
+void pool_serve(int listenfd, int nworkers, int maxworkers)
+{
+    int connfd;
+    socklen_t clientlen;
+    struct sockaddr_storage clientaddr;
+    pthread_t tid;
+
+    sbuf_init(&pool.sbuf, POOL_SBUFSIZE);
+    Sem_init(&pool.mutex, 0, 1);
+    pool.minworkers = nworkers;
+    pool.maxworkers = maxworkers < nworkers ? nworkers : maxworkers;
+    pool_spawn(nworkers);
+    Pthread_create(&tid, NULL, pool_manager, NULL);
+
+    while (1) {
+	clientlen = sizeof(clientaddr);
+	if ((connfd = accept(listenfd, (SA *)&clientaddr, &clientlen)) < 0) {
+	    if (errno != EINTR && errno != ECONNABORTED) {
+		fprintf(stderr, "accept error: %s\n", strerror(errno));
+		usleep(10000);  /* e.g. EMFILE: let workers close some */
+	    }
+	    continue;
+	}
+	log_client((SA *)&clientaddr, clientlen);
+
+	P(&pool.mutex);
+	pool.accepted++;
+	V(&pool.mutex);
+	sbuf_insert(&pool.sbuf, connfd);
+    }
+}
@@ -0,0 +1,172 @@
+/*
+ * tiny_shard.c - One listening socket per thread for Tiny (tiny -s).
+ *
+ * open_listenfd_sharded binds nshards listening sockets to the port
+ * with SO_REUSEPORT, and the kernel hashes each incoming connection
+ * onto one of them. Every shard has its own thread that accepts only
+ * from its own socket, so no two threads ever contend on one accept
+ * queue, and it serves what it accepts itself: one connection at a
+ * time, or with -e from its own epoll loop. The kernel keeps hashing
+ * new connections onto a shard busy with one, so a shard that serves
+ * one at a time closes each after its first response (whatever -k
+ * says): a keep-alive client idling on it would stall every
+ * connection queued behind. With -C shard i is pinned to CPU i
+ * (modulo the number of CPUs), and its socket asks the kernel
+ * (SO_INCOMING_CPU) for the connections whose packets that CPU
+ * handles, so a connection is accepted and served where it arrived.
+ *
+ * Each shard counts what it accepts. tiny's reporter thread prints,
+ * on SIGUSR1, each shard's share of the connections and how many are
+ * waiting in its accept queue right now.
+ */
+#include "tiny.h"
+#include <netinet/tcp.h>
+#include <sys/syscall.h>
+
+#ifndef SO_INCOMING_CPU
+#define SO_INCOMING_CPU 49
+#endif
+
+#define SHARD_MAXCPUS 1024     /* Highest CPU number -C can pin to */
+
+typedef struct {
+    int id;
+    int listenfd;
+    int cpu;                   /* CPU the thread is pinned to, or -1 */
+    int evented;               /* Serve from an epoll loop? */
+    unsigned long accepted;    /* Connections accepted (relaxed atomics) */
+} shard_t;
+
+static shard_t *shards;
+static int nshards;
+static __thread shard_t *myshard;  /* The calling thread's shard, if any */
+
+/*
+ * pin_cpu - bind the calling thread to cpu. sched_setaffinity and the
+ *     CPU_SET macros are only declared under _GNU_SOURCE, which clashes
+ *     with csapp.h, so the mask is built by hand.
+ */
+static int pin_cpu(int cpu)
+{
+    unsigned long mask[SHARD_MAXCPUS / (8 * sizeof(unsigned long))];
+
+    memset(mask, 0, sizeof(mask));
+    mask[cpu / (8 * sizeof(unsigned long))] |=
+	1UL << (cpu % (8 * sizeof(unsigned long)));
+    return syscall(SYS_sched_setaffinity, 0, sizeof(mask), mask);
+}
+
+/*
+ * shard_accepted - count a connection accepted by the calling thread's
+ *     shard; does nothing in a thread that isn't a shard's
+ */
+void shard_accepted(void)
+{
+    if (myshard)
+	__atomic_add_fetch(&myshard->accepted, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * shard_thread - thread routine: accept connections on the shard's
+ *     own listening socket and serve them. Does not return.
+ */
+static void *shard_thread(void *vargp)
+{
+    shard_t *sh = vargp;
+    int connfd;
+    socklen_t clientlen;
+    struct sockaddr_storage clientaddr;
+
+    myshard = sh;
+    if (sh->cpu >= 0 && pin_cpu(sh->cpu) < 0)
+	fprintf(stderr, "tiny: shard %d: can't pin to CPU %d: %s\n",
+		sh->id, sh->cpu, strerror(errno));
+    if (sh->evented)
+	epoll_serve(sh->listenfd);      /* Does not return */
+
+    while (1) {
+	clientlen = sizeof(clientaddr);
+	if ((connfd = accept(sh->listenfd, (SA *)&clientaddr,
+			     &clientlen)) < 0) {
+	    if (errno != EINTR && errno != ECONNABORTED) {
+		fprintf(stderr, "accept error: %s\n", strerror(errno));
+		usleep(10000);          /* e.g. EMFILE */
+	    }
+	    continue;
+	}
+	shard_accepted();
+	log_client((SA *)&clientaddr, clientlen);
+	serve_client(connfd);
+	Close(connfd);
+    }
+    return NULL;
+}
+
+/*
+ * shard_serve - listen on port with n SO_REUSEPORT sockets and serve
+ *     each from its own thread, pinned to a CPU if pin, from an epoll
+ *     loop if evented. The calling thread becomes shard 0. Does not
+ *     return.
+ */
+void shard_serve(char *port, int n, int pin, int evented)
+{
+    int i, *fds;
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    pthread_t tid;
+
+    if (ncpus < 1)
+	ncpus = 1;
+    if (ncpus > SHARD_MAXCPUS)
+	ncpus = SHARD_MAXCPUS;
+    if (!evented)
+	keepalive_max = 1;      /* One request per connection (see above) */
+
+    fds = Malloc(n * sizeof(int));
+    Open_listenfd_sharded(port, n, fds);
+    shards = Calloc(n, sizeof(shard_t));
+    for (i = 0; i < n; i++) {
+	shards[i].id = i;
+	shards[i].listenfd = fds[i];
+	shards[i].cpu = pin ? i % ncpus : -1;
+	shards[i].evented = evented;
+	if (pin)
+	    setsockopt(fds[i], SOL_SOCKET, SO_INCOMING_CPU,
+		       &shards[i].cpu, sizeof(int));
+    }
+    Free(fds);
+    nshards = n;                /* Set last: shard_report reads it */
+
+    for (i = 1; i < n; i++)
+	Pthread_create(&tid, NULL, shard_thread, &shards[i]);
+    shard_thread(&shards[0]);
+}
+
+/*
+ * shard_report - print each shard's share of the connections accepted
+ *     and the depth of its accept queue, if tiny is sharded
+ */
+void shard_report(void)
+{
+    int i;
+    unsigned long accepted, total = 0;
+    struct tcp_info ti;
+    socklen_t len;
+
+    for (i = 0; i < nshards; i++)
+	total += __atomic_load_n(&shards[i].accepted, __ATOMIC_RELAXED);
+    for (i = 0; i < nshards; i++) {
+	accepted = __atomic_load_n(&shards[i].accepted, __ATOMIC_RELAXED);
+	/* For a listening socket, tcpi_unacked is the accept queue's
+	   length and tcpi_sacked its limit */
+	len = sizeof(ti);
+	if (getsockopt(shards[i].listenfd, IPPROTO_TCP, TCP_INFO,
+		       &ti, &len) < 0)
+	    ti.tcpi_unacked = ti.tcpi_sacked = 0;
+	fprintf(stderr, "tiny: shard %d", i);
+	if (shards[i].cpu >= 0)
+	    fprintf(stderr, " (cpu %d)", shards[i].cpu);
+	fprintf(stderr, ": %lu accepted (%.1f%%), queue %u/%u\n", accepted,
+		total ? 100.0 * accepted / total : 0.0, ti.tcpi_unacked,
+		ti.tcpi_sacked);
+    }
+}
@@ -0,0 +1,844 @@
+/*
+ * tiny_uring.c - io_uring event loop for Tiny (tiny -u).
+ *
+ * The same connection state machine as tiny_epoll.c, but instead of
+ * being told when a socket is ready and then making a read, write or
+ * sendfile call of its own, the loop queues the operation itself
+ * (accept, poll, read, write, and the reads of a static file) on an
+ * io_uring submission queue and picks up the result from the
+ * completion queue. Every pass round the loop is one io_uring_enter
+ * call that both submits everything queued since the last pass and
+ * waits for the next completions, so a request on a persistent
+ * connection costs no system calls of its own beyond opening the file
+ * it asks for. The ring is driven through the raw system calls; there
+ * is no liburing.
+ *
+ * Socket and file I/O goes through buffers registered with the kernel
+ * once at startup, which saves it pinning and unpinning the pages on
+ * every operation. Each buffer holds a request (the first MAXLINE
+ * bytes) and a staging area where the response head is built and the
+ * file is read in chunks behind it, so the head and the start of the
+ * body go out in one write. While buffers are plentiful an idle
+ * connection keeps one and reads its next request straight into it.
+ * Once half of them are in use, a connection holds a buffer only while
+ * it has a request in progress: an idle one waits on a poll operation,
+ * which costs nothing but its uconn_t, and takes a buffer when the
+ * next request arrives (or queues for one if they are all in use).
+ * Cached objects are written straight from the cache with writev.
+ *
+ * Each connection has at most one operation in flight. To close a
+ * connection that has one (an idle connection that timed out, say),
+ * the loop shuts the socket down, which makes the operation complete,
+ * and frees the connection when it does.
+ *
+ * Connections have the same deadlines as in the epoll loop, kept on a
+ * timer wheel and set whenever an operation is queued. A timeout
+ * operation wakes the loop in time for the next one that may expire,
+ * or after a second at most.
+ *
+ * If the kernel has no io_uring, or lacks one of the operations used
+ * here, tiny falls back to the epoll loop.
+ */
+#include "tiny.h"
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <poll.h>
+
+#define UR_ENTRIES 1024               /* Submission queue slots */
+#define UR_NBUFS   256                /* Registered buffers */
+#define UR_BUFSIZE (64 * 1024)        /* Bytes per registered buffer */
+#define UR_STAGE   (UR_BUFSIZE - MAXLINE) /* Head and file chunk area */
+
+/* user_data of the operations that don't belong to a connection */
+#define UD_ACCEPT 1
+#define UD_TICK   2
+
+/* Connection states: the operation in flight, or the one wanted */
+#define UC_POLL  0   /* Waiting for the next request to start arriving */
+#define UC_WAIT  1   /* Waiting for a free buffer to read it into */
+#define UC_READ  2   /* Reading the request head */
+#define UC_FILE  3   /* Reading the next chunk of the file */
+#define UC_WRITE 4   /* Writing the response */
+
+typedef struct uconn {
+    int fd;
+    int state;            /* UC_* */
+    int busy;             /* Is an operation in flight? */
+    int closing;          /* Close once it completes */
+    int flags;            /* RESP_* flags for the current response */
+    int nrequests;        /* Requests started on this connection */
+    int buf;              /* Registered buffer, or -1 */
+    char *inbuf;          /* Request bytes received so far (MAXLINE) */
+    size_t inlen;
+    http_req_t *req;      /* Parse of the request at the front of inbuf */
+    size_t reqlen;        /* Length of the request being answered (0 if
+			     it was malformed or overflowed inbuf) */
+    char *out;            /* Staging area: head and file bytes to send */
+    size_t outlen, outoff;
+    int filefd;           /* File for a static response body, or -1 */
+    off_t fileoff;        /* Next byte of the file to read */
+    size_t filelen;
+    cache_obj_t *obj;     /* Cached object to send after the head, or NULL */
+    size_t objoff;
+    struct iovec iov[2];  /* Head and object, for an object's writev */
+    lat_req_t lat;        /* The current request's progress */
+    tw_timer_t deadline;  /* On the loop's wheel, kind DL_* */
+    int progress;         /* A response moved on since it was set */
+    struct uconn *waitnext; /* Queue for a free buffer */
+} uconn_t;
+
+typedef struct {
+    int fd;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    unsigned sq_entries;
+    unsigned tail;        /* Our copy of the SQ tail, ahead of the kernel's */
+} ring_t;
+
+typedef struct {
+    ring_t ring;
+    int listenfd;
+    int sparefd;          /* Reserved descriptor for shedding on EMFILE */
+    struct sockaddr_storage clientaddr;  /* Filled in by the accept */
+    socklen_t clientlen;
+    struct __kernel_timespec tick;
+    char *bufs;           /* UR_NBUFS registered buffers */
+    http_req_t *reqs;     /* A parser state for each buffer */
+    int *freebufs;        /* Stack of free buffer indexes */
+    int nfree;
+    uconn_t *waithead;    /* Connections waiting for a buffer */
+    uconn_t *waittail;
+    tw_t wheel;           /* Every connection's deadline */
+    long now;             /* ms, as of the last io_uring_enter */
+} uring_t;
+
+static uring_t ur;
+
+static void ur_accept(void);
+static void ur_expire(void);
+static void ur_tick(void);
+static void ur_deadline(uconn_t *c);
+static void conn_complete(uconn_t *c, int res);
+static void conn_idle(uconn_t *c);
+static void conn_poll(uconn_t *c);
+static void conn_recv(uconn_t *c);
+static void conn_release(uconn_t *c);
+static void conn_parse(uconn_t *c);
+static int conn_request(uconn_t *c);
+static void conn_send(uconn_t *c);
+static void conn_done(uconn_t *c);
+static void conn_close(uconn_t *c);
+
+/*
+ * ring_setup - create an io_uring with room for entries submissions
+ *     and map its queues. Returns 0, or -1 with errno set.
+ */
+static int ring_setup(ring_t *r, unsigned entries)
+{
+    struct io_uring_params p;
+    size_t sqlen, cqlen;
+    char *sq, *cq;
+
+    memset(&p, 0, sizeof(p));
+    if ((r->fd = syscall(__NR_io_uring_setup, entries, &p)) < 0)
+	return -1;
+    if (!(p.features & IORING_FEAT_NODROP)) {
+	/* Completions could be lost if more operations are in flight
+	   than the completion queue holds */
+	close(r->fd);
+	errno = ENOSYS;
+	return -1;
+    }
+
+    sqlen = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cqlen = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP && cqlen > sqlen)
+	sqlen = cqlen;
+    sq = mmap(0, sqlen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+	      r->fd, IORING_OFF_SQ_RING);
+    if (sq == MAP_FAILED)
+	goto fail;
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+	cq = sq;
+    else if ((cq = mmap(0, cqlen, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, r->fd,
+			IORING_OFF_CQ_RING)) == MAP_FAILED)
+	goto fail;
+    r->sqes = mmap(0, p.sq_entries * sizeof(struct io_uring_sqe),
+		   PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		   r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED)
+	goto fail;
+
+    r->sq_head = (unsigned *)(sq + p.sq_off.head);
+    r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    r->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned *)(sq + p.sq_off.array);
+    r->cq_head = (unsigned *)(cq + p.cq_off.head);
+    r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    r->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    r->sq_entries = p.sq_entries;
+    r->tail = *r->sq_tail;
+    return 0;
+
+ fail:
+    close(r->fd);
+    return -1;
+}
+
+/*
+ * ring_supports - can the kernel do every operation the loop uses?
+ */
+static int ring_supports(ring_t *r)
+{
+    static const int ops[] = {
+	IORING_OP_ACCEPT, IORING_OP_POLL_ADD, IORING_OP_READ_FIXED,
+	IORING_OP_WRITE_FIXED, IORING_OP_WRITEV, IORING_OP_TIMEOUT
+    };
+    struct io_uring_probe *probe;
+    size_t i, len;
+    int ok = 1;
+
+    len = sizeof(*probe) + IORING_OP_LAST * sizeof(struct io_uring_probe_op);
+    probe = Calloc(1, len);
+    if (syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_PROBE,
+		probe, IORING_OP_LAST) < 0)
+	ok = 0;
+    for (i = 0; ok && i < sizeof(ops) / sizeof(ops[0]); i++)
+	if (ops[i] > probe->last_op ||
+	    !(probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED))
+	    ok = 0;
+    Free(probe);
+    return ok;
+}
+
+/*
+ * ring_enter - submit everything queued and, if wait, wait for at
+ *     least one completion
+ */
+static void ring_enter(ring_t *r, int wait)
+{
+    unsigned n;
+
+    /* Publish the new SQEs before the kernel is told about them */
+    n = r->tail - *r->sq_tail;
+    __atomic_store_n(r->sq_tail, r->tail, __ATOMIC_RELEASE);
+    while (syscall(__NR_io_uring_enter, r->fd, n, wait ? 1 : 0,
+		   wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0) < 0) {
+	if (errno == EINTR)             /* Interrupted by a signal */
+	    continue;
+	if (errno == EAGAIN || errno == EBUSY) {
+	    /* Out of resources for now: let completions drain first */
+	    n = 0;
+	    if (!wait)
+		return;
+	    continue;
+	}
+	unix_error("io_uring_enter error");
+    }
+}
+
+/*
+ * ring_sqe - return a cleared submission queue entry for an operation
+ *     on fd, submitting what is queued first if the queue is full
+ */
+static struct io_uring_sqe *ring_sqe(ring_t *r, int opcode, int fd,
+				     unsigned long data)
+{
+    struct io_uring_sqe *sqe;
+    unsigned idx;
+
+    while (r->tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE) ==
+	   r->sq_entries)
+	ring_enter(r, 0);
+    idx = r->tail & *r->sq_mask;
+    sqe = &r->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->user_data = data;
+    r->sq_array[idx] = idx;
+    r->tail++;
+    return sqe;
+}
+
+/*
+ * ur_init - set up the ring and register the buffers. Returns 0, or
+ *     -1 with errno set if io_uring can't be used.
+ */
+static int ur_init(void)
+{
+    struct iovec *iov;
+    int i, rc;
+
+    if (ring_setup(&ur.ring, UR_ENTRIES) < 0)
+	return -1;
+    if (!ring_supports(&ur.ring)) {
+	close(ur.ring.fd);
+	errno = ENOSYS;
+	return -1;
+    }
+
+    ur.bufs = mmap(0, (size_t)UR_NBUFS * UR_BUFSIZE, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ur.bufs == MAP_FAILED)
+	unix_error("mmap error");
+    /* CGI children get no copy, so a write here after a fork can never
+       move a page out from under the kernel */
+    madvise(ur.bufs, (size_t)UR_NBUFS * UR_BUFSIZE, MADV_DONTFORK);
+    iov = Malloc(UR_NBUFS * sizeof(struct iovec));
+    for (i = 0; i < UR_NBUFS; i++) {
+	iov[i].iov_base = ur.bufs + (size_t)i * UR_BUFSIZE;
+	iov[i].iov_len = UR_BUFSIZE;
+    }
+    rc = syscall(__NR_io_uring_register, ur.ring.fd, IORING_REGISTER_BUFFERS,
+		 iov, UR_NBUFS);
+    Free(iov);
+    if (rc < 0) {                       /* Over RLIMIT_MEMLOCK, say */
+	close(ur.ring.fd);
+	munmap(ur.bufs, (size_t)UR_NBUFS * UR_BUFSIZE);
+	return -1;
+    }
+
+    ur.reqs = Malloc(UR_NBUFS * sizeof(http_req_t));
+    ur.freebufs = Malloc(UR_NBUFS * sizeof(int));
+    for (i = 0; i < UR_NBUFS; i++)
+	ur.freebufs[i] = UR_NBUFS - 1 - i;
+    ur.nfree = UR_NBUFS;
+    return 0;
+}
+
+/*
+ * uring_serve - serve all connections on listenfd from one io_uring
+ *     event loop, or from the epoll loop if io_uring isn't available.
+ *     Does not return.
+ */
+void uring_serve(int listenfd)
+{
+    struct io_uring_cqe *cqe;
+    ring_t *r = &ur.ring;
+    unsigned head;
+    unsigned long data;
+    int res, flags;
+
+    if (ur_init() < 0) {
+	fprintf(stderr, "tiny: no io_uring (%s), using epoll\n",
+		strerror(errno));
+	epoll_serve(listenfd);
+    }
+
+    fcntl(listenfd, F_SETFD, FD_CLOEXEC);
+    fcntl(ur.ring.fd, F_SETFD, FD_CLOEXEC);
+    ur.listenfd = listenfd;
+    ur.sparefd = Open("/dev/null", O_RDONLY | O_CLOEXEC, 0);
+    ur.now = tw_clock();
+    tw_init(&ur.wheel, DL_TICK, ur.now);
+
+    ur_accept();
+    ur_tick();
+
+    while (1) {
+	ring_enter(r, 1);
+	ur.now = tw_clock();
+
+	/* Handle every completion that has arrived */
+	head = *r->cq_head;
+	while (head != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) {
+	    cqe = &r->cqes[head & *r->cq_mask];
+	    data = cqe->user_data;
+	    res = cqe->res;
+	    __atomic_store_n(r->cq_head, ++head, __ATOMIC_RELEASE);
+
+	    if (data == UD_ACCEPT) {
+		if (res >= 0) {
+		    uconn_t *c = Calloc(1, sizeof(uconn_t));
+
+		    /* Numeric: -r is off, since a reverse DNS query
+		       would stall the loop */
+		    log_client((SA *)&ur.clientaddr, ur.clientlen);
+		    c->fd = res;
+		    c->buf = c->filefd = -1;
+		    lat_reset(&c->lat);
+		    lat_mark(&c->lat, LAT_ACCEPT);
+		    tw_timer_init(&c->deadline, c);
+		    conn_idle(c);
+		}
+		else if (res == -EMFILE || res == -ENFILE) {
+		    /* Give up the spare descriptor long enough to accept
+		       and drop one client. No accept of the ring's is
+		       queued now, so the listening socket can be made
+		       nonblocking meanwhile: if the client has already
+		       gone, the loop mustn't wait for the next one. */
+		    close(ur.sparefd);
+		    flags = fcntl(ur.listenfd, F_GETFL);
+		    fcntl(ur.listenfd, F_SETFL, flags | O_NONBLOCK);
+		    if ((res = accept(ur.listenfd, NULL, NULL)) >= 0) {
+			close(res);
+			fprintf(stderr, "tiny: out of descriptors, "
+				"dropped a client\n");
+		    }
+		    fcntl(ur.listenfd, F_SETFL, flags);
+		    ur.sparefd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+		}
+		else if (res != -EINTR && res != -ECONNABORTED)
+		    fprintf(stderr, "accept error: %s\n", strerror(-res));
+		ur_accept();
+	    }
+	    else if (data == UD_TICK)
+		ur_tick();
+	    else
+		conn_complete((uconn_t *)data, res);
+	}
+	ur_expire();
+    }
+}
+
+/*
+ * ur_accept - queue an accept on the listening socket
+ */
+static void ur_accept(void)
+{
+    struct io_uring_sqe *sqe;
+
+    ur.clientlen = sizeof(ur.clientaddr);
+    sqe = ring_sqe(&ur.ring, IORING_OP_ACCEPT, ur.listenfd, UD_ACCEPT);
+    sqe->addr = (unsigned long)&ur.clientaddr;
+    sqe->addr2 = (unsigned long)&ur.clientlen;
+    sqe->accept_flags = SOCK_CLOEXEC;
+}
+
+/*
+ * ur_tick - queue the timeout that wakes the loop when the next
+ *     deadline may expire (deadlines armed meanwhile are a second or
+ *     more away, so a second at most is soon enough), or as soon as
+ *     anything else completes
+ */
+static void ur_tick(void)
+{
+    struct io_uring_sqe *sqe;
+    long ms = tw_timeout(&ur.wheel, tw_clock(), 1000);
+
+    if (ms < DL_TICK)
+	ms = DL_TICK;
+    ur.tick.tv_sec = ms / 1000;
+    ur.tick.tv_nsec = ms % 1000 * 1000000;
+    sqe = ring_sqe(&ur.ring, IORING_OP_TIMEOUT, -1, UD_TICK);
+    sqe->addr = (unsigned long)&ur.tick;
+    sqe->len = 1;
+}
+
+/*
+ * ur_deadline - give c the deadline its state calls for, as
+ *     ev_deadline does in the epoll loop: DL_WRITE while it has a
+ *     response to send, DL_HEADER while part of a request head is
+ *     buffered, and DL_IDLE otherwise
+ */
+static void ur_deadline(uconn_t *c)
+{
+    int kind = c->state == UC_FILE || c->state == UC_WRITE ? DL_WRITE :
+	c->inlen > 0 ? DL_HEADER : DL_IDLE;
+
+    if (kind != c->deadline.kind || c->progress)
+	tw_arm(&ur.wheel, &c->deadline, kind, ur.now + deadline_ms(kind));
+    c->progress = 0;
+}
+
+/*
+ * ur_expire - close the connections whose deadlines have passed,
+ *     counting them by the deadline they missed
+ */
+static void ur_expire(void)
+{
+    tw_timer_t *t;
+
+    while ((t = tw_expire(&ur.wheel, ur.now)) != NULL) {
+	deadline_missed(t->kind);
+	conn_close(t->data);
+    }
+}
+
+/*
+ * conn_submit - queue an operation for c (it has none in flight) and
+ *     return its entry
+ */
+static struct io_uring_sqe *conn_submit(uconn_t *c, int opcode, int fd,
+					int state)
+{
+    c->state = state;
+    c->busy = 1;
+    ur_deadline(c);
+    return ring_sqe(&ur.ring, opcode, fd, (unsigned long)c);
+}
+
+/*
+ * conn_complete - carry on with c now that its operation has finished
+ *     with result res
+ */
+static void conn_complete(uconn_t *c, int res)
+{
+    c->busy = 0;
+    if (c->closing) {
+	conn_close(c);
+	return;
+    }
+
+    switch (c->state) {
+    case UC_POLL:
+	conn_recv(c);
+	break;
+
+    case UC_READ:
+	if (res <= 0) {                 /* Client went away or shut down */
+	    conn_close(c);
+	    return;
+	}
+	c->inlen += res;
+	conn_parse(c);
+	break;
+
+    case UC_FILE:
+	if (res <= 0) {                 /* The file shrank under us */
+	    conn_close(c);
+	    return;
+	}
+	c->outlen += res;
+	c->fileoff += res;
+	conn_send(c);
+	break;
+
+    case UC_WRITE:
+	if (res <= 0) {
+	    conn_close(c);
+	    return;
+	}
+	c->progress = 1;
+	if ((size_t)res <= c->outlen - c->outoff)
+	    c->outoff += res;
+	else {                          /* writev went into the object */
+	    c->objoff += res - (c->outlen - c->outoff);
+	    c->outoff = c->outlen;
+	}
+	if (c->outoff == c->outlen)
+	    lat_mark(&c->lat, LAT_HEAD);
+	conn_send(c);
+	break;
+    }
+}
+
+/*
+ * conn_idle - wait for c's next request. While at least half the
+ *     buffers are free, read it straight into a buffer, saving a trip
+ *     round the loop; otherwise give c's buffer back and poll.
+ */
+static void conn_idle(uconn_t *c)
+{
+    if (ur.nfree >= UR_NBUFS / 2)
+	conn_recv(c);
+    else {
+	conn_release(c);
+	conn_poll(c);
+    }
+}
+
+/*
+ * conn_poll - wait, without holding a buffer, for c's next request
+ */
+static void conn_poll(uconn_t *c)
+{
+    struct io_uring_sqe *sqe;
+
+    sqe = conn_submit(c, IORING_OP_POLL_ADD, c->fd, UC_POLL);
+    sqe->poll32_events = POLLIN;
+}
+
+/*
+ * conn_recv - read more of c's request into its buffer, taking a free
+ *     buffer first if it has none, or queueing for one if none is free
+ */
+static void conn_recv(uconn_t *c)
+{
+    struct io_uring_sqe *sqe;
+
+    if (c->buf < 0) {
+	if (ur.nfree == 0) {
+	    c->state = UC_WAIT;
+	    ur_deadline(c);
+	    c->waitnext = NULL;
+	    if (ur.waittail)
+		ur.waittail->waitnext = c;
+	    else
+		ur.waithead = c;
+	    ur.waittail = c;
+	    return;
+	}
+	c->buf = ur.freebufs[--ur.nfree];
+	c->inbuf = ur.bufs + (size_t)c->buf * UR_BUFSIZE;
+	c->out = c->inbuf + MAXLINE;
+	c->req = &ur.reqs[c->buf];
+	http_init(c->req);
+    }
+
+    sqe = conn_submit(c, IORING_OP_READ_FIXED, c->fd, UC_READ);
+    sqe->addr = (unsigned long)(c->inbuf + c->inlen);
+    sqe->len = MAXLINE - c->inlen;
+    sqe->buf_index = c->buf;
+}
+
+/*
+ * conn_release - give c's buffer back, handing it straight to the
+ *     first connection waiting for one
+ */
+static void conn_release(uconn_t *c)
+{
+    uconn_t *w;
+
+    if (c->buf < 0)
+	return;
+    ur.freebufs[ur.nfree++] = c->buf;
+    c->buf = -1;
+    c->inbuf = c->out = NULL;
+    c->req = NULL;
+    if ((w = ur.waithead) != NULL) {
+	if ((ur.waithead = w->waitnext) == NULL)
+	    ur.waittail = NULL;
+	conn_recv(w);
+    }
+}
+
+/*
+ * conn_parse - feed the bytes buffered so far to the parser, then read
+ *     more or start answering the request
+ */
+static void conn_parse(uconn_t *c)
+{
+    int rc = http_parse(c->req, c->inbuf, c->inlen);
+
+    lat_mark(&c->lat, LAT_FIRST);
+    if (rc == HTTP_AGAIN && c->inlen < MAXLINE) {
+	conn_recv(c);
+	return;
+    }
+    c->reqlen = rc == HTTP_DONE ? c->req->hdrlen : 0;
+    lat_mark(&c->lat, LAT_PARSED);
+    if (conn_request(c) < 0) {
+	conn_close(c);
+	return;
+    }
+    conn_send(c);
+}
+
+/*
+ * conn_request - route the buffered request and build its response
+ *     head in the staging area. Returns -1 if the connection should be
+ *     closed now.
+ */
+static int conn_request(uconn_t *c)
+{
+    char *method, *uri, *version;
+    route_t rt;
+
+    c->nrequests++;
+    if (c->reqlen == 0) {               /* Malformed or too big */
+	c->flags = 0;
+	c->outlen = error_response(c->out, "request", "400", "Bad Request",
+				   "Tiny couldn't parse the request headers",
+				   c->flags);
+	c->lat.outcome = LAT_ERROR;
+	c->lat.out = c->outlen;
+	return 0;
+    }
+    c->lat.in = c->reqlen;
+    if (alog_on && alog_sample(ALOG_REQUEST))
+	alog_request(c->inbuf, c->reqlen);
+
+    http_terminate(c->req, c->inbuf);
+    method = http_str(c->inbuf, c->req->method);
+    uri = http_str(c->inbuf, c->req->uri);
+    version = http_str(c->inbuf, c->req->version);
+    c->flags = response_flags(method, version,
+			      connection_header(c->req, c->inbuf),
+			      c->nrequests);
+    route_request(method, uri, &rt);
+    lat_mark(&c->lat, LAT_ROUTED);
+
+    if (rt.kind == ROUTE_DYNAMIC) {
+	/* The CGI program writes straight to the (blocking) socket, and
+	   the child is reaped by tiny's reporter thread */
+	spawn_dynamic(c->fd, rt.filename, rt.cgiargs, 0);
+	c->lat.outcome = LAT_DYNAMIC;
+	lat_mark(&c->lat, LAT_HEAD);
+	lat_record(&c->lat);
+	return -1;
+    }
+
+    if (rt.kind == ROUTE_STATS) {       /* Not recorded itself */
+	c->outlen = stats_response(c->out, rt.cgiargs, c->flags);
+	return 0;
+    }
+
+    if (rt.kind == ROUTE_STATIC &&
+	(c->obj = static_object(rt.filename, &rt.sbuf)) != NULL) {
+	/* Cached: per-request headers, then the object in the same writev */
+	c->outlen = status_headers(c->out, c->flags);
+	c->lat.outcome = LAT_STATIC;
+	c->lat.out = c->outlen + c->obj->size;
+	if (alog_on)
+	    alog_response(c->out, c->outlen, c->obj->data, c->obj->hdrlen,
+			  NULL, 0);
+	return 0;
+    }
+
+    if (rt.kind == ROUTE_STATIC &&
+	(c->filelen = rt.sbuf.st_size) > 0 &&
+	(c->filefd = open(rt.filename, O_RDONLY | O_CLOEXEC, 0)) < 0) {
+	rt.kind = ROUTE_ERROR;          /* Lost a race with the file */
+	rt.errnum = "403";
+	rt.shortmsg = "Forbidden";
+	rt.longmsg = "Tiny couldn't read the file";
+	c->filelen = 0;
+    }
+
+    if (rt.kind == ROUTE_STATIC) {
+	c->outlen = static_headers(c->out, rt.filename, rt.sbuf.st_size,
+				   c->flags);
+	c->lat.outcome = LAT_STATIC;
+	if (alog_on)
+	    alog_response(c->out, c->outlen, NULL, 0, NULL, 0);
+    }
+    else {
+	c->outlen = error_response(c->out, rt.errcause, rt.errnum,
+				   rt.shortmsg, rt.longmsg, c->flags);
+	c->lat.outcome = LAT_ERROR;
+    }
+    c->lat.out = c->outlen + c->filelen;
+    return 0;
+}
+
+/*
+ * conn_send - queue the next step of c's response. File bytes are read
+ *     into the staging area behind whatever is there and not yet sent,
+ *     until it is full, so each write carries as much as it can.
+ */
+static void conn_send(uconn_t *c)
+{
+    struct io_uring_sqe *sqe;
+    size_t n;
+
+    if (c->outoff == c->outlen && c->filefd >= 0)
+	c->outoff = c->outlen = 0;      /* Staging area sent: refill it */
+
+    if (c->filefd >= 0 && (size_t)c->fileoff < c->filelen &&
+	c->outoff == 0 && c->outlen < UR_STAGE) {
+	n = c->filelen - c->fileoff;
+	if (n > UR_STAGE - c->outlen)
+	    n = UR_STAGE - c->outlen;
+	sqe = conn_submit(c, IORING_OP_READ_FIXED, c->filefd, UC_FILE);
+	sqe->addr = (unsigned long)(c->out + c->outlen);
+	sqe->len = n;
+	sqe->off = c->fileoff;
+	sqe->buf_index = c->buf;
+	return;
+    }
+
+    if (c->obj && (c->outoff < c->outlen || c->objoff < c->obj->size)) {
+	c->iov[0].iov_base = c->out + c->outoff;
+	c->iov[0].iov_len = c->outlen - c->outoff;
+	c->iov[1].iov_base = c->obj->data + c->objoff;
+	c->iov[1].iov_len = c->obj->size - c->objoff;
+	sqe = conn_submit(c, IORING_OP_WRITEV, c->fd, UC_WRITE);
+	sqe->addr = (unsigned long)c->iov;
+	sqe->len = 2;
+	return;
+    }
+
+    if (c->outoff < c->outlen) {
+	sqe = conn_submit(c, IORING_OP_WRITE_FIXED, c->fd, UC_WRITE);
+	sqe->addr = (unsigned long)(c->out + c->outoff);
+	sqe->len = c->outlen - c->outoff;
+	sqe->buf_index = c->buf;
+	return;
+    }
+
+    conn_done(c);
+}
+
+/*
+ * conn_done - finish the current request: close the connection, or
+ *     move on to a request the client pipelined behind it, or give the
+ *     buffer back and wait for the next one
+ */
+static void conn_done(uconn_t *c)
+{
+    lat_mark(&c->lat, LAT_HEAD);
+    if (c->filelen > 0 || c->obj)
+	lat_mark(&c->lat, LAT_BODY);
+    lat_record(&c->lat);
+    if (!(c->flags & RESP_KEEPALIVE)) {
+	conn_close(c);
+	return;
+    }
+
+    if (c->obj)
+	cache_release(static_cache, c->obj);
+    if (c->filefd >= 0)
+	close(c->filefd);
+    c->obj = NULL;
+    c->filefd = -1;
+    c->fileoff = c->filelen = c->objoff = c->outlen = c->outoff = 0;
+    c->progress = 1;                    /* A new deadline for the next one */
+
+    c->inlen -= c->reqlen;
+    if (c->inlen > 0) {
+	memmove(c->inbuf, c->inbuf + c->reqlen, c->inlen);
+	c->reqlen = 0;
+	http_init(c->req);
+	conn_parse(c);
+    }
+    else {
+	c->reqlen = 0;
+	http_init(c->req);
+	conn_idle(c);
+    }
+}
+
+/*
+ * conn_close - release a connection and everything it holds. If it
+ *     has an operation in flight, shut the socket down to make the
+ *     operation finish, and free it when it does.
+ */
+static void conn_close(uconn_t *c)
+{
+    uconn_t *w, *prev;
+
+    /* Off the wheel, so it isn't expired twice */
+    tw_cancel(&ur.wheel, &c->deadline);
+
+    if (c->busy) {
+	if (!c->closing) {
+	    c->closing = 1;
+	    shutdown(c->fd, SHUT_RDWR);
+	}
+	return;
+    }
+
+    if (c->state == UC_WAIT) {          /* Take it out of the buffer queue */
+	for (prev = NULL, w = ur.waithead; w != c; prev = w, w = w->waitnext)
+	    ;
+	if (prev)
+	    prev->waitnext = c->waitnext;
+	else
+	    ur.waithead = c->waitnext;
+	if (ur.waittail == c)
+	    ur.waittail = prev;
+    }
+    if (c->obj)
+	cache_release(static_cache, c->obj);
+    if (c->filefd >= 0)
+	close(c->filefd);
+    close(c->fd);
+    conn_release(c);
+    free(c);
+}
@@ -0,0 +1,150 @@
+/*
+ * tinylfu.c - A TinyLFU frequency filter for cache admission.
+ *     See tinylfu.h.
+ */
+#include "csapp.h"
+#include "tinylfu.h"
+
+#define DOOR_HASHES 3          /* Bits set per key in the doorkeeper */
+#define LONGBITS (8 * sizeof(unsigned long))
+
+#define load(p) __atomic_load_n((p), __ATOMIC_RELAXED)
+#define store(p, v) __atomic_store_n((p), (v), __ATOMIC_RELAXED)
+
+/* mix - a second, independent hash of h (the splitmix64 finalizer) */
+static unsigned long mix(unsigned long h)
+{
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9UL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebUL;
+    return h ^ (h >> 31);
+}
+
+/* pow2 - the smallest power of two >= n (and >= 64) */
+static size_t pow2(size_t n)
+{
+    size_t p = 64;
+
+    while (p < n)
+	p <<= 1;
+    return p;
+}
+
+/*
+ * tinylfu_init - create a filter for a cache of about nitems objects
+ */
+void tinylfu_init(tinylfu_t *tl, size_t nitems)
+{
+    tl->width = pow2(nitems);
+    tl->counters = Calloc(TINYLFU_DEPTH * tl->width, 1);
+    tl->doorbits = pow2(8 * nitems);
+    tl->door = Calloc(tl->doorbits / LONGBITS, sizeof(unsigned long));
+    tl->samples = 0;
+    tl->window = 10 * (nitems > 0 ? nitems : 1);
+    tl->agings = 0;
+}
+
+/*
+ * The i'th hash of a key: double hashing from h and mix(h), with the
+ * second made odd so that the rows' indices differ
+ */
+#define nth(h, h2, i) ((h) + (i) * (h2))
+
+/*
+ * door_add - set the key's bits in the doorkeeper; return 1 if they
+ *     were all set already
+ */
+static int door_add(tinylfu_t *tl, unsigned long h, unsigned long h2)
+{
+    int i, seen = 1;
+    unsigned long bit, mask;
+
+    for (i = 0; i < DOOR_HASHES; i++) {
+	bit = nth(h2, h, i) & (tl->doorbits - 1);
+	mask = 1UL << (bit % LONGBITS);
+	if (!(__atomic_fetch_or(&tl->door[bit / LONGBITS], mask,
+				__ATOMIC_RELAXED) & mask))
+	    seen = 0;
+    }
+    return seen;
+}
+
+/* door_has - are all the key's bits set in the doorkeeper? */
+static int door_has(tinylfu_t *tl, unsigned long h, unsigned long h2)
+{
+    int i;
+    unsigned long bit;
+
+    for (i = 0; i < DOOR_HASHES; i++) {
+	bit = nth(h2, h, i) & (tl->doorbits - 1);
+	if (!(load(&tl->door[bit / LONGBITS]) & (1UL << (bit % LONGBITS))))
+	    return 0;
+    }
+    return 1;
+}
+
+/* sketch_min - the key's smallest counter, and where each one is */
+static int sketch_min(tinylfu_t *tl, unsigned long h, unsigned long h2,
+		      unsigned char **cells)
+{
+    int i, c, min = TINYLFU_MAXCOUNT;
+
+    for (i = 0; i < TINYLFU_DEPTH; i++) {
+	cells[i] = &tl->counters[i * tl->width +
+				 (nth(h, h2, i) & (tl->width - 1))];
+	if ((c = load(cells[i])) < min)
+	    min = c;
+    }
+    return min;
+}
+
+/*
+ * age - halve every counter and clear the doorkeeper
+ */
+static void age(tinylfu_t *tl)
+{
+    size_t i;
+
+    for (i = 0; i < TINYLFU_DEPTH * tl->width; i++)
+	store(&tl->counters[i], load(&tl->counters[i]) >> 1);
+    for (i = 0; i < tl->doorbits / LONGBITS; i++)
+	store(&tl->door[i], 0);
+    __atomic_add_fetch(&tl->agings, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * tinylfu_record - count an access to the key whose hash is h
+ */
+void tinylfu_record(tinylfu_t *tl, unsigned long h)
+{
+    int i, min;
+    unsigned long h2 = mix(h) | 1;
+    unsigned char *cells[TINYLFU_DEPTH];
+
+    if (__atomic_add_fetch(&tl->samples, 1, __ATOMIC_RELAXED) == tl->window) {
+	age(tl);
+	store(&tl->samples, 0);
+    }
+    if (!door_add(tl, h, h2))
+	return;                 /* First sighting this window */
+
+    /* Conservative update: raise only the counters at the minimum */
+    if ((min = sketch_min(tl, h, h2, cells)) == TINYLFU_MAXCOUNT)
+	return;
+    for (i = 0; i < TINYLFU_DEPTH; i++)
+	if (load(cells[i]) == min)
+	    store(cells[i], min + 1);
+}
+
+/*
+ * tinylfu_estimate - how often has the key whose hash is h been asked
+ *     for lately?
+ */
+int tinylfu_estimate(tinylfu_t *tl, unsigned long h)
+{
+    unsigned long h2 = mix(h) | 1;
+    unsigned char *cells[TINYLFU_DEPTH];
+
+    return sketch_min(tl, h, h2, cells) + door_has(tl, h, h2);
+}
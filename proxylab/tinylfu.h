@@ -0,0 +1,44 @@
+/*
+ * tinylfu.h - A TinyLFU frequency filter for cache admission.
+ *
+ * TinyLFU estimates how often each key has been asked for recently,
+ * in a few bytes per cached object, so that a cache can refuse a new
+ * object that is asked for less often than the ones it would evict.
+ * That keeps one pass over many one-off objects (a crawler, a big
+ * download list) from flushing the small hot objects out of the cache.
+ *
+ * The estimate comes from a count-min sketch: four rows of 8-bit
+ * counters, saturating at TINYLFU_MAXCOUNT, indexed by four hashes of
+ * the key; a key's count is the smallest of its four counters. A key's
+ * first access only sets its bits in a small Bloom filter (the
+ * doorkeeper), so the many keys seen just once never reach the sketch.
+ * Every window accesses (ten per object the cache holds), all counters
+ * are halved and the doorkeeper is cleared, so old popularity fades.
+ *
+ * Keys are given by their 64-bit hash. Counters are updated with
+ * relaxed atomics and no lock; concurrent updates may occasionally be
+ * lost, which only makes the estimate a little less exact.
+ */
+#ifndef __TINYLFU_H__
+#define __TINYLFU_H__
+
+#include <stddef.h>
+
+#define TINYLFU_DEPTH    4
+#define TINYLFU_MAXCOUNT 15
+
+typedef struct {
+    unsigned char *counters;   /* TINYLFU_DEPTH rows of width counters */
+    size_t width;              /* Power of two */
+    unsigned long *door;       /* Doorkeeper bits */
+    size_t doorbits;           /* Power of two */
+    unsigned long samples;     /* Accesses since the last aging */
+    unsigned long window;      /* Accesses between agings */
+    unsigned long agings;
+} tinylfu_t;
+
+void tinylfu_init(tinylfu_t *tl, size_t nitems);
+void tinylfu_record(tinylfu_t *tl, unsigned long h);
+int tinylfu_estimate(tinylfu_t *tl, unsigned long h);
+
+#endif /* __TINYLFU_H__ */